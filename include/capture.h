@@ -0,0 +1,63 @@
+#ifndef _capture_h
+#define _capture_h
+
+#include <SDL2/SDL.h>
+
+#define CAPTURE_QUEUE_SIZE 16
+
+#define CAPTURE_ITEM_FRAME 0
+#define CAPTURE_ITEM_AUDIO 1
+#define CAPTURE_ITEM_STOP  2
+
+/* Frame rate of the LCD (one frame every 154 lines of 456 cycles) */
+#define CAPTURE_FPS_NUM CYCLES_PER_SECOND
+#define CAPTURE_FPS_DEN 70224
+
+typedef struct capture_item_t {
+    uint8_t type;
+    uint64_t cycles;    // Emulated cycles when the item was queued
+    uint32_t samples;   // Audio only, interleaved stereo floats
+
+    union {
+        uint16_t pixels[LCD_WIDTH * LCD_HEIGHT];
+        float audio[SOUND_BUFFER_SIZE];
+    };
+} capture_item_t;
+
+/*
+    Bounded single producer / single consumer queue between the emulator
+    thread and the writer thread. Slots are preallocated, the emulator only
+    blocks if the writer (or whatever reads the pipe) falls a whole queue behind.
+*/
+typedef struct capture_t {
+    bool enabled;
+
+    FILE *video;
+    FILE *audio;
+    bool audio_seekable;
+    uint32_t audio_rate;
+
+    capture_item_t items[CAPTURE_QUEUE_SIZE];
+    SDL_sem *free_slots;
+    SDL_sem *used_slots;
+    int head;   // Emulator thread
+    int tail;   // Writer thread
+
+    SDL_Thread *thread;
+
+    /* Stats */
+    uint32_t frames;
+    uint64_t audio_samples;
+    uint64_t padded_samples;
+    uint32_t stalls;
+} capture_t;
+
+extern capture_t capture;
+
+bool capture_start(const char *video_path, const char *audio_path);
+void capture_stop();
+
+void capture_frame(const uint16_t *color_buffer);
+void capture_audio(const float *samples, uint32_t count);
+
+#endif
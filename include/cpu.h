@@ -5,10 +5,11 @@
 
 #define CPU_DEBUG
 //#define CPU_DEBUG_INSTRUCTIONS
+//#define CPU_DEBUG_TIMING
 //#define CPU_DEBUG_INTERRUPTS
 
 #ifdef CPU_DEBUG
-#define DEBUG_CPU(...) printf("[cpu] "); printf(__VA_ARGS__); fflush(stdout);
+#define DEBUG_CPU(...) LOG(LOG_CPU, LOG_LEVEL_DEBUG, __VA_ARGS__)
 #endif
 
 typedef struct cpu_regs_t {
@@ -57,19 +58,25 @@ typedef struct cpu_t {
     uint32_t cycles;
     uint8_t ie;
     uint8_t ifr;
+    uint8_t pending;        // IE & IF, only updated when either changes
 
     bool ime;
     bool halted;
     bool stopped;
     bool debug_enabled;
+    bool software_break;    // LD B,B was executed, test ROMs use it to signal the end
+
+    /* CGB KEY1 */
+    bool double_speed;
+    bool speed_switch;      // Armed, STOP switches the speed
 } cpu_t;
 
 void cpu_init();
 void cpu_reset();
-void cpu_serve_interrupts();
 void cpu_step();
 void cpu_request_interrupt(uint8_t ifr);
 void cpu_enable_interrupts(uint8_t ie);
+void cpu_set_interrupt_flags(uint8_t ifr);
 
 #define CPU_IE_VBLANK (1 << 0)
 #define CPU_IE_LCD_STAT (1 << 1)
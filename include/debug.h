@@ -1,7 +1,80 @@
 #ifndef _debug_h
 #define _debug_h
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+#define DEBUG_MAX_POINTS 32
+
+/* Point types, also used as the per page flags */
+#define DEBUG_BREAK         (1 << 0)
+#define DEBUG_WATCH_READ    (1 << 1)
+#define DEBUG_WATCH_WRITE   (1 << 2)
+
+#define DEBUG_ANY_BANK      0xFFFF
+
+/* debugger.paused */
+#define DEBUG_RUNNING       0
+#define DEBUG_PAUSING       1
+#define DEBUG_PARKED        2
+
+typedef struct debug_point_t {
+    bool used;
+    uint8_t type;
+    uint16_t start;
+    uint16_t end;
+
+    // ROM bank the point is in for 4000-7FFF, DEBUG_ANY_BANK for every bank
+    uint16_t bank;
+} debug_point_t;
+
+typedef struct debug_t {
+    debug_point_t points[DEBUG_MAX_POINTS];
+
+    // DEBUG_PARKED once the emulator thread sits in the paused loop, other threads may touch the state then
+    SDL_atomic_t paused;
+    SDL_atomic_t step;
+
+    // Emulator thread only, hit ends the current frame early
+    bool hit;
+    bool reported;
+
+    // What stopped the emulator last
+    uint8_t hit_type;
+    uint16_t hit_addr;
+
+    // Lets a resume or step run the instruction the breakpoint stopped on
+    bool skip;
+    uint16_t skip_pc;
+} debug_t;
+
+/* Types of all points on each 256 byte page, the hot paths only look further on a page with a flag set */
+extern uint8_t debug_pages[256];
+extern debug_t debugger;
+
 void debug_mem_dump(uint16_t start, uint16_t size);
 void debug_reg_dump();
+void debug_disasm(uint16_t addr, char *buffer, int size);
+
+bool debug_add(uint8_t type, uint16_t start, uint16_t end, uint16_t bank);
+bool debug_remove(uint8_t type, uint16_t start, uint16_t end);
+bool debug_parse_break(const char *arg);
+bool debug_parse_watch(const char *arg);
+
+uint8_t debug_peek(uint16_t addr);
+void debug_poke(uint16_t addr, uint8_t data);
+
+bool debug_check_break(uint16_t pc);
+void debug_check_read(uint16_t addr, uint8_t data);
+void debug_check_write(uint16_t addr, uint8_t data);
+
+void debug_pause();
+void debug_continue();
+void debug_step();
+bool debug_wait_parked();
+void debug_update();
+void debug_resume();
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,41 @@
+#ifndef _dma_h
+#define _dma_h
+
+#include "emulator.h"
+
+//#define DMA_DEBUG
+
+/* OAM DMA copies one byte per 4 cycles, the CPU can only use FF00-FFFF meanwhile */
+#define DMA_OAM_BYTES           160
+#define DMA_CYCLES_PER_BYTE     4
+
+/* CGB HDMA copies 16 byte blocks into VRAM and stops the CPU while it does */
+#define DMA_HDMA_BLOCK          16
+#define DMA_HDMA_CYCLES         32
+
+typedef struct dma_t {
+    /* OAM DMA */
+    uint8_t reg;            // FF46, the last source page written
+    bool active;
+    uint16_t source;
+    uint8_t bytes;          // Copied so far
+    uint32_t cycles;        // Since the transfer started
+
+    /* HDMA */
+    uint16_t hdma_source;
+    uint16_t hdma_destination;
+    uint8_t hdma_blocks;    // Left to copy
+    bool hdma_active;       // HBlank mode, a block per HBlank
+
+    uint32_t stall;         // Cycles the CPU still has to wait for HDMA
+} dma_t;
+
+extern dma_t dma;
+
+void dma_init();
+void dma_wb(uint8_t addr, uint8_t data);
+uint8_t dma_rb(uint8_t addr);
+void dma_step(uint32_t cycles);
+void dma_hblank();
+
+#endif
@@ -9,33 +9,60 @@
 
 #include <SDL2/SDL.h>
 
+#include "log.h"
+#include "zone.h"
 #include "cpu.h"
+#include "opcodes.h"
+#include "symbols.h"
+#include "trace.h"
+#include "profile.h"
+#include "movie.h"
 #include "mmu.h"
 #include "rom.h"
 #include "lcd.h"
+#include "video.h"
+#include "scale.h"
 #include "input.h"
 #include "timer.h"
+#include "serial.h"
+#include "dma.h"
 #include "sound.h"
+#include "capture.h"
 #include "mbc.h"
+#include "save.h"
 #include "debug.h"
+#include "gdb.h"
 #include "boot.h"
 
 typedef struct emulator_t {
     uint8_t *rom;
+    long rom_size;
     rom_info_t rom_info;
     SDL_Window *window;
     SDL_Renderer *renderer;
     SDL_Texture *texture;
+    SDL_Texture *scaled_texture;
+    int scaled_factor;
     int audiodev_id;
 
-    bool running;
+    SDL_Thread *thread;
+    SDL_atomic_t running;
+    uint32_t last_cycles;
+    uint64_t total_cycles;
 } emulator_t;
 
 #define CYCLES_PER_SECOND 4194304
 #define CYCLES_PER_FRAME 69905
 
+/* Longest jump while halted, one scanline, so the loop still checks for input and pacing */
+#define EMULATOR_HALT_MAX 456
+
 void handle_events();
-void render();
+void render(video_frame_t *frame, const uint32_t *dirty_lines);
+void emulator_reset();
+uint32_t emulator_step();
+void emulator_run_frames(uint32_t frames);
+int emulator_run(void *data);
 
 extern emulator_t emulator;
 
@@ -0,0 +1,16 @@
+#ifndef _gdb_h
+#define _gdb_h
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Largest packet in either direction */
+#define GDB_PACKET_SIZE 4096
+
+/* gdb has no SM83 target, the registers are laid out like its z80 one: af bc de hl sp pc ix iy af' bc' de' hl' ir */
+#define GDB_REGISTER_COUNT 13
+
+bool gdb_start(const char *address);
+void gdb_stop();
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef _inflate_h
+#define _inflate_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+    Raw DEFLATE (RFC 1951) decoder for compressed ROMs
+
+    Decodes one bit at a time with canonical Huffman tables, which is
+    plenty for a few MB that are only inflated once and then cached.
+*/
+
+long inflate_raw(const uint8_t *in, size_t in_size, uint8_t *out, size_t out_size);
+
+#endif
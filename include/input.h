@@ -3,19 +3,24 @@
 
 //#define INPUT_DEBUG
 
-typedef struct input_state_t {
-    uint8_t a           : 1;
-    uint8_t b           : 1;
-    uint8_t select      : 1;
-    uint8_t start       : 1;
-    uint8_t up          : 1;
-    uint8_t down        : 1;
-    uint8_t left        : 1;
-    uint8_t right       : 1;
+typedef union {
+    struct {
+        uint8_t a           : 1;
+        uint8_t b           : 1;
+        uint8_t select      : 1;
+        uint8_t start       : 1;
+        uint8_t up          : 1;
+        uint8_t down        : 1;
+        uint8_t left        : 1;
+        uint8_t right       : 1;
+    } fields;
+
+    uint8_t value;
 } input_state_t;
 
 typedef struct input_t {
-    input_state_t state;
+    input_state_t state;        // Latched by the emulator thread on each read
+    SDL_atomic_t pressed;       // Written by the presentation thread
     bool direction;
     bool action;
 } input_t;
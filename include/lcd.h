@@ -5,6 +5,10 @@
 #define LCD_HEIGHT 144
 #define LCD_SCALE 4
 
+/* 384 tiles per VRAM bank, the second bank only exists on a CGB */
+#define LCD_TILE_COUNT 768
+#define LCD_DIRTY_WORDS ((LCD_HEIGHT + 31) / 32)
+
 #include <SDL2/SDL.h>
 
 //#define LCD_DEBUG
@@ -22,6 +26,20 @@ typedef union {
     uint8_t value;
 } lcd_oam_flags_t;
 
+/* CGB background map attributes, VRAM bank 1 at the same offset as the tile index */
+typedef union {
+    struct {
+        uint8_t palette_number          : 3;
+        uint8_t tile_vram_bank          : 1;
+        uint8_t unused                  : 1;
+        uint8_t x_flip                  : 1;
+        uint8_t y_flip                  : 1;
+        uint8_t bg_over_obj             : 1;
+    } fields;
+
+    uint8_t value;
+} lcd_bg_attributes_t;
+
 typedef struct lcd_oam_t {
     uint8_t y;
     uint8_t x;
@@ -70,14 +88,71 @@ typedef struct lcd_regs_t {
     uint8_t wx;
 
     uint8_t bgp;
+    uint8_t obp0;
+    uint8_t obp1;
 } lcd_regs_t;
 
+/* Everything besides VRAM that a background/window line depends on */
+typedef struct lcd_line_inputs_t {
+    uint8_t control;
+    uint8_t scy;
+    uint8_t scx;
+    uint8_t wy;
+    uint8_t wx;
+    uint8_t bgp;
+    uint8_t obp0;
+    uint8_t obp1;
+    uint8_t valid;
+} lcd_line_inputs_t;
+
+/* VRAM/OAM writes that actually changed a value */
+typedef struct lcd_vram_dirty_t {
+    uint32_t tiles[LCD_TILE_COUNT / 32];
+    uint64_t map_rows;      // Tile indices or CGB attributes
+    bool oam;
+    bool palettes;          // CGB palette RAM
+} lcd_vram_dirty_t;
+
+/* PPU implementation, both engines share the registers in lcd_t */
+typedef struct lcd_engine_t {
+    const char *name;
+    void (*reset)();
+    void (*step)(uint32_t cycles);
+    uint32_t (*next_event)();   // Cycles that can be stepped at once without missing a mode change
+} lcd_engine_t;
+
+/*
+    Pixels are 15 bit BGR colors like CGB palette entries, the DMG shades are
+    mapped to lcd_dmg_colors. The presentation side converts them with a LUT.
+*/
 typedef struct lcd_t {
-    uint8_t color_buffer[LCD_WIDTH * LCD_HEIGHT];
+    uint16_t color_buffer[LCD_WIDTH * LCD_HEIGHT];
+    uint16_t bg_buffer[LCD_WIDTH * LCD_HEIGHT];
+    uint8_t bg_index[LCD_WIDTH * LCD_HEIGHT];   // Color index, LCD_BG_PRIORITY if the CGB attribute is set
     uint8_t framebuffer[LCD_WIDTH * LCD_HEIGHT * 3][3];
     lcd_regs_t regs;
     uint32_t cycles;
-    uint8_t palette[4];
+
+    /* Colors the engines draw with, BGP/OBP0/OBP1 in the first entries on a DMG */
+    uint16_t bg_colors[8][4];
+    uint16_t obj_colors[8][4];
+
+    /* CGB palette RAM, BCPS/BCPD and OCPS/OCPD */
+    uint8_t bg_palette_ram[64];
+    uint8_t obj_palette_ram[64];
+    uint8_t bg_palette_index;
+    uint8_t obj_palette_index;
+
+    const lcd_engine_t *engine;
+
+    /* Dirty line tracking */
+    lcd_line_inputs_t line_inputs[LCD_HEIGHT];
+    lcd_vram_dirty_t dirty;
+    lcd_vram_dirty_t dirty_previous;
+    uint32_t redrawn_lines[LCD_DIRTY_WORDS];
+    uint32_t sprite_lines[LCD_DIRTY_WORDS];
+    uint32_t dirty_lines[LCD_DIRTY_WORDS];
+    lcd_line_inputs_t sprite_inputs;
 } lcd_t;
 
 #define LCD_MODE_HBLANK 0
@@ -89,6 +164,10 @@ typedef struct lcd_t {
 #define LCD_CONTROL_OBJ_ENABLE (1 << 1)
 #define LCD_CONTROL_LCD_ENABLE (1 << 7)
 
+#define LCD_BG_PRIORITY (1 << 7)
+
+#define LCD_PALETTE_AUTO_INCREMENT (1 << 7)
+
 #define TILE_WIDTH 8
 #define TILE_HEIGHT 8
 
@@ -98,10 +177,21 @@ typedef struct lcd_t {
 
 void lcd_init();
 void lcd_step(uint32_t cycles);
+uint32_t lcd_next_event();
+bool lcd_select_engine(const char *name);
 
 void lcd_wb(uint8_t addr, uint8_t data);
 uint8_t lcd_rb(uint8_t addr);
 
+void lcd_vram_written(uint16_t offset);
+void lcd_oam_written();
+
 extern lcd_t lcd;
+extern const uint16_t lcd_dmg_colors[4];
+extern const lcd_engine_t lcd_scanline_engine;
+extern const lcd_engine_t lcd_fifo_engine;
+extern const lcd_engine_t *lcd_engines[];
+
+#define LCD_ENGINE_COUNT 2
 
 #endif
\ No newline at end of file
@@ -0,0 +1,74 @@
+#ifndef _log_h
+#define _log_h
+
+#include <SDL2/SDL.h>
+
+#define LOG_LEVEL_OFF   0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_TRACE 5
+
+#define LOG_DEFAULT_LEVEL LOG_LEVEL_WARN
+
+/* Modules */
+#define LOG_CPU     0
+#define LOG_MMU     1
+#define LOG_LCD     2
+#define LOG_TIMER   3
+#define LOG_SOUND   4
+#define LOG_MBC     5
+#define LOG_INPUT   6
+#define LOG_SERIAL  7
+#define LOG_MODULE_COUNT 8
+
+/* Must be a power of two */
+#define LOG_RING_SIZE 4096
+#define LOG_MAX_ARGS 16
+#define LOG_STRING_SIZE 64
+
+/*
+    Only the format pointer and the raw arguments are stored, formatting
+    happens on the logging thread. The format has to be a string literal,
+    %s arguments are copied into the record.
+*/
+typedef struct log_record_t {
+    SDL_atomic_t sequence;
+    uint8_t module;
+    uint8_t level;
+    uint8_t count;
+    uint8_t strings_used;
+    const char *format;
+    uint64_t args[LOG_MAX_ARGS];
+    char strings[LOG_STRING_SIZE];
+} log_record_t;
+
+/* Bounded lock-free queue, any thread can write, only the logging thread reads */
+typedef struct log_t {
+    log_record_t ring[LOG_RING_SIZE];
+    SDL_atomic_t head;
+    uint32_t tail;
+
+    SDL_atomic_t dropped;
+    SDL_atomic_t running;
+    SDL_Thread *thread;
+} log_t;
+
+extern uint8_t log_levels[LOG_MODULE_COUNT];
+
+/* A disabled message costs a load and a branch, the arguments aren't evaluated */
+#define LOG(module, level, ...) \
+    do { \
+        if (__builtin_expect(log_levels[module] >= (level), 0)) { \
+            log_write(module, level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+void log_init();
+void log_quit();
+bool log_configure(const char *spec);
+
+void log_write(uint8_t module, uint8_t level, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+#endif
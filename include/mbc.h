@@ -11,14 +11,39 @@
 #define MBC_TYPE_MBC6   5
 #define MBC_TYPE_MBC7   6
 
+/* Where the MBC3 clock takes its time from */
+#define MBC_RTC_HOST        0   // Wall clock, keeps running while the emulator is closed once saved
+#define MBC_RTC_EMULATED    1   // Emulated cycles, for deterministic runs
+
+#define MBC_RTC_SECONDS     0
+#define MBC_RTC_MINUTES     1
+#define MBC_RTC_HOURS       2
+#define MBC_RTC_DAYS_LOW    3
+#define MBC_RTC_DAYS_HIGH   4
+
+#define MBC_RTC_DAY_HIGH    (1 << 0)
+#define MBC_RTC_HALT        (1 << 6)
+#define MBC_RTC_DAY_CARRY   (1 << 7)
+
+typedef struct mbc_rtc_t {
+    uint8_t latched[5];     // What the game reads, indexed by MBC_RTC_*
+    uint8_t latch;          // Last value written to 6000-7FFF, 00 then 01 latches
+    bool halted;
+    bool carry;
+
+    /* The running clock is base seconds plus the time since reference */
+    uint64_t base;
+    uint64_t reference;     // Host seconds or emulated cycles
+} mbc_rtc_t;
+
 typedef struct mbc_t {
     uint8_t type;
 
-    uint8_t rom_banks;
+    uint16_t rom_banks;
     uint8_t ram_banks;
 
-    uint8_t rom_bank;
-    uint8_t ram_bank;
+    uint16_t rom_bank;
+    uint8_t ram_bank;       // MBC3: 08-0C select an RTC register instead
 
     uint8_t* rom;
     uint8_t* ram;
@@ -30,12 +55,43 @@ typedef struct mbc_t {
     bool rtc_enabled;
 
     bool inserted;
+
+    // MBC3
+    mbc_rtc_t rtc;
+    int rtc_source;
+    uint8_t *rtc_file;      // Clock footer of the mapped save, NULL without one
+
+    /* Host memory of each 8 KB page (ROM at 0-3, RAM at 5), updated when a banking register changes */
+    const uint8_t *read_pages[8];
+    uint8_t *ram_write;     // Discarded page while RAM is disabled
+    bool ram_direct;        // Writes can go straight to ram_write, nothing else needs to see them
+    uint16_t rom0_bank;
+    uint16_t romx_bank;
 } mbc_t;
 
 extern mbc_t mbc;
 
 void mbc_init();
-uint8_t mbc_rb(uint16_t addr);
+void mbc_map();
 void mbc_wb(uint16_t addr, uint8_t data);
+uint16_t mbc_bank(uint16_t addr);
+void mbc_rtc_store();
+
+/* Cartridge ROM (0000-7FFF) and RAM (A000-BFFF) for every MBC type */
+static inline uint8_t mbc_rb(uint16_t addr)
+{
+    return mbc.read_pages[addr >> 13][addr & 0x1FFF];
+}
+
+/* Cartridge RAM (A000-BFFF), a disabled RAM is just another page */
+static inline void mbc_ram_wb(uint16_t addr, uint8_t data)
+{
+    if (mbc.ram_direct) {
+        mbc.ram_write[addr & 0x1FFF] = data;
+        return;
+    }
+
+    mbc_wb(addr, data);
+}
 
 #endif
\ No newline at end of file
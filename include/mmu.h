@@ -14,34 +14,35 @@ void mmu_ww(uint16_t addr, uint16_t data);
 uint8_t mmu_rb(uint16_t addr);
 uint16_t mmu_rw(uint16_t addr);
 
-typedef union {
-    struct {
-        uint8_t shift_clock : 1;
-        uint8_t clock_speed : 1;
-        uint8_t reserved    : 5;
-        uint8_t start_flag  : 1;
-    } fields;
-
-    uint8_t value;  
-} serial_control_t;
+/* CGB banks, a DMG only ever sees VRAM bank 0 and WRAM banks 0 and 1 */
+#define MMU_VRAM_BANK_SIZE 0x2000
+#define MMU_WRAM_BANK_SIZE 0x1000
 
 typedef struct mmu_t {
     uint8_t boot_rom[0x0100];
     uint8_t rom[0x8000];
-    uint8_t vram[0x2000];
-    uint8_t sram[0x2000];
-    uint8_t wram[0x2000];
+    uint8_t vram[MMU_VRAM_BANK_SIZE * 2];
+    uint8_t wram[MMU_WRAM_BANK_SIZE * 8];
     uint8_t oam[0x0100];
     uint8_t hram[0x007F];
 
-    serial_control_t serial_control;
-    char serial_data;
-    char serial_out;
-    int serial_cycles;
-
     bool boot_rom_mapped;
+
+    uint8_t vram_bank;      // VBK
+    uint8_t wram_bank;      // SVBK, 1-7 in D000-DFFF
 } mmu_t;
 
 extern mmu_t mmu;
 
+/* Offsets into mmu.vram / mmu.wram of a CPU address in the banked areas */
+static inline uint16_t mmu_vram_offset(uint16_t addr)
+{
+    return mmu.vram_bank * MMU_VRAM_BANK_SIZE + (addr & 0x1FFF);
+}
+
+static inline uint16_t mmu_wram_offset(uint16_t addr)
+{
+    return (addr & 0x1000) ? mmu.wram_bank * MMU_WRAM_BANK_SIZE + (addr & 0x0FFF) : (addr & 0x0FFF);
+}
+
 #endif
\ No newline at end of file
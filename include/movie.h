@@ -0,0 +1,62 @@
+#ifndef _movie_h
+#define _movie_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+    Input movie
+
+    File:   "GBMOVIE" 0x00, u32 version, u64 ROM hash, char[16] PPU engine, then records
+    Record: u8 type, varint cycles since the previous record, then
+            u8 joypad state     MOVIE_INPUT
+            u64 state hash      MOVIE_END, always the last record
+
+    Movies start from power-on. The joypad is recorded where the game reads
+    it (input_read), keyed by emulator.total_cycles, so a replay sees exactly
+    the same values at the same emulated time.
+*/
+
+#define MOVIE_MAGIC "GBMOVIE"
+#define MOVIE_VERSION 2
+
+#define MOVIE_INPUT 0
+#define MOVIE_END   1
+
+#define MOVIE_OFF       0
+#define MOVIE_RECORD    1
+#define MOVIE_PLAY      2
+
+typedef struct movie_t {
+    int mode;
+    FILE *fp;
+
+    uint8_t state;          // Last recorded or replayed joypad state
+    uint64_t cycles;        // Emulated cycles of the last record
+
+    /* Playback */
+    uint8_t *data;
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t next_cycles;   // Next input to replay
+    uint8_t next_state;
+    uint64_t end_cycles;
+    uint64_t end_hash;
+
+    /* Stats */
+    uint32_t inputs;
+} movie_t;
+
+extern movie_t movie;
+
+uint64_t movie_hash(uint64_t hash, const void *data, size_t size);
+uint64_t movie_state_hash();
+
+bool movie_record(const char *path);
+bool movie_play(const char *path);
+void movie_stop();
+uint8_t movie_input(uint8_t pressed);
+int movie_replay();
+
+#endif
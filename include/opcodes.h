@@ -0,0 +1,51 @@
+#ifndef _opcodes_h
+#define _opcodes_h
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Kept free of SDL so the offline tools can link it */
+
+/* Immediate operand, the mnemonic names it with the token in brackets */
+typedef enum opcode_operand_t {
+    OPERAND_NONE,
+    OPERAND_N,          // n, 8 bit
+    OPERAND_NN,         // nn, 16 bit value or address
+    OPERAND_IO,         // FF00+n, high page address
+    OPERAND_REL,        // PC+dd, relative jump target
+    OPERAND_SP          // dd, signed offset added to SP
+} opcode_operand_t;
+
+#define OPCODE_JUMP         (1 << 0)
+#define OPCODE_CALL         (1 << 1)    // Includes RST
+#define OPCODE_RET          (1 << 2)
+#define OPCODE_CONDITIONAL  (1 << 3)
+#define OPCODE_PREFIX       (1 << 4)    // CB, the instruction is in opcode_cb_table
+#define OPCODE_ILLEGAL      (1 << 5)
+
+typedef struct opcode_info_t {
+    const char *mnemonic;
+    uint8_t length;         // Bytes including the opcode (and the CB prefix)
+    uint8_t cycles;         // Clock cycles, not taken for conditional branches
+    uint8_t cycles_taken;   // Conditional branches only
+    uint8_t operand;
+    uint8_t flags;
+} opcode_info_t;
+
+extern const opcode_info_t opcode_table[256];
+extern const opcode_info_t opcode_cb_table[256];
+
+/* One decoded instruction */
+typedef struct disasm_insn_t {
+    uint16_t addr;
+    uint8_t length;
+    uint8_t bytes[3];
+    const opcode_info_t *info;
+} disasm_insn_t;
+
+int disasm_decode(const uint8_t *bytes, int available, uint16_t addr, disasm_insn_t *insn);
+int disasm_decode_block(const uint8_t *data, uint32_t size, uint16_t addr, disasm_insn_t *insns, int max);
+void disasm_format(const disasm_insn_t *insn, uint16_t rom_bank, char *buffer, int size);
+uint16_t disasm_target(const disasm_insn_t *insn);
+
+#endif
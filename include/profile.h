@@ -0,0 +1,58 @@
+#ifndef _profile_h
+#define _profile_h
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PROFILE_HASH_SIZE (1 << 16)
+#define PROFILE_MAX_NODES (1 << 16)
+#define PROFILE_MAX_DEPTH 256
+#define PROFILE_HOTSPOTS 64
+
+/* (bank << 16 | pc) + 1, 0 marks an empty slot */
+typedef struct profile_entry_t {
+    uint32_t key;
+    uint32_t count;
+    uint64_t cycles;
+    uint8_t opcode;
+} profile_entry_t;
+
+#define PROFILE_NODE_INTERRUPT (1u << 31)
+
+/* Call tree, children are a linked list since most functions only call a few others */
+typedef struct profile_node_t {
+    uint32_t key;       // bank << 16 | address, PROFILE_NODE_INTERRUPT for interrupt vectors
+    uint32_t parent;
+    uint32_t child;
+    uint32_t sibling;
+    uint32_t calls;
+    uint64_t cycles;    // Spent in this function itself
+} profile_node_t;
+
+typedef struct profile_t {
+    uint32_t opcode_count[256];
+    uint64_t opcode_cycles[256];
+    uint32_t cb_count[256];
+    uint64_t cb_cycles[256];
+
+    profile_entry_t hotspots[PROFILE_HASH_SIZE];
+    uint32_t hotspot_overflow;
+
+    profile_node_t nodes[PROFILE_MAX_NODES];
+    uint32_t node_count;
+    uint32_t current;
+    uint32_t depth;
+    uint32_t untracked;
+
+    uint64_t instructions;
+    uint64_t cycles;
+} profile_t;
+
+extern bool profile_enabled;
+
+void profile_start();
+void profile_instruction(uint16_t pc, uint16_t sp, uint8_t opcode, uint8_t cb_opcode, uint32_t cycles);
+void profile_interrupt(uint16_t vector);
+void profile_dump(const char *prefix);
+
+#endif
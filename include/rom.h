@@ -2,9 +2,38 @@
 #define _rom_h
 
 #define ROM_TITLE_OFFSET                0x134
+#define ROM_CGB_FLAG_OFFSET             0x143
+#define ROM_SGB_FLAG_OFFSET             0x146
 #define ROM_CARTRIDGE_TYPE_OFFSET       0x147
 #define ROM_ROM_SIZE_OFFSET             0x148
 #define ROM_RAM_SIZE_OFFSET             0x149
+#define ROM_HEADER_CHECKSUM_OFFSET      0x14D
+#define ROM_GLOBAL_CHECKSUM_OFFSET      0x14E
+#define ROM_HEADER_SIZE                 0x150
+
+#define ROM_MAX_BANKS 512   // MBC5, 8 MB
+
+/*
+    Cartridge database, <data dir>/gameboy-emulator/gamedb.txt or --gamedb
+
+    "<crc32> <sha1|-> [type=<hex>] [ram=<banks>] [ppu=<engine>] [name=<title>]"
+    per line, lines starting with '#' are comments. Overrides headers that are known to be
+    wrong and selects the PPU engine a game needs, name takes the rest of
+    the line. A SHA1 of '-' matches any ROM with the CRC32.
+
+    ROM index, <cache dir>/gameboy-emulator/roms.idx
+
+    "<size> <mtime> <crc32> <sha1> <flags> <path>" per ROM loaded before,
+    so the hashes and the global checksum aren't computed again while
+    the file is unchanged.
+*/
+
+#define ROM_DB_FILE     "gamedb.txt"
+#define ROM_INDEX_FILE  "roms.idx"
+#define ROM_INDEX_MAX   4096
+
+#define ROM_HEADER_OK   (1 << 0)
+#define ROM_GLOBAL_OK   (1 << 1)
 
 #define ROM_CARTRIDGE_TYPE_ROMONLY          0x00
 #define ROM_CARTRIDGE_TYPE_MBC1             0x01
@@ -17,16 +46,43 @@
 #define ROM_CARTRIDGE_TYPE_MBC3             0x11
 #define ROM_CARTRIDGE_TYPE_MBC3RAM          0x12
 #define ROM_CARTRIDGE_TYPE_MBC3RAMBAT       0x13
+#define ROM_CARTRIDGE_TYPE_MBC5             0x19
+#define ROM_CARTRIDGE_TYPE_MBC5RAM          0x1A
+#define ROM_CARTRIDGE_TYPE_MBC5RAMBAT       0x1B
+#define ROM_CARTRIDGE_TYPE_MBC5RUMBLE       0x1C
+#define ROM_CARTRIDGE_TYPE_MBC5RUMBLERAM    0x1D
+#define ROM_CARTRIDGE_TYPE_MBC5RUMBLERAMBAT 0x1E
 
 typedef struct rom_info_t {
     char title[16];
     uint8_t cartridge_type;
     char cartridge_type_name[32];
-    uint8_t rom_banks;
+    uint16_t rom_banks;
     uint8_t ram_banks;
     
     bool cgb;
     bool sgb;
+
+    bool battery;   // RAM and clock are kept in a .sav
+    bool rtc;
+
+    /* Identification */
+    uint32_t crc32;
+    uint8_t sha1[20];
+    uint8_t checksums;      // ROM_HEADER_OK, ROM_GLOBAL_OK
+    char name[64];          // From the database, empty if unknown
+    char ppu[16];           // PPU engine the database asks for
 } rom_info_t;
 
+typedef struct rom_config_t {
+    const char *db_path;    // NULL for the default
+    bool ppu_selected;      // --ppu wins over the database
+} rom_config_t;
+
+extern rom_config_t rom_config;
+
+void load_rom(const char *path);
+uint32_t rom_crc32(uint32_t crc, const uint8_t *data, size_t size);
+void rom_sha1(const uint8_t *data, size_t size, uint8_t digest[20]);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,58 @@
+#ifndef _save_h
+#define _save_h
+
+#include <SDL2/SDL.h>
+
+/*
+    Battery backed cartridge RAM, memory mapped from <rom>.sav
+
+    Writes land directly in the mapping, so the OS keeps them even if the
+    emulator crashes. A background thread msyncs the pages written since
+    its last pass, at most once per SAVE_FLUSH_INTERVAL. Windows has no
+    mmap, there the RAM is read from the file and the same thread writes
+    the pages back.
+
+    MBC3 clocks are appended in the common 48 byte format: live and
+    latched S M H DL DH as u32 each, then a u64 UNIX timestamp.
+*/
+
+#define SAVE_FLUSH_INTERVAL 1000    // Milliseconds
+#define SAVE_RTC_SIZE 48
+#define SAVE_MAX_PAGES 64           // 128 KB of RAM plus the clock in 4 KB pages
+
+typedef struct save_t {
+    bool enabled;
+    int fd;
+    uint8_t *data;
+    size_t size;
+    size_t page_size;
+
+    SDL_atomic_t dirty[SAVE_MAX_PAGES];
+    SDL_atomic_t running;
+    SDL_sem *wake;
+    SDL_Thread *thread;
+
+    /* Stats */
+    uint32_t flushes;
+    uint32_t pages;
+} save_t;
+
+extern save_t save;
+
+bool save_start(const char *rom_path);
+void save_stop();
+
+/* Called on the emulator thread, offset is into the file */
+static inline void save_written(uint32_t offset, uint32_t length)
+{
+    uint32_t first = offset / save.page_size;
+    uint32_t last = (offset + length - 1) / save.page_size;
+
+    for (uint32_t page = first; page <= last; page++) {
+        if (!SDL_AtomicGet(&save.dirty[page])) {
+            SDL_AtomicSet(&save.dirty[page], 1);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef _scale_h
+#define _scale_h
+
+#include <SDL2/SDL.h>
+
+#define SCALE_MAX_FACTOR 4
+#define SCALE_MAX_WORKERS 4
+#define SCALE_FILTER_COUNT 6
+
+/* Scales source rows y0 to y1 (exclusive), pitch is in pixels */
+typedef void (*scale_func_t)(const uint32_t *source, uint32_t *output, int pitch, int y0, int y1);
+
+typedef struct scale_filter_t {
+    const char *name;
+    int factor;
+    scale_func_t func;  // NULL leaves the scaling to the renderer
+} scale_filter_t;
+
+typedef struct scale_worker_t {
+    SDL_Thread *thread;
+    SDL_sem *start;
+    int y0;
+    int y1;
+} scale_worker_t;
+
+typedef struct scale_stats_t {
+    uint32_t frames;
+    uint64_t ticks;
+} scale_stats_t;
+
+/*
+    The frame is split into horizontal bands, one per worker plus one for
+    the calling (presentation) thread, so the emulator thread never scales.
+*/
+typedef struct scale_t {
+    const scale_filter_t *filter;
+    uint32_t source[LCD_WIDTH * LCD_HEIGHT];
+
+    /* Current job */
+    uint32_t *output;
+    int pitch;
+
+    scale_worker_t workers[SCALE_MAX_WORKERS];
+    int worker_count;
+    SDL_sem *done;
+    bool quit;
+
+    scale_stats_t stats[SCALE_FILTER_COUNT];
+} scale_t;
+
+extern scale_t scale;
+extern const scale_filter_t scale_filters[SCALE_FILTER_COUNT];
+
+void scale_init();
+void scale_quit();
+bool scale_select(const char *name);
+void scale_next();
+
+void scale_frame(const uint16_t *pixels, uint32_t *output, int pitch);
+void scale_report();
+void scale_bench(const uint16_t *pixels, uint32_t iterations);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef _serial_h
+#define _serial_h
+
+#include "emulator.h"
+
+//#define SERIAL_DEBUG
+
+/* Internal clock of 8192 Hz */
+#define SERIAL_CYCLES_PER_BIT 512
+
+/* Sent bytes are kept for test ROMs that report through the link port */
+#define SERIAL_OUTPUT_SIZE 4096
+
+#define SERIAL_CONTROL_INTERNAL_CLOCK (1 << 0)
+#define SERIAL_CONTROL_START (1 << 7)
+
+typedef struct serial_t {
+    /* Registers */
+    uint8_t data;
+    uint8_t control;
+
+    uint8_t bits;           // Left in the current transfer, 0 when idle
+    uint32_t cycles;        // Until the next bit
+
+    char output[SERIAL_OUTPUT_SIZE];
+    uint32_t output_length;
+} serial_t;
+
+extern serial_t serial;
+
+void serial_init();
+void serial_wb(uint8_t addr, uint8_t data);
+uint8_t serial_rb(uint8_t addr);
+void serial_step(uint32_t cycles);
+
+#endif
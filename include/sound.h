@@ -5,6 +5,7 @@
 
 #define SOUND_SAMPLERATE 48000
 #define SOUND_BUFFER_SIZE 1024
+#define SOUND_MAX_QUEUED 8
 
 /* 
     OC = Output channel 1-2
@@ -0,0 +1,20 @@
+#ifndef _symbols_h
+#define _symbols_h
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* RGBDS .sym files, kept free of SDL so the offline tools can link it */
+
+typedef struct symbol_t {
+    uint16_t bank;
+    uint16_t addr;
+    uint32_t name;      // Offset into the name pool
+} symbol_t;
+
+bool symbols_load(const char *path);
+const char* symbols_find(uint16_t rom_bank, uint16_t addr);
+const char* symbols_nearest(uint16_t rom_bank, uint16_t addr, uint16_t *offset);
+bool symbols_lookup(const char *name, uint16_t *bank, uint16_t *addr);
+
+#endif
@@ -8,16 +8,20 @@
 #define TIMER_TAC_ENABLE        (1 << 2)
 #define TIMER_CYCLES_PER_DIV    16384
 
+/*
+    DIV is the upper byte of a 16 bit divider counting every cycle. TIMA
+    counts the falling edges of one divider bit (9, 3, 5 or 7 by TAC)
+    ANDed with the enable bit, so resetting DIV or changing TAC can
+    increment it too, like on hardware.
+*/
+
 typedef struct timer_regs_t {
     /* Registers */
-    uint8_t div;
     uint8_t tima;
     uint8_t tma;
     uint8_t tac;
 
-    uint32_t freq;
-    uint32_t div_counter;
-    uint32_t tima_counter;
+    uint16_t counter;   // Internal divider
 } timer_regs_t;
 
 extern timer_regs_t timer;
@@ -25,5 +29,6 @@ extern timer_regs_t timer;
 void timer_wb(uint8_t addr, uint8_t data);
 uint8_t timer_rb(uint8_t addr);
 void timer_tick(uint32_t cycles);
+uint32_t timer_cycles_to_overflow();
 
-#endif
\ No newline at end of file
+#endif
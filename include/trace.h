@@ -0,0 +1,161 @@
+#ifndef _trace_h
+#define _trace_h
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+    Binary instruction trace
+
+    File:   "GBTRACE" 0x00, u32 version, then blocks
+    Block:  u32 payload size, u32 record count, payload (all little endian)
+
+    Every block starts from a zeroed state so it can be decoded on its own.
+    A record holds the CPU state before the instruction, as deltas to the
+    previous record:
+
+    u8      mask of changed registers (A B C D E H L F, bit 0 = A)
+    u8      TRACE_* flags
+    u8[]    new value of each changed register
+    varint  PC delta (zigzag)
+    varint  SP delta (zigzag)   if TRACE_SP
+    u8      IE                  if TRACE_IE
+    u8      IF                  if TRACE_IF
+    varint  ROM bank at 4000    if TRACE_BANK (version 2)
+    varint  cycles delta
+    u8      opcode
+
+    IME and whether the boot ROM is mapped are stored as toggles (TRACE_IME, TRACE_BOOT).
+*/
+
+#define TRACE_MAGIC "GBTRACE"
+#define TRACE_VERSION 2
+
+#define TRACE_SP  (1 << 0)
+#define TRACE_IME (1 << 1)
+#define TRACE_IE  (1 << 2)
+#define TRACE_IF  (1 << 3)
+#define TRACE_BANK (1 << 4)
+#define TRACE_BOOT (1 << 5)
+
+#define TRACE_BLOCK_SIZE (256 * 1024)
+#define TRACE_BLOCK_COUNT 8
+#define TRACE_MAX_RECORD 32
+
+typedef struct trace_state_t {
+    uint8_t regs[8];    // A B C D E H L F
+    uint16_t pc;
+    uint16_t sp;
+    uint8_t ime;
+    uint8_t ie;
+    uint8_t ifr;
+    uint8_t opcode;
+    uint8_t boot;
+    uint16_t bank;
+    uint32_t cycles;
+} trace_state_t;
+
+extern bool trace_enabled;
+
+bool trace_start(const char *path);
+void trace_stop();
+void trace_instruction(uint8_t opcode);
+
+static inline uint8_t* trace_put_varint(uint8_t *p, uint32_t value)
+{
+    while (value >= 0x80) {
+        *p++ = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+
+    *p++ = (uint8_t) value;
+
+    return p;
+}
+
+static inline const uint8_t* trace_get_varint(const uint8_t *p, const uint8_t *end, uint32_t *value)
+{
+    *value = 0;
+
+    for (int shift=0; p < end && shift < 35; shift += 7) {
+        uint8_t byte = *p++;
+        *value |= (uint32_t) (byte & 0x7F) << shift;
+
+        if (!(byte & 0x80)) {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+static inline uint32_t trace_zigzag(int32_t value)
+{
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+static inline int32_t trace_unzigzag(uint32_t value)
+{
+    return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+/* Decodes one record on top of the previous state, returns NULL on truncated input */
+static inline const uint8_t* trace_decode(const uint8_t *p, const uint8_t *end, trace_state_t *state)
+{
+    uint32_t value;
+
+    if (end - p < 2) {
+        return NULL;
+    }
+
+    uint8_t mask = *p++;
+    uint8_t flags = *p++;
+
+    for (int i=0; i < 8; i++) {
+        if (mask & (1 << i)) {
+            if (p >= end) return NULL;
+            state->regs[i] = *p++;
+        }
+    }
+
+    if (!(p = trace_get_varint(p, end, &value))) return NULL;
+    state->pc += (uint16_t) trace_unzigzag(value);
+
+    if (flags & TRACE_SP) {
+        if (!(p = trace_get_varint(p, end, &value))) return NULL;
+        state->sp += (uint16_t) trace_unzigzag(value);
+    }
+
+    if (flags & TRACE_IME) {
+        state->ime ^= 1;
+    }
+
+    if (flags & TRACE_BOOT) {
+        state->boot ^= 1;
+    }
+
+    if (flags & TRACE_IE) {
+        if (p >= end) return NULL;
+        state->ie = *p++;
+    }
+
+    if (flags & TRACE_IF) {
+        if (p >= end) return NULL;
+        state->ifr = *p++;
+    }
+
+    if (flags & TRACE_BANK) {
+        if (!(p = trace_get_varint(p, end, &value))) return NULL;
+        state->bank = (uint16_t) value;
+    }
+
+    if (!(p = trace_get_varint(p, end, &value))) return NULL;
+    state->cycles += value;
+
+    if (p >= end) return NULL;
+    state->opcode = *p++;
+
+    return p;
+}
+
+#endif
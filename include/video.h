@@ -0,0 +1,54 @@
+#ifndef _video_h
+#define _video_h
+
+#include <SDL2/SDL.h>
+
+#define VIDEO_BUFFER_COUNT 3
+#define VIDEO_DIRTY_HISTORY 8
+
+/* Set in video_t.ready while the slot it points to hasn't been picked up yet */
+#define VIDEO_FRAME_FRESH (1 << 2)
+#define VIDEO_FRAME_INDEX 3
+
+/* Every 15 bit color the PPU can output */
+#define VIDEO_COLOR_COUNT 0x8000
+
+typedef struct video_frame_t {
+    uint16_t pixels[LCD_WIDTH * LCD_HEIGHT];
+    uint32_t sequence;
+} video_frame_t;
+
+/*
+    Lock-free triple buffer between the emulator thread (writer) and the
+    presentation thread (reader). Each side owns one slot, the third one
+    is exchanged atomically through "ready".
+
+    The presentation thread may skip frames, so the dirty lines of the last
+    few frames are kept around to know which rows changed since the frame
+    it presented before.
+*/
+typedef struct video_t {
+    video_frame_t frames[VIDEO_BUFFER_COUNT];
+    SDL_atomic_t ready;
+
+    uint32_t dirty_history[VIDEO_DIRTY_HISTORY][LCD_DIRTY_WORDS];
+    SDL_atomic_t published;
+
+    int back;           // Emulator thread
+    int front;          // Presentation thread
+    uint32_t presented; // Presentation thread
+} video_t;
+
+extern video_t video;
+extern uint32_t video_colors[VIDEO_COLOR_COUNT];
+
+void video_init();
+void video_publish(const uint16_t *color_buffer, const uint32_t *dirty_lines);
+video_frame_t* video_acquire(uint32_t *dirty_lines);
+
+static inline bool video_line_dirty(const uint32_t *dirty_lines, int y)
+{
+    return (dirty_lines[y >> 5] >> (y & 31)) & 1;
+}
+
+#endif
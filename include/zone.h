@@ -0,0 +1,77 @@
+#ifndef _zone_h
+#define _zone_h
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* Per thread, the oldest events are overwritten */
+#define ZONE_RING_SIZE (1 << 16)
+#define ZONE_MAX_THREADS 16
+
+typedef struct zone_event_t {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+} zone_event_t;
+
+typedef struct zone_buffer_t {
+    const char *thread_name;
+    int tid;
+    uint64_t count;
+    zone_event_t events[ZONE_RING_SIZE];
+} zone_buffer_t;
+
+typedef struct zone_scope_t {
+    const char *name;
+    uint64_t start;
+} zone_scope_t;
+
+extern bool zones_enabled;
+
+void zones_start();
+void zones_dump(const char *path);
+void zone_thread(const char *name);
+void zone_record(const char *name, uint64_t start, uint64_t end);
+
+static inline uint64_t zone_clock()
+{
+    #if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+    #else
+    return SDL_GetPerformanceCounter();
+    #endif
+}
+
+static inline zone_scope_t zone_begin(const char *name)
+{
+    zone_scope_t scope = { NULL, 0 };
+
+    if (zones_enabled) {
+        scope.name = name;
+        scope.start = zone_clock();
+    }
+
+    return scope;
+}
+
+static inline void zone_end(zone_scope_t *scope)
+{
+    if (scope->name) {
+        zone_record(scope->name, scope->start, zone_clock());
+    }
+}
+
+#define ZONE_CONCAT_(a, b) a##b
+#define ZONE_CONCAT(a, b) ZONE_CONCAT_(a, b)
+
+/* Times the rest of the enclosing block, name must be a string literal */
+#define ZONE(name) \
+    zone_scope_t ZONE_CONCAT(zone_, __LINE__) __attribute__((cleanup(zone_end))) = zone_begin(name)
+
+#endif
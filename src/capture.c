@@ -0,0 +1,276 @@
+#include "emulator.h"
+
+capture_t capture;
+
+/* Samples are produced every (CYCLES_PER_SECOND / SOUND_SAMPLERATE) cycles, so the real rate is slightly above 48kHz */
+#define CAPTURE_SAMPLE_PERIOD (CYCLES_PER_SECOND / SOUND_SAMPLERATE)
+
+static uint8_t yuv[VIDEO_COLOR_COUNT][3];
+static uint8_t chroma[LCD_WIDTH * LCD_HEIGHT * 2];
+static uint8_t plane[LCD_WIDTH * LCD_HEIGHT];
+static float silence[SOUND_BUFFER_SIZE];
+
+static void write_u16(FILE *fp, uint16_t value)
+{
+    fputc(value & 0xFF, fp);
+    fputc(value >> 8, fp);
+}
+
+static void write_u32(FILE *fp, uint32_t value)
+{
+    write_u16(fp, value & 0xFFFF);
+    write_u16(fp, value >> 16);
+}
+
+/* Float PCM, the data sizes are patched in capture_stop when the output can be seeked */
+static void write_wav_header(FILE *fp, uint32_t data_size)
+{
+    fwrite("RIFF", 1, 4, fp);
+    write_u32(fp, (data_size == 0xFFFFFFFF) ? data_size : data_size + 36);
+    fwrite("WAVE", 1, 4, fp);
+
+    fwrite("fmt ", 1, 4, fp);
+    write_u32(fp, 16);
+    write_u16(fp, 3);                           // IEEE float
+    write_u16(fp, 2);                           // Channels
+    write_u32(fp, capture.audio_rate);
+    write_u32(fp, capture.audio_rate * 2 * sizeof(float));
+    write_u16(fp, 2 * sizeof(float));           // Block align
+    write_u16(fp, 8 * sizeof(float));           // Bits per sample
+
+    fwrite("data", 1, 4, fp);
+    write_u32(fp, data_size);
+}
+
+static void write_frame(capture_item_t *item)
+{
+    ZONE("capture_frame");
+
+    for (int i=0; i < LCD_WIDTH * LCD_HEIGHT; i++) {
+        const uint8_t *color = yuv[item->pixels[i] & (VIDEO_COLOR_COUNT - 1)];
+
+        plane[i] = color[0];
+        chroma[i] = color[1];
+        chroma[LCD_WIDTH * LCD_HEIGHT + i] = color[2];
+    }
+
+    fputs("FRAME\n", capture.video);
+    fwrite(plane, 1, sizeof(plane), capture.video);
+    fwrite(chroma, 1, sizeof(chroma), capture.video);
+
+    capture.frames++;
+}
+
+static void write_audio(const float *samples, uint32_t count)
+{
+    fwrite(samples, sizeof(float), count, capture.audio);
+    capture.audio_samples += count / 2;
+}
+
+/* The APU produces nothing while it's off, fill the gap so audio stays in sync with the video */
+static void pad_audio(uint64_t cycles)
+{
+    uint64_t expected = cycles / CAPTURE_SAMPLE_PERIOD;
+
+    // Stereo frames, one APU buffer of slack for the buffer still being filled
+    if (capture.audio_samples + SOUND_BUFFER_SIZE / 2 >= expected) {
+        return;
+    }
+
+    while (capture.audio_samples < expected) {
+        uint64_t missing = (expected - capture.audio_samples) * 2;
+        uint32_t count = (missing < SOUND_BUFFER_SIZE) ? (uint32_t) missing : SOUND_BUFFER_SIZE;
+
+        write_audio(silence, count);
+        capture.padded_samples += count / 2;
+    }
+}
+
+/* Writer thread, does all the conversion and I/O */
+static int capture_run(void *data)
+{
+    (void) data;
+
+    zone_thread("capture");
+
+    while (true) {
+        SDL_SemWait(capture.used_slots);
+
+        capture_item_t *item = &capture.items[capture.tail];
+        capture.tail = (capture.tail + 1) % CAPTURE_QUEUE_SIZE;
+
+        switch(item->type) {
+            case CAPTURE_ITEM_FRAME:
+                if (capture.video) {
+                    write_frame(item);
+                }
+
+                if (capture.audio) {
+                    pad_audio(item->cycles);
+                }
+                break;
+
+            case CAPTURE_ITEM_AUDIO:
+                if (capture.audio) {
+                    write_audio(item->audio, item->samples);
+                }
+                break;
+
+            case CAPTURE_ITEM_STOP:
+                SDL_SemPost(capture.free_slots);
+                return 0;
+        }
+
+        SDL_SemPost(capture.free_slots);
+    }
+}
+
+static FILE* open_output(const char *path)
+{
+    // Also works for named pipes, fopen blocks until the reader shows up
+    FILE *fp = fopen(path, "wb");
+
+    if (!fp) {
+        printf("[capture] Unable to open %s\n", path);
+        exit(-1);
+    }
+
+    setvbuf(fp, NULL, _IOFBF, 1 << 16);
+
+    return fp;
+}
+
+bool capture_start(const char *video_path, const char *audio_path)
+{
+    if (!video_path && !audio_path) {
+        return false;
+    }
+
+    memset(&capture, 0x00, sizeof(capture_t));
+
+    // Same colors as on screen, BT.601 studio range
+    for (int i=0; i < VIDEO_COLOR_COUNT; i++) {
+        int r = (video_colors[i] >> 16) & 0xFF;
+        int g = (video_colors[i] >> 8) & 0xFF;
+        int b = video_colors[i] & 0xFF;
+
+        yuv[i][0] = 16 + ((66 * r + 129 * g + 25 * b + 128) >> 8);
+        yuv[i][1] = 128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8);
+        yuv[i][2] = 128 + ((112 * r - 94 * g - 18 * b + 128) >> 8);
+    }
+
+    if (video_path) {
+        capture.video = open_output(video_path);
+        fprintf(capture.video, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C444\n", LCD_WIDTH, LCD_HEIGHT, CAPTURE_FPS_NUM, CAPTURE_FPS_DEN);
+    }
+
+    if (audio_path) {
+        capture.audio = open_output(audio_path);
+        capture.audio_rate = CYCLES_PER_SECOND / CAPTURE_SAMPLE_PERIOD;
+        capture.audio_seekable = fseek(capture.audio, 0, SEEK_CUR) == 0;
+
+        // Unknown length when streaming into a pipe
+        write_wav_header(capture.audio, capture.audio_seekable ? 0 : 0xFFFFFFFF);
+    }
+
+    capture.free_slots = SDL_CreateSemaphore(CAPTURE_QUEUE_SIZE);
+    capture.used_slots = SDL_CreateSemaphore(0);
+    capture.thread = SDL_CreateThread(capture_run, "capture", NULL);
+
+    if (!capture.free_slots || !capture.used_slots || !capture.thread) {
+        printf("[capture] Unable to start writer thread!\n");
+        exit(-1);
+    }
+
+    capture.enabled = true;
+
+    return true;
+}
+
+/* Waits for a free slot, only blocks if the writer is a whole queue behind */
+static capture_item_t* capture_acquire(uint8_t type)
+{
+    if (SDL_SemTryWait(capture.free_slots) != 0) {
+        capture.stalls++;
+        SDL_SemWait(capture.free_slots);
+    }
+
+    capture_item_t *item = &capture.items[capture.head];
+    item->type = type;
+    item->cycles = emulator.total_cycles;
+
+    return item;
+}
+
+static void capture_submit()
+{
+    capture.head = (capture.head + 1) % CAPTURE_QUEUE_SIZE;
+    SDL_SemPost(capture.used_slots);
+}
+
+/* Called by the PPU for each completed frame */
+void capture_frame(const uint16_t *color_buffer)
+{
+    if (!capture.video && !capture.audio) {
+        return;
+    }
+
+    capture_item_t *item = capture_acquire(CAPTURE_ITEM_FRAME);
+
+    if (capture.video) {
+        memcpy(item->pixels, color_buffer, sizeof(item->pixels));
+    }
+
+    capture_submit();
+}
+
+/* Called by the APU whenever its sample buffer is full */
+void capture_audio(const float *samples, uint32_t count)
+{
+    if (!capture.audio) {
+        return;
+    }
+
+    capture_item_t *item = capture_acquire(CAPTURE_ITEM_AUDIO);
+    memcpy(item->audio, samples, sizeof(float) * count);
+    item->samples = count;
+
+    capture_submit();
+}
+
+/* Drains the queue and finalizes the files, the emulator thread must be stopped */
+void capture_stop()
+{
+    if (!capture.enabled) {
+        return;
+    }
+
+    capture.enabled = false;
+
+    capture_acquire(CAPTURE_ITEM_STOP);
+    capture_submit();
+    SDL_WaitThread(capture.thread, NULL);
+
+    if (capture.video) {
+        fclose(capture.video);
+    }
+
+    if (capture.audio) {
+        if (capture.audio_seekable) {
+            fseek(capture.audio, 0, SEEK_SET);
+            write_wav_header(capture.audio, (uint32_t) (capture.audio_samples * 2 * sizeof(float)));
+        }
+
+        fclose(capture.audio);
+    }
+
+    SDL_DestroySemaphore(capture.free_slots);
+    SDL_DestroySemaphore(capture.used_slots);
+
+    printf("[capture] %u frames | %llu audio samples (%llu padded) | %u stalls\n",
+            capture.frames,
+            (unsigned long long) capture.audio_samples,
+            (unsigned long long) capture.padded_samples,
+            capture.stalls
+        );
+}
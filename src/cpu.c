@@ -2178,12 +2178,19 @@ void instruction_halt()
 
 void instruction_stop()
 {
-    // TODO: Stop emulator
-    cpu.halted = true;
-    
-    timer.div = 0;
+    timer_wb(0x04, 0x00);
 
     cpu.cycles += 4;
+
+    // CGB speed switch, the CPU carries on right away
+    if (cpu.speed_switch) {
+        cpu.double_speed = !cpu.double_speed;
+        cpu.speed_switch = false;
+        return;
+    }
+
+    // TODO: Stop emulator
+    cpu.halted = true;
 }
 
 void instruction_di()
@@ -2557,6 +2564,7 @@ void instruction_ld_b_a()
 void instruction_ld_b_b()
 {
     cpu.regs.b = cpu.regs.b;
+    cpu.software_break = true;
 
     cpu.cycles += 4;
 }
@@ -4623,267 +4631,6 @@ const void (*cb_instruction_pointers[256])(void) = {
     [0x26] = &instruction_cb_sla_hlp
 };
 
-const char* instruction_labels[256] = {
-    /* Control */
-    [0x3F] = "CCF",
-    [0x37] = "SCF",
-    [0x00] = "NOP",
-    [0x76] = "HALT",
-    [0x10] = "STOP",
-    [0xF3] = "DI",
-    [0xFB] = "EI",
-
-    /* Jump */
-    [0xC3] = "JP nn",
-    [0xE9] = "JP HL",
-    [0xC2] = "JP NZ,nn",
-    [0xCA] = "JP Z,nn",
-    [0xD2] = "JP NC,nn",
-    [0xDA] = "JP C,nn",
-    [0x18] = "JR PC+dd",
-    [0x20] = "JR NZ,PC+dd",
-    [0x28] = "JR Z,PC+dd",
-    [0x30] = "JR NC,PC+dd",
-    [0x38] = "JR C,PC+dd",
-    [0xCD] = "CALL nn",
-    [0xC4] = "CALL NZ,nn",
-    [0xCC] = "CALL Z,nn",
-    [0xD4] = "CALL NC,nn",
-    [0xDC] = "CALL C,nn",
-    [0xC9] = "RET",
-    [0xC0] = "RET NZ",
-    [0xC8] = "RET Z",
-    [0xD0] = "RET NC",
-    [0xD8] = "RET C",
-    [0xD9] = "RETI",
-    [0xC7] = "RST 00",
-    [0xCF] = "RST 08",
-    [0xD7] = "RST 10",
-    [0xDF] = "RST 18",
-    [0xE7] = "RST 20",
-    [0xEF] = "RST 28",
-    [0xF7] = "RST 30",
-    [0xFF] = "RST 38",
-
-    /* 8-bit Load instructions */
-    [0x7F] = "LD A,A",
-    [0x78] = "LD A,B",
-    [0x79] = "LD A,C",
-    [0x7A] = "LD A,D",
-    [0x7B] = "LD A,E",
-    [0x7C] = "LD A,H",
-    [0x7D] = "LD A,L",
-    [0x47] = "LD B,A",
-    [0x40] = "LD B,B",
-    [0x41] = "LD B,C",
-    [0x42] = "LD B,D",
-    [0x43] = "LD B,E",
-    [0x44] = "LD B,H",
-    [0x45] = "LD B,L",
-    [0x4F] = "LD C,A",
-    [0x48] = "LD C,B",
-    [0x49] = "LD C,C",
-    [0x4A] = "LD C,D",
-    [0x4B] = "LD C,E",
-    [0x4C] = "LD C,H",
-    [0x4D] = "LD C,L",
-    [0x57] = "LD D,A",
-    [0x50] = "LD D,B",
-    [0x51] = "LD D,C",
-    [0x52] = "LD D,D",
-    [0x53] = "LD D,E",
-    [0x54] = "LD D,H",
-    [0x55] = "LD D,L",
-    [0x5F] = "LD E,A",
-    [0x58] = "LD E,B",
-    [0x59] = "LD E,C",
-    [0x5A] = "LD E,D",
-    [0x5B] = "LD E,E",
-    [0x5C] = "LD E,H",
-    [0x5D] = "LD E,L",
-    [0x67] = "LD H,A",
-    [0x60] = "LD H,B",
-    [0x61] = "LD H,C",
-    [0x62] = "LD H,D",
-    [0x63] = "LD H,E",
-    [0x64] = "LD H,H",
-    [0x65] = "LD H,L",
-    [0x6F] = "LD L,A",
-    [0x68] = "LD L,B",
-    [0x69] = "LD L,C",
-    [0x6A] = "LD L,D",
-    [0x6B] = "LD L,E",
-    [0x6C] = "LD L,H",
-    [0x6D] = "LD L,L",
-    [0x3E] = "LD A,n",
-    [0x06] = "LD B,n",
-    [0x0E] = "LD C,n",
-    [0x16] = "LD D,n",
-    [0x1E] = "LD E,n",
-    [0x26] = "LD H,n",
-    [0x2E] = "LD L,n",
-    [0x7E] = "LD A,(HL)",
-    [0x46] = "LD B,(HL)",
-    [0x4E] = "LD C,(HL)",
-    [0x56] = "LD D,(HL)",
-    [0x5E] = "LD E,(HL)",
-    [0x66] = "LD H,(HL)",
-    [0x6E] = "LD L,(HL)",
-    [0x77] = "LD (HL),A",
-    [0x70] = "LD (HL),B",
-    [0x71] = "LD (HL),C",
-    [0x72] = "LD (HL),D",
-    [0x73] = "LD (HL),E",
-    [0x74] = "LD (HL),H",
-    [0x75] = "LD (HL),L",
-    [0x36] = "LD (HL),n",
-    [0x0A] = "LD A,(BC)",
-    [0x1A] = "LD A,(DE)",
-    [0xFA] = "LD A,(nn)",
-    [0x02] = "LD (BC),A",
-    [0x12] = "LD (DE),A",
-    [0xEA] = "LD (nn),A",
-    [0xF0] = "LD A,(FF00+n)",
-    [0xE0] = "LD (FF00+n),A",
-    [0xF2] = "LD A,(FF00+C)",
-    [0xE2] = "LD (FF00+C),A",
-    [0x22] = "LDI (HL),A",
-    [0x2A] = "LDI A,(HL)",
-    [0x32] = "LDD (HL),A",
-    [0x3A] = "LDD A,(HL)",
-
-    /* 16-bit Load instructions */
-    [0x01] = "LD BC,nn",
-    [0x11] = "LD DE,nn",
-    [0x21] = "LD HL,nn",
-    [0x31] = "LD SP,nn",
-    [0x08] = "LD (nn),SP",
-    [0xF9] = "LD SP,HL",
-    [0xF5] = "PUSH AF",
-    [0xC5] = "PUSH BC",
-    [0xD5] = "PUSH DE",
-    [0xE5] = "PUSH HL",
-    [0xF1] = "POP AF",
-    [0xC1] = "POP BC",
-    [0xD1] = "POP DE",
-    [0xE1] = "POP HL",
-
-    /* 8-bit Arithmetic/Logic instructions */
-    [0x87] = "ADD A,A",
-    [0x80] = "ADD A,B",
-    [0x81] = "ADD A,C",
-    [0x82] = "ADD A,D",
-    [0x83] = "ADD A,E",
-    [0x84] = "ADD A,H",
-    [0x85] = "ADD A,L",
-    [0xC6] = "ADD A,n",
-    [0x86] = "ADD A,(HL)",
-    [0x8F] = "ADC A,A",
-    [0x88] = "ADC A,B",
-    [0x89] = "ADC A,C",
-    [0x8A] = "ADC A,D",
-    [0x8B] = "ADC A,E",
-    [0x8C] = "ADC A,H",
-    [0x8D] = "ADC A,L",
-    [0xCE] = "ADC A,n",
-    [0x8E] = "ADC A,(HL)",
-    [0x97] = "SUB A,A",
-    [0x90] = "SUB A,B",
-    [0x91] = "SUB A,C",
-    [0x92] = "SUB A,D",
-    [0x93] = "SUB A,E",
-    [0x94] = "SUB A,H",
-    [0x95] = "SUB A,L",
-    [0xD6] = "SUB A,n",
-    [0x96] = "SUB A,(HL)",
-    [0x9F] = "SBC A,A",
-    [0x98] = "SBC A,B",
-    [0x99] = "SBC A,C",
-    [0x9A] = "SBC A,D",
-    [0x9B] = "SBC A,E",
-    [0x9C] = "SBC A,H",
-    [0x9D] = "SBC A,L",
-    [0xDE] = "SBC A,n",
-    [0x9E] = "SBC A,(HL)",
-    [0xA7] = "AND A",
-    [0xA0] = "AND B",
-    [0xA1] = "AND C",
-    [0xA2] = "AND D",
-    [0xA3] = "AND E",
-    [0xA4] = "AND H",
-    [0xA5] = "AND L",
-    [0xE6] = "AND n",
-    [0xA6] = "AND (HL)",
-    [0xAF] = "XOR A",
-    [0xA8] = "XOR B",
-    [0xA9] = "XOR C",
-    [0xAA] = "XOR D",
-    [0xAB] = "XOR E",
-    [0xAC] = "XOR H",
-    [0xAD] = "XOR L",
-    [0xEE] = "XOR n",
-    [0xAE] = "XOR (HL)",
-    [0xB7] = "OR A",
-    [0xB0] = "OR B",
-    [0xB1] = "OR C",
-    [0xB2] = "OR D",
-    [0xB3] = "OR E",
-    [0xB4] = "OR H",
-    [0xB5] = "OR L",
-    [0xF6] = "OR n",
-    [0xB6] = "OR (HL)",
-    [0xBF] = "CP A",
-    [0xB8] = "CP B",
-    [0xB9] = "CP C",
-    [0xBA] = "CP D",
-    [0xBB] = "CP E",
-    [0xBC] = "CP H",
-    [0xBD] = "CP L",
-    [0xFE] = "CP n",
-    [0xBE] = "CP (HL)",
-    [0x3C] = "INC A",
-    [0x04] = "INC B",
-    [0x0C] = "INC C",
-    [0x14] = "INC D",
-    [0x1C] = "INC E",
-    [0x24] = "INC H",
-    [0x2C] = "INC L",
-    [0x34] = "INC (HL)",
-    [0x3D] = "DEC A",
-    [0x05] = "DEC B",
-    [0x0D] = "DEC C",
-    [0x15] = "DEC D",
-    [0x1D] = "DEC E",
-    [0x25] = "DEC H",
-    [0x2D] = "DEC L",
-    [0x35] = "DEC (HL)",
-    [0x27] = "DAA",
-    [0x2F] = "CPL",
-
-    /* 16-bit Arithmetic/Logic instructions */
-    [0x09] = "ADD HL,BC",
-    [0x19] = "ADD HL,DE",
-    [0x29] = "ADD HL,HL",
-    [0x39] = "ADD HL,SP",
-    [0x03] = "INC BC",
-    [0x13] = "INC DE",
-    [0x23] = "INC HL",
-    [0x33] = "INC SP",
-    [0x0B] = "DEC BC",
-    [0x1B] = "DEC DE",
-    [0x2B] = "DEC HL",
-    [0x3B] = "DEC SP",
-    [0xE8] = "ADD SP,dd",
-    [0xF8] = "LD HL,SP+dd",
-
-    /* Rotate and Shift */
-    [0x07] = "RLCA",
-    [0x17] = "RLA",
-    [0x1F] = "RRA",
-
-    [0xCB] = "CB"
-};
-
 const void (*instruction_pointers[256])(void) = {
     /* Control */
     [0x3F] = &instruction_ccf,
@@ -5158,14 +4905,26 @@ void cpu_reset()
     cpu.regs.pc = 0x0000;
     cpu.ie = 0x00;
     cpu.ifr = 0x00;
+    cpu.pending = 0x00;
     cpu.ime = false;
+    cpu.halted = false;
+    cpu.stopped = false;
     cpu.cycles = 0;
     cpu.debug_enabled = false;
+    cpu.software_break = false;
+    cpu.double_speed = false;
+    cpu.speed_switch = false;
+}
+
+static inline void update_pending()
+{
+    cpu.pending = cpu.ie & cpu.ifr & 0x1F;
 }
 
 void cpu_enable_interrupts(uint8_t ie)
 {
     cpu.ie = ie;
+    update_pending();
 
     #if defined CPU_DEBUG && defined CPU_DEBUG_INTERRUPTS
     DEBUG_CPU("-> IE: %x\n", ie);
@@ -5200,6 +4959,7 @@ void cpu_request_interrupt(uint8_t ifr)
     }
 
     cpu.ifr |= ifr;
+    update_pending();
 
     #if defined CPU_DEBUG && defined CPU_DEBUG_INTERRUPTS
     char *source_name;
@@ -5226,39 +4986,36 @@ void cpu_request_interrupt(uint8_t ifr)
     #endif
 }
 
-void cpu_serve_interrupts()
-{
-    if (cpu.ime && (cpu.ifr & cpu.ie)) {
-        uint8_t triggered = cpu.ie & cpu.ifr;
-
-        cpu_stack_push(cpu.regs.pc);
-
-        if (triggered & CPU_IF_VBLANK) {
-            cpu.regs.pc = 0x0040;
-            cpu.ifr &= ~CPU_IF_VBLANK;
-        } else if (triggered & CPU_IF_LCD_STAT) {
-            cpu.regs.pc = 0x0048;
-            cpu.ifr &= ~CPU_IF_LCD_STAT;
-        } else if (triggered & CPU_IF_TIMER) {
-            cpu.regs.pc = 0x0050;
-            cpu.ifr &= ~CPU_IF_TIMER;
-        } else if (triggered & CPU_IF_SERIAL) {
-            cpu.regs.pc = 0x0058;
-            cpu.ifr &= ~CPU_IF_SERIAL;
-        } else if (triggered & CPU_IF_JOYPAD) {
-            cpu.regs.pc = 0x0060;
-            cpu.ifr &= ~CPU_IF_JOYPAD;
-        }
+/* Writes to FF0F */
+void cpu_set_interrupt_flags(uint8_t ifr)
+{
+    cpu.ifr = ifr;
+    update_pending();
+}
 
-        cpu.cycles += 20;
+/* Jumps to the highest priority pending interrupt, the lowest bit wins and vectors are 8 bytes apart */
+static void serve_interrupt()
+{
+    uint8_t bit = __builtin_ctz(cpu.pending);
 
-        cpu.ime = false;
-        cpu.halted = false;
+    cpu_stack_push(cpu.regs.pc);
 
-        #if defined CPU_DEBUG && defined CPU_DEBUG_INTERRUPTS
-        DEBUG_CPU("Interrupt after %d cycles | IF: %02X\n", cpu.cycles, cpu.ifr);
-        #endif
+    cpu.regs.pc = 0x0040 + bit * 8;
+    cpu.ifr &= ~(1 << bit);
+    update_pending();
+
+    cpu.cycles += 20;
+
+    cpu.ime = false;
+    cpu.halted = false;
+
+    if (profile_enabled) {
+        profile_interrupt(cpu.regs.pc);
     }
+
+    #if defined CPU_DEBUG && defined CPU_DEBUG_INTERRUPTS
+    DEBUG_CPU("Interrupt after %d cycles | IF: %02X\n", cpu.cycles, cpu.ifr);
+    #endif
 }
 
 void cpu_step()
@@ -5267,19 +5024,34 @@ void cpu_step()
         return;
     }
 
+    // Interrupts are only taken between instructions, with nothing pending this is the only check
+    if (cpu.pending && cpu.ime) {
+        serve_interrupt();
+        return;
+    }
+
     if (cpu.halted) {
         cpu.cycles += 1;
         return;
     }
 
-    // Breakpoints
-    if (mmu.boot_rom_mapped == false && cpu.regs.pc == 0x0100) cpu.debug_enabled = true;
+    uint16_t pc = cpu.regs.pc;
+    uint16_t sp = cpu.regs.sp;
+    uint32_t cycles = cpu.cycles;
+    uint8_t cb_opcode = 0;
 
     uint8_t opcode = mmu_rb(cpu.regs.pc++);
 
+    if (trace_enabled) {
+        trace_instruction(opcode);
+    }
+
     #if defined CPU_DEBUG && defined CPU_DEBUG_INSTRUCTIONS
     if (cpu.debug_enabled) {
-        DEBUG_CPU("A: %02X B: %02X C: %02X D: %02X E: %02X H: %02X L: %02X | F: %02X PC: %04X SP: %04X IME: %d IE: %02X IF: %02X Cycles: %d | %02X | %s\n",
+        char text[64];
+        debug_disasm(pc, text, sizeof(text));
+
+        LOG(LOG_CPU, LOG_LEVEL_TRACE, "A: %02X B: %02X C: %02X D: %02X E: %02X H: %02X L: %02X | F: %02X PC: %04X SP: %04X IME: %d IE: %02X IF: %02X Cycles: %d | %02X | %s\n",
             cpu.regs.a,
             cpu.regs.b,
             cpu.regs.c,
@@ -5295,7 +5067,7 @@ void cpu_step()
             cpu.ifr,
             cpu.cycles,
             opcode,
-            instruction_labels[opcode]
+            text
         );
     }
     #endif
@@ -5304,21 +5076,17 @@ void cpu_step()
         if (instruction_pointers[opcode]) {
             (*instruction_pointers[opcode])();
         } else {
-            #ifdef CPU_DEBUG
-            DEBUG_CPU("Unknown opcode %02X at PC: %04X\n", opcode, cpu.regs.pc - 1);
-            #endif
+            LOG(LOG_CPU, LOG_LEVEL_ERROR, "Unknown opcode %02X at PC: %04X\n", opcode, cpu.regs.pc - 1);
 
             cpu.stopped = true;
         }
     } else {
-        opcode = mmu_rb(cpu.regs.pc++);
+        cb_opcode = mmu_rb(cpu.regs.pc++);
 
-        if (cb_instruction_pointers[opcode]) {
-            (*cb_instruction_pointers[opcode])();
+        if (cb_instruction_pointers[cb_opcode]) {
+            (*cb_instruction_pointers[cb_opcode])();
         } else {
-            #ifdef CPU_DEBUG
-            DEBUG_CPU("Unknown CB opcode %02X at PC: %04X\n", opcode, cpu.regs.pc - 2);
-            #endif
+            LOG(LOG_CPU, LOG_LEVEL_ERROR, "Unknown CB opcode %02X at PC: %04X\n", cb_opcode, cpu.regs.pc - 2);
 
             cpu.stopped = true;
         }
@@ -5328,4 +5096,17 @@ void cpu_step()
         // HALT bug
         cpu.regs.pc--;
     }
+
+    #if defined CPU_DEBUG && defined CPU_DEBUG_TIMING
+    const opcode_info_t *info = (opcode == 0xCB) ? &opcode_cb_table[cb_opcode] : &opcode_table[opcode];
+    uint32_t used = cpu.cycles - cycles;
+
+    if (!cpu.stopped && used != info->cycles && used != info->cycles_taken) {
+        LOG(LOG_CPU, LOG_LEVEL_WARN, "%s took %u cycles, expected %u\n", info->mnemonic, used, info->cycles);
+    }
+    #endif
+
+    if (profile_enabled) {
+        profile_instruction(pc, sp, opcode, cb_opcode, cpu.cycles - cycles);
+    }
 }
\ No newline at end of file
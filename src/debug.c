@@ -1,21 +1,25 @@
 #include "emulator.h"
 
+uint8_t debug_pages[256];
+debug_t debugger;
+
 void debug_mem_dump(uint16_t start, uint16_t size)
 {
     printf("[debug] memdump start: %04X size: %04X\n", start, size);
 
     for (int i=0; i < (size / 8); i++) {
         for (int j=0; j < 8; j++) {
-            printf("%x ", mmu_rb(start + i*8 + j));
+            printf("%x ", debug_peek(start + i*8 + j));
         }
 
         printf("\n");
     }
 }
 
+/* Only called between instructions, so PC points at the next one */
 void debug_reg_dump()
 {
-    printf("[debug] regdump: A: %02X B: %02X C: %02X D: %02X E: %02X H: %02X L: %02X | F: %02X PC: %04X SP: %04X IE: %02X IF: %02X Cycles: %d\n",
+    printf("[debug] regdump: A: %02X B: %02X C: %02X D: %02X E: %02X H: %02X L: %02X | F: %02X PC: %04X SP: %04X IME: %d IE: %02X IF: %02X Cycles: %d\n",
                 cpu.regs.a,
                 cpu.regs.b,
                 cpu.regs.c,
@@ -24,10 +28,359 @@ void debug_reg_dump()
                 cpu.regs.h,
                 cpu.regs.l,
                 cpu.regs.f,
-                cpu.regs.pc - 1,
+                cpu.regs.pc,
                 cpu.regs.sp,
+                cpu.ime ? 1 : 0,
                 cpu.ie,
                 cpu.ifr,
                 cpu.cycles
             );
-}
\ No newline at end of file
+
+    char text[64];
+    debug_disasm(cpu.regs.pc, text, sizeof(text));
+    printf("[debug] %04X: %s\n", cpu.regs.pc, text);
+}
+
+/* Disassembles the instruction in memory at addr, with the ROM bank currently mapped */
+void debug_disasm(uint16_t addr, char *buffer, int size)
+{
+    uint8_t bytes[3];
+    disasm_insn_t insn;
+
+    for (int i=0; i < 3; i++) {
+        bytes[i] = debug_peek(addr + i);
+    }
+
+    disasm_decode(bytes, 3, addr, &insn);
+    disasm_format(&insn, mbc_bank(0x4000), buffer, size);
+}
+
+static void debug_update_pages()
+{
+    memset(debug_pages, 0x00, sizeof(debug_pages));
+
+    for (int i=0; i < DEBUG_MAX_POINTS; i++) {
+        debug_point_t *point = &debugger.points[i];
+
+        if (!point->used) {
+            continue;
+        }
+
+        for (int page = point->start >> 8; page <= point->end >> 8; page++) {
+            debug_pages[page] |= point->type;
+        }
+    }
+}
+
+bool debug_add(uint8_t type, uint16_t start, uint16_t end, uint16_t bank)
+{
+    if (end < start) {
+        return false;
+    }
+
+    for (int i=0; i < DEBUG_MAX_POINTS; i++) {
+        debug_point_t *point = &debugger.points[i];
+
+        if (!point->used) {
+            point->used = true;
+            point->type = type;
+            point->start = start;
+            point->end = end;
+            point->bank = bank;
+
+            debug_update_pages();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool debug_remove(uint8_t type, uint16_t start, uint16_t end)
+{
+    for (int i=0; i < DEBUG_MAX_POINTS; i++) {
+        debug_point_t *point = &debugger.points[i];
+
+        if (point->used && point->type == type && point->start == start && point->end == end) {
+            point->used = false;
+
+            debug_update_pages();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Name of a symbol or a hex address, '$' forces hex. Symbols in 4000-7FFF also give their ROM bank */
+static bool parse_addr(const char *str, char **end, uint16_t *addr, uint16_t *bank)
+{
+    // Symbol names end at the same separators as addresses
+    int length = (int) strcspn(str, "-:");
+    char name[256];
+
+    *bank = DEBUG_ANY_BANK;
+
+    if (*str != '$' && length > 0 && length < (int) sizeof(name)) {
+        memcpy(name, str, length);
+        name[length] = '\0';
+
+        if (symbols_lookup(name, bank, addr)) {
+            if (*addr < 0x4000 || *addr >= 0x8000) {
+                *bank = DEBUG_ANY_BANK;
+            }
+
+            *end = (char *) str + length;
+            return true;
+        }
+    }
+
+    if (*str == '$') {
+        str++;
+    }
+
+    unsigned long value = strtoul(str, end, 16);
+
+    if (*end == str || value > 0xFFFF) {
+        return false;
+    }
+
+    *addr = (uint16_t) value;
+    return true;
+}
+
+/* <addr>, hex or a symbol */
+bool debug_parse_break(const char *arg)
+{
+    char *end;
+    uint16_t addr;
+    uint16_t bank;
+
+    if (!parse_addr(arg, &end, &addr, &bank) || *end != '\0') {
+        return false;
+    }
+
+    return debug_add(DEBUG_BREAK, addr, addr, bank);
+}
+
+/* <start>[-<end>][:r|w|rw], hex or symbols */
+bool debug_parse_watch(const char *arg)
+{
+    char *end;
+    uint16_t start;
+    uint16_t stop;
+    uint16_t bank;
+    uint16_t stop_bank = DEBUG_ANY_BANK;
+    uint8_t type = DEBUG_WATCH_READ | DEBUG_WATCH_WRITE;
+
+    if (!parse_addr(arg, &end, &start, &bank)) {
+        return false;
+    }
+
+    stop = start;
+
+    if (*end == '-' && !parse_addr(end + 1, &end, &stop, &stop_bank)) {
+        return false;
+    }
+
+    // A range can't span two ROM banks
+    if (stop_bank != DEBUG_ANY_BANK && stop_bank != bank) {
+        if (bank != DEBUG_ANY_BANK) {
+            return false;
+        }
+
+        bank = stop_bank;
+    }
+
+    if (*end == ':') {
+        end++;
+
+        if (strcmp(end, "r") == 0) {
+            type = DEBUG_WATCH_READ;
+        } else if (strcmp(end, "w") == 0) {
+            type = DEBUG_WATCH_WRITE;
+        } else if (strcmp(end, "rw") != 0) {
+            return false;
+        }
+    } else if (*end != '\0') {
+        return false;
+    }
+
+    return debug_add(type, start, stop, bank);
+}
+
+static debug_point_t* debug_find(uint8_t type, uint16_t addr)
+{
+    for (int i=0; i < DEBUG_MAX_POINTS; i++) {
+        debug_point_t *point = &debugger.points[i];
+
+        if (!point->used || !(point->type & type) || addr < point->start || addr > point->end) {
+            continue;
+        }
+
+        // Points on banked symbols only count while their bank is mapped
+        if (point->bank == DEBUG_ANY_BANK || addr < 0x4000 || addr >= 0x8000 || mbc_bank(addr) == point->bank) {
+            return point;
+        }
+    }
+
+    return NULL;
+}
+
+/* Bus access for debuggers that doesn't trigger watchpoints or see the OAM DMA lock, the emulator thread must be parked */
+uint8_t debug_peek(uint16_t addr)
+{
+    uint8_t flags = debug_pages[addr >> 8];
+    bool active = dma.active;
+    debug_pages[addr >> 8] = 0;
+    dma.active = false;
+
+    uint8_t data = mmu_rb(addr);
+
+    debug_pages[addr >> 8] = flags;
+    dma.active = active;
+    return data;
+}
+
+void debug_poke(uint16_t addr, uint8_t data)
+{
+    uint8_t flags = debug_pages[addr >> 8];
+    bool active = dma.active;
+    debug_pages[addr >> 8] = 0;
+    dma.active = false;
+
+    mmu_wb(addr, data);
+
+    debug_pages[addr >> 8] = flags;
+    dma.active = active;
+}
+
+/* Stops the emulator thread, it finishes the current instruction first */
+static void debug_hit(uint8_t type, uint16_t addr)
+{
+    // An instruction can hit several times, the first one is reported
+    if (!debugger.hit) {
+        debugger.hit_type = type;
+        debugger.hit_addr = addr;
+    }
+
+    debugger.hit = true;
+    SDL_AtomicCAS(&debugger.paused, DEBUG_RUNNING, DEBUG_PAUSING);
+}
+
+/* Called before the instruction at pc executes, true if it must not */
+bool debug_check_break(uint16_t pc)
+{
+    if (debugger.skip && debugger.skip_pc == pc) {
+        debugger.skip = false;
+        return false;
+    }
+
+    if (!debug_find(DEBUG_BREAK, pc)) {
+        return false;
+    }
+
+    printf("[debug] Breakpoint at %04X\n", pc);
+
+    // Resuming runs this instruction instead of stopping on it again
+    debugger.skip = true;
+    debugger.skip_pc = pc;
+
+    // Instruction logging starts at the first breakpoint, like the old hard-coded one at 0100
+    cpu.debug_enabled = true;
+
+    debug_hit(DEBUG_BREAK, pc);
+    return true;
+}
+
+void debug_check_read(uint16_t addr, uint8_t data)
+{
+    debug_point_t *point = debug_find(DEBUG_WATCH_READ, addr);
+
+    if (point) {
+        printf("[debug] Read from %04X -> %02X (watch %04X-%04X)\n", addr, data, point->start, point->end);
+        debug_hit(DEBUG_WATCH_READ, addr);
+    }
+}
+
+void debug_check_write(uint16_t addr, uint8_t data)
+{
+    debug_point_t *point = debug_find(DEBUG_WATCH_WRITE, addr);
+
+    if (point) {
+        printf("[debug] Write to %04X <- %02X (watch %04X-%04X)\n", addr, data, point->start, point->end);
+        debug_hit(DEBUG_WATCH_WRITE, addr);
+    }
+}
+
+/* Hotkeys and the gdb stub, called from other threads */
+void debug_pause()
+{
+    // Leaves a parked emulator thread parked
+    SDL_AtomicCAS(&debugger.paused, DEBUG_RUNNING, DEBUG_PAUSING);
+}
+
+void debug_continue()
+{
+    SDL_AtomicSet(&debugger.paused, DEBUG_RUNNING);
+}
+
+void debug_step()
+{
+    SDL_AtomicSet(&debugger.step, 1);
+}
+
+/* Waits until the emulator thread stopped after debug_pause or a hit, false if it quit instead */
+bool debug_wait_parked()
+{
+    while (SDL_AtomicGet(&debugger.paused) != DEBUG_PARKED) {
+        if (!SDL_AtomicGet(&emulator.running)) {
+            return false;
+        }
+
+        SDL_Delay(1);
+    }
+
+    return true;
+}
+
+/* Called by the emulator thread while paused, runs pending single steps */
+void debug_update()
+{
+    // Only parks if no debug_continue came in since the emulator thread saw the pause
+    SDL_AtomicCAS(&debugger.paused, DEBUG_PAUSING, DEBUG_PARKED);
+
+    if (SDL_AtomicGet(&debugger.paused) != DEBUG_PARKED) {
+        return;
+    }
+
+    if (!debugger.reported) {
+        debug_reg_dump();
+        debugger.reported = true;
+    }
+
+    if (SDL_AtomicGet(&debugger.step)) {
+        debugger.hit = false;
+        debugger.hit_type = 0;
+
+        // Also steps over a breakpoint on the current instruction
+        debugger.skip = true;
+        debugger.skip_pc = cpu.regs.pc;
+
+        emulator_step();
+        debugger.skip = false;
+
+        debug_reg_dump();
+
+        // Cleared last, the step is complete once it reads 0
+        SDL_AtomicSet(&debugger.step, 0);
+    }
+}
+
+/* Called by the emulator thread when it runs again */
+void debug_resume()
+{
+    debugger.hit = false;
+    debugger.hit_type = 0;
+    debugger.reported = false;
+}
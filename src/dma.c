@@ -0,0 +1,170 @@
+#include "emulator.h"
+
+dma_t dma;
+
+#ifdef DMA_DEBUG
+#define DEBUG_DMA(...) LOG(LOG_LCD, LOG_LEVEL_DEBUG, __VA_ARGS__)
+#endif
+
+void dma_init()
+{
+    memset(&dma, 0x00, sizeof(dma_t));
+}
+
+/* Host memory behind a source address, transfers never cross an 8 KB page */
+static const uint8_t* dma_source(uint16_t addr)
+{
+    if (addr < 0x8000 || (addr >= 0xA000 && addr < 0xC000)) {
+        return &mbc.read_pages[addr >> 13][addr & 0x1FFF];
+    }
+
+    if (addr < 0xA000) {
+        return &mmu.vram[mmu_vram_offset(addr)];
+    }
+
+    // E000 and up mirror WRAM
+    return &mmu.wram[mmu_wram_offset(addr)];
+}
+
+static void hdma_block()
+{
+    const uint8_t *source = dma_source(dma.hdma_source);
+
+    for (int i=0; i < DMA_HDMA_BLOCK; i++) {
+        uint16_t offset = mmu_vram_offset(dma.hdma_destination + i);
+
+        if (mmu.vram[offset] != source[i]) {
+            mmu.vram[offset] = source[i];
+            lcd_vram_written(offset);
+        }
+    }
+
+    dma.hdma_source += DMA_HDMA_BLOCK;
+    dma.hdma_destination = 0x8000 | ((dma.hdma_destination + DMA_HDMA_BLOCK) & 0x1FFF);
+    dma.hdma_blocks--;
+    // Takes as long in double speed, that's twice the CPU cycles
+    dma.stall += DMA_HDMA_CYCLES << cpu.double_speed;
+}
+
+void dma_wb(uint8_t addr, uint8_t data)
+{
+    // Only OAM DMA exists on a DMG
+    if (addr != 0x46 && !emulator.rom_info.cgb) {
+        return;
+    }
+
+    switch(addr) {
+        case 0x46:
+            // Restarts a running transfer
+            dma.reg = data;
+            dma.source = data << 8;
+            dma.bytes = 0;
+            dma.cycles = 0;
+            dma.active = true;
+
+            #ifdef DMA_DEBUG
+            DEBUG_DMA("-> DMA: %04X -> FE00\n", dma.source);
+            #endif
+            break;
+
+        case 0x51:
+            dma.hdma_source = (dma.hdma_source & 0x00FF) | (data << 8);
+            break;
+
+        case 0x52:
+            dma.hdma_source = (dma.hdma_source & 0xFF00) | (data & 0xF0);
+            break;
+
+        case 0x53:
+            dma.hdma_destination = 0x8000 | ((data & 0x1F) << 8) | (dma.hdma_destination & 0x00FF);
+            break;
+
+        case 0x54:
+            dma.hdma_destination = (dma.hdma_destination & 0xFF00) | (data & 0xF0);
+            break;
+
+        case 0x55:
+            // Bit 7 clear stops an HBlank transfer, the remaining length stays readable
+            if (dma.hdma_active && !(data & 0x80)) {
+                dma.hdma_active = false;
+                break;
+            }
+
+            dma.hdma_destination |= 0x8000;
+            dma.hdma_blocks = (data & 0x7F) + 1;
+
+            #ifdef DMA_DEBUG
+            DEBUG_DMA("-> HDMA: %04X -> %04X, %d blocks%s\n", dma.hdma_source, dma.hdma_destination, dma.hdma_blocks, (data & 0x80) ? " in HBlank" : "");
+            #endif
+
+            if (data & 0x80) {
+                dma.hdma_active = true;
+                break;
+            }
+
+            // General purpose, all at once
+            while (dma.hdma_blocks) {
+                hdma_block();
+            }
+            break;
+    }
+}
+
+uint8_t dma_rb(uint8_t addr)
+{
+    switch(addr) {
+        case 0x46:
+            return dma.reg;
+
+        case 0x55:
+            if (emulator.rom_info.cgb) {
+                return (dma.hdma_active ? 0x00 : 0x80) | ((dma.hdma_blocks - 1) & 0x7F);
+            }
+            break;
+    }
+
+    return 0xFF;
+}
+
+/* Copies the bytes that are due by now straight from the source page */
+void dma_step(uint32_t cycles)
+{
+    dma.cycles += cycles;
+
+    uint32_t due = dma.cycles / DMA_CYCLES_PER_BYTE;
+
+    if (due > DMA_OAM_BYTES) {
+        due = DMA_OAM_BYTES;
+    }
+
+    if (due > dma.bytes) {
+        const uint8_t *source = dma_source(dma.source) + dma.bytes;
+        uint8_t *destination = &mmu.oam[dma.bytes];
+        uint32_t count = due - dma.bytes;
+
+        if (memcmp(destination, source, count) != 0) {
+            memcpy(destination, source, count);
+            lcd_oam_written();
+        }
+
+        dma.bytes = (uint8_t) due;
+    }
+
+    if (dma.bytes == DMA_OAM_BYTES) {
+        dma.active = false;
+    }
+}
+
+/* Called by the PPU engines when a visible line enters HBlank */
+void dma_hblank()
+{
+    if (!dma.hdma_active) {
+        return;
+    }
+
+    hdma_block();
+
+    if (!dma.hdma_blocks) {
+        dma.hdma_active = false;
+    }
+}
@@ -1,3 +1,190 @@
 #include "emulator.h"
 
-emulator_t emulator;
\ No newline at end of file
+emulator_t emulator;
+
+/* Puts every component back into its power-on state, the loaded ROM is kept */
+void emulator_reset()
+{
+    cpu_init();
+    mmu_init();
+    lcd_init();
+    input_init();
+    serial_init();
+    dma_init();
+    sound_init();
+    video_init();
+
+    memset(&timer, 0x00, sizeof(timer_regs_t));
+
+    if (emulator.rom) {
+        memcpy(mmu.rom, emulator.rom, (emulator.rom_size > 0x8000) ? 0x8000 : emulator.rom_size);
+    }
+
+    // Without a ROM everything reads as open bus
+    mbc_init();
+
+    emulator.last_cycles = 0;
+    emulator.total_cycles = 0;
+}
+
+/* LCD cycles until its next event in CPU cycles, twice as many in double speed */
+static inline uint32_t lcd_next_cpu_event()
+{
+    uint32_t next = lcd_next_event();
+
+    return (next == UINT32_MAX) ? next : next << cpu.double_speed;
+}
+
+/* A halted CPU only wakes up on an interrupt, none can come before the next timer, LCD or serial event */
+static uint32_t halt_cycles()
+{
+    uint32_t cycles = EMULATOR_HALT_MAX;
+    uint32_t next = timer_cycles_to_overflow();
+
+    if (next < cycles) {
+        cycles = next;
+    }
+
+    next = lcd_next_cpu_event();
+
+    if (next < cycles) {
+        cycles = next;
+    }
+
+    if (serial.bits && serial.cycles < cycles) {
+        cycles = serial.cycles;
+    }
+
+    if (!cycles) {
+        cycles = 1;
+    }
+
+    // Whole LCD cycles in double speed, a wake up one CPU cycle late doesn't matter
+    if (cpu.double_speed) {
+        cycles = (cycles + 1) & ~1u;
+    }
+
+    return cycles;
+}
+
+/*
+    Executes one instruction and lets the other components catch up. Timer,
+    serial and OAM DMA run on the CPU clock, the LCD and sound don't speed
+    up in CGB double speed mode. Returns the LCD cycles that passed.
+*/
+uint32_t emulator_step()
+{
+    // Stops before the instruction, interrupts are not served either
+    if ((debug_pages[cpu.regs.pc >> 8] & DEBUG_BREAK) && !cpu.halted && debug_check_break(cpu.regs.pc)) {
+        return 0;
+    }
+
+    if (dma.stall) {
+        // HDMA holds the CPU, the PPU still has to reach the next HBlank in time
+        uint32_t cycles = lcd_next_cpu_event();
+
+        if (cycles > dma.stall) {
+            cycles = dma.stall;
+        }
+
+        cpu.cycles += cycles;
+        dma.stall -= cycles;
+    } else if (cpu.halted && !cpu.stopped && !(cpu.pending && cpu.ime)) {
+        cpu.cycles += halt_cycles();
+    } else {
+        cpu_step();
+    }
+
+    uint32_t cpu_cycles = cpu.cycles - emulator.last_cycles;
+
+    if (dma.active) {
+        dma_step(cpu_cycles);
+    }
+
+    timer_tick(cpu_cycles);
+
+    if (serial.bits) {
+        serial_step(cpu_cycles);
+    }
+
+    // Instructions and halts take an even number of CPU cycles, nothing is lost in double speed
+    uint32_t cycles = cpu_cycles >> cpu.double_speed;
+
+    lcd_step(cycles);
+    sound_step(cycles);
+
+    emulator.last_cycles = cpu.cycles;
+    emulator.total_cycles += cycles;
+
+    return cycles;
+}
+
+/* Runs as fast as possible, used for headless runs */
+void emulator_run_frames(uint32_t frames)
+{
+    uint64_t cycles = (uint64_t) frames * CYCLES_PER_FRAME;
+
+    while (cycles > 0 && !cpu.stopped && !debugger.hit) {
+        uint32_t elapsed = emulator_step();
+        cycles -= (elapsed < cycles) ? elapsed : cycles;
+    }
+}
+
+/* Emulator thread, paced to real time without touching the GPU */
+int emulator_run(void *data)
+{
+    (void) data;
+
+    uint64_t frequency = SDL_GetPerformanceFrequency();
+    uint64_t frame_length = frequency * CYCLES_PER_FRAME / CYCLES_PER_SECOND;
+    uint64_t deadline = SDL_GetPerformanceCounter() + frame_length;
+
+    uint32_t frame_cycles = 0;
+
+    zone_thread("emulator");
+
+    while (SDL_AtomicGet(&emulator.running)) {
+        // Checked first so a stopped CPU can still be inspected
+        if (SDL_AtomicGet(&debugger.paused)) {
+            debug_update();
+            SDL_Delay(1);
+            continue;
+        }
+
+        if (cpu.stopped) {
+            SDL_Delay(1);
+            continue;
+        }
+
+        debug_resume();
+
+        {
+            ZONE("emulate_frame");
+
+            while (frame_cycles < CYCLES_PER_FRAME && !cpu.stopped && !debugger.hit) {
+                frame_cycles += emulator_step();
+            }
+        }
+
+        if (frame_cycles < CYCLES_PER_FRAME) {
+            continue;
+        }
+
+        frame_cycles -= CYCLES_PER_FRAME;
+
+        ZONE("pace");
+
+        uint64_t now = SDL_GetPerformanceCounter();
+
+        if (now < deadline) {
+            SDL_Delay((uint32_t) ((deadline - now) * 1000 / frequency));
+        } else if (now - deadline > frame_length * 4) {
+            // Too far behind (e.g. after a stall), don't try to catch up
+            deadline = now;
+        }
+
+        deadline += frame_length;
+    }
+
+    return 0;
+}
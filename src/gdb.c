@@ -0,0 +1,699 @@
+#include "emulator.h"
+
+// Needs BSD sockets and poll, on Windows --gdb only reports that it's unavailable
+#ifndef _WIN32
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+typedef enum gdb_parse_state_t {
+    GDB_STATE_IDLE,
+    GDB_STATE_DATA,
+    GDB_STATE_CHECKSUM_HIGH,
+    GDB_STATE_CHECKSUM_LOW
+} gdb_parse_state_t;
+
+/* Remote serial protocol server, one debugger at a time on its own thread */
+typedef struct gdb_t {
+    int server;
+    int client;
+    char unix_path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+
+    SDL_Thread *thread;
+    SDL_atomic_t quit;
+
+    bool connected;
+    bool no_ack;
+
+    // Continued, the stop reply is sent once the emulator thread parks again
+    bool running;
+    int signal;
+
+    gdb_parse_state_t state;
+    char packet[GDB_PACKET_SIZE];
+    int packet_size;
+    uint8_t checksum;
+    uint8_t received_checksum;
+
+    char reply[GDB_PACKET_SIZE];
+} gdb_t;
+
+static gdb_t gdb;
+
+#define GDB_SIGINT 2
+#define GDB_SIGTRAP 5
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+static uint32_t parse_hex(const char **p)
+{
+    uint32_t value = 0;
+
+    while (hex_value(**p) >= 0) {
+        value = (value << 4) | hex_value(**p);
+        (*p)++;
+    }
+
+    return value;
+}
+
+static char* put_hex8(char *p, uint8_t value)
+{
+    *p++ = hex_digits[value >> 4];
+    *p++ = hex_digits[value & 0xF];
+
+    return p;
+}
+
+/* Target byte order, low byte first */
+static char* put_hex16(char *p, uint16_t value)
+{
+    p = put_hex8(p, value & 0xFF);
+    return put_hex8(p, value >> 8);
+}
+
+static uint16_t parse_hex16(const char **p)
+{
+    uint16_t value = 0;
+
+    for (int i=0; i < 2; i++) {
+        int high = hex_value((*p)[0]);
+        int low = hex_value((*p)[1]);
+
+        if (high < 0 || low < 0) {
+            break;
+        }
+
+        value |= ((high << 4) | low) << (i * 8);
+        *p += 2;
+    }
+
+    return value;
+}
+
+static void gdb_write(const char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t written = send(gdb.client, data, size, MSG_NOSIGNAL);
+
+        if (written <= 0) {
+            gdb.connected = false;
+            return;
+        }
+
+        data += written;
+        size -= written;
+    }
+}
+
+static void gdb_send(const char *data)
+{
+    static char frame[GDB_PACKET_SIZE + 4];
+    uint8_t checksum = 0;
+    size_t size = 0;
+
+    frame[size++] = '$';
+
+    for (const char *p = data; *p; p++) {
+        frame[size++] = *p;
+        checksum += *p;
+    }
+
+    frame[size++] = '#';
+    put_hex8(&frame[size], checksum);
+    size += 2;
+
+    gdb_write(frame, size);
+}
+
+static void gdb_send_stop()
+{
+    switch(debugger.hit_type) {
+        case DEBUG_WATCH_WRITE:
+            snprintf(gdb.reply, GDB_PACKET_SIZE, "T%02xwatch:%04x;", GDB_SIGTRAP, debugger.hit_addr);
+            break;
+        case DEBUG_WATCH_READ:
+            snprintf(gdb.reply, GDB_PACKET_SIZE, "T%02xrwatch:%04x;", GDB_SIGTRAP, debugger.hit_addr);
+            break;
+        case DEBUG_BREAK:
+            snprintf(gdb.reply, GDB_PACKET_SIZE, "S%02x", GDB_SIGTRAP);
+            break;
+        default:
+            snprintf(gdb.reply, GDB_PACKET_SIZE, "S%02x", gdb.signal);
+            break;
+    }
+
+    gdb_send(gdb.reply);
+}
+
+static uint16_t* gdb_register(uint32_t index)
+{
+    switch(index) {
+        case 0: return &cpu.regs.af;
+        case 1: return &cpu.regs.bc;
+        case 2: return &cpu.regs.de;
+        case 3: return &cpu.regs.hl;
+        case 4: return &cpu.regs.sp;
+        case 5: return &cpu.regs.pc;
+        default: return NULL;
+    }
+}
+
+static void gdb_read_registers()
+{
+    char *p = gdb.reply;
+
+    for (int i=0; i < GDB_REGISTER_COUNT; i++) {
+        uint16_t *reg = gdb_register(i);
+        p = put_hex16(p, reg ? *reg : 0);
+    }
+
+    *p = '\0';
+    gdb_send(gdb.reply);
+}
+
+static void gdb_write_registers(const char *p)
+{
+    for (int i=0; i < GDB_REGISTER_COUNT && *p; i++) {
+        uint16_t value = parse_hex16(&p);
+        uint16_t *reg = gdb_register(i);
+
+        if (reg) {
+            *reg = value;
+        }
+    }
+
+    gdb_send("OK");
+}
+
+/* p<n> */
+static void gdb_read_register(const char *p)
+{
+    uint16_t *reg = gdb_register(parse_hex(&p));
+
+    *put_hex16(gdb.reply, reg ? *reg : 0) = '\0';
+    gdb_send(gdb.reply);
+}
+
+/* P<n>=<value> */
+static void gdb_write_register(const char *p)
+{
+    uint16_t *reg = gdb_register(parse_hex(&p));
+
+    if (*p++ != '=') {
+        gdb_send("E01");
+        return;
+    }
+
+    uint16_t value = parse_hex16(&p);
+
+    if (reg) {
+        *reg = value;
+    }
+
+    gdb_send("OK");
+}
+
+/* m<addr>,<length> */
+static void gdb_read_memory(const char *p)
+{
+    uint16_t addr = parse_hex(&p);
+
+    if (*p++ != ',') {
+        gdb_send("E01");
+        return;
+    }
+
+    uint32_t length = parse_hex(&p);
+
+    if (length > (GDB_PACKET_SIZE - 1) / 2) {
+        length = (GDB_PACKET_SIZE - 1) / 2;
+    }
+
+    char *out = gdb.reply;
+
+    for (uint32_t i=0; i < length; i++) {
+        out = put_hex8(out, debug_peek(addr + i));
+    }
+
+    *out = '\0';
+    gdb_send(gdb.reply);
+}
+
+/* M<addr>,<length>:<bytes>, goes through the bus like a CPU write */
+static void gdb_write_memory(const char *p)
+{
+    uint16_t addr = parse_hex(&p);
+
+    if (*p++ != ',') {
+        gdb_send("E01");
+        return;
+    }
+
+    uint32_t length = parse_hex(&p);
+
+    if (*p++ != ':') {
+        gdb_send("E01");
+        return;
+    }
+
+    for (uint32_t i=0; i < length; i++) {
+        int high = hex_value(p[0]);
+        int low = hex_value(p[1]);
+
+        if (high < 0 || low < 0) {
+            gdb_send("E01");
+            return;
+        }
+
+        debug_poke(addr + i, (high << 4) | low);
+        p += 2;
+    }
+
+    gdb_send("OK");
+}
+
+/* Z<type>,<addr>,<kind> and z<type>,<addr>,<kind> */
+static void gdb_breakpoint(bool insert, const char *p)
+{
+    uint32_t type = parse_hex(&p);
+
+    if (*p++ != ',') {
+        gdb_send("E01");
+        return;
+    }
+
+    uint16_t addr = parse_hex(&p);
+
+    if (*p++ != ',') {
+        gdb_send("E01");
+        return;
+    }
+
+    uint32_t kind = parse_hex(&p);
+    uint16_t end = addr;
+    uint8_t point_type;
+
+    switch(type) {
+        case 0:
+        case 1:
+            point_type = DEBUG_BREAK;
+            break;
+        case 2:
+            point_type = DEBUG_WATCH_WRITE;
+            break;
+        case 3:
+            point_type = DEBUG_WATCH_READ;
+            break;
+        case 4:
+            point_type = DEBUG_WATCH_READ | DEBUG_WATCH_WRITE;
+            break;
+        default:
+            gdb_send("");
+            return;
+    }
+
+    // For watchpoints kind is the length in bytes
+    if (type >= 2 && kind > 1) {
+        end = (addr + kind - 1 > 0xFFFF) ? 0xFFFF : addr + kind - 1;
+    }
+
+    bool result = insert ? debug_add(point_type, addr, end, DEBUG_ANY_BANK) : debug_remove(point_type, addr, end);
+    gdb_send(result ? "OK" : "E01");
+}
+
+/* c[<addr>] */
+static void gdb_continue(const char *p)
+{
+    if (*p) {
+        cpu.regs.pc = parse_hex(&p);
+    }
+
+    gdb.signal = GDB_SIGINT;
+    gdb.running = true;
+
+    debug_continue();
+}
+
+/* s[<addr>] */
+static void gdb_single_step(const char *p)
+{
+    if (*p) {
+        cpu.regs.pc = parse_hex(&p);
+    }
+
+    debug_step();
+
+    while (SDL_AtomicGet(&debugger.step)) {
+        if (!SDL_AtomicGet(&emulator.running)) {
+            return;
+        }
+
+        SDL_Delay(0);
+    }
+
+    gdb.signal = GDB_SIGTRAP;
+    gdb_send_stop();
+}
+
+static void gdb_query(const char *packet)
+{
+    if (strncmp(packet, "qSupported", 10) == 0) {
+        snprintf(gdb.reply, GDB_PACKET_SIZE, "PacketSize=%x;QStartNoAckMode+", GDB_PACKET_SIZE - 1);
+        gdb_send(gdb.reply);
+    } else if (strcmp(packet, "qAttached") == 0) {
+        gdb_send("1");
+    } else if (strcmp(packet, "qC") == 0) {
+        gdb_send("QC1");
+    } else if (strcmp(packet, "qfThreadInfo") == 0) {
+        gdb_send("m1");
+    } else if (strcmp(packet, "qsThreadInfo") == 0) {
+        gdb_send("l");
+    } else {
+        gdb_send("");
+    }
+}
+
+static void gdb_handle(const char *packet)
+{
+    const char *args = packet + 1;
+
+    // Only queries and detaching are safe while the emulator thread runs, gdb sends nothing else before a stop
+    if (SDL_AtomicGet(&debugger.paused) != DEBUG_PARKED && !strchr("qQHDk", packet[0])) {
+        gdb_send("E01");
+        return;
+    }
+
+    switch(packet[0]) {
+        case '?':
+            gdb_send_stop();
+            break;
+        case 'g':
+            gdb_read_registers();
+            break;
+        case 'G':
+            gdb_write_registers(args);
+            break;
+        case 'p':
+            gdb_read_register(args);
+            break;
+        case 'P':
+            gdb_write_register(args);
+            break;
+        case 'm':
+            gdb_read_memory(args);
+            break;
+        case 'M':
+            gdb_write_memory(args);
+            break;
+        case 'Z':
+            gdb_breakpoint(true, args);
+            break;
+        case 'z':
+            gdb_breakpoint(false, args);
+            break;
+        case 'c':
+            gdb_continue(args);
+            break;
+        case 's':
+            gdb_single_step(args);
+            break;
+        case 'H':
+            gdb_send("OK");
+            break;
+        case 'q':
+            gdb_query(packet);
+            break;
+        case 'Q':
+            if (strcmp(packet, "QStartNoAckMode") == 0) {
+                gdb_send("OK");
+                gdb.no_ack = true;
+            } else {
+                gdb_send("");
+            }
+            break;
+        case 'D':
+            gdb_send("OK");
+            gdb.connected = false;
+            break;
+        case 'k':
+            SDL_AtomicSet(&emulator.running, 0);
+            gdb.connected = false;
+            break;
+        default:
+            // Empty reply, unsupported
+            gdb_send("");
+            break;
+    }
+}
+
+static void gdb_interrupt()
+{
+    if (gdb.running) {
+        gdb.signal = GDB_SIGINT;
+        debug_pause();
+    }
+}
+
+/* Feeds received bytes through the packet parser */
+static void gdb_receive(const uint8_t *data, int size)
+{
+    for (int i=0; i < size && gdb.connected; i++) {
+        uint8_t c = data[i];
+
+        switch(gdb.state) {
+            case GDB_STATE_IDLE:
+                // Acks are ignored, nothing is ever resent
+                if (c == '$') {
+                    gdb.packet_size = 0;
+                    gdb.checksum = 0;
+                    gdb.state = GDB_STATE_DATA;
+                } else if (c == 0x03) {
+                    gdb_interrupt();
+                }
+                break;
+
+            case GDB_STATE_DATA:
+                if (c == '#') {
+                    gdb.state = GDB_STATE_CHECKSUM_HIGH;
+                } else {
+                    if (gdb.packet_size < GDB_PACKET_SIZE - 1) {
+                        gdb.packet[gdb.packet_size++] = c;
+                    }
+
+                    gdb.checksum += c;
+                }
+                break;
+
+            case GDB_STATE_CHECKSUM_HIGH:
+                gdb.received_checksum = hex_value(c) << 4;
+                gdb.state = GDB_STATE_CHECKSUM_LOW;
+                break;
+
+            case GDB_STATE_CHECKSUM_LOW:
+                gdb.received_checksum |= hex_value(c) & 0xF;
+                gdb.packet[gdb.packet_size] = '\0';
+                gdb.state = GDB_STATE_IDLE;
+
+                if (gdb.no_ack) {
+                    gdb_handle(gdb.packet);
+                } else if (gdb.received_checksum != gdb.checksum) {
+                    gdb_write("-", 1);
+                } else {
+                    gdb_write("+", 1);
+                    gdb_handle(gdb.packet);
+                }
+                break;
+        }
+    }
+}
+
+static void gdb_session()
+{
+    int one = 1;
+    setsockopt(gdb.client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    gdb.connected = true;
+    gdb.no_ack = false;
+    gdb.running = false;
+    gdb.signal = GDB_SIGTRAP;
+    gdb.state = GDB_STATE_IDLE;
+
+    printf("[gdb] Debugger connected\n");
+
+    debug_pause();
+
+    if (!debug_wait_parked()) {
+        return;
+    }
+
+    while (gdb.connected && !SDL_AtomicGet(&gdb.quit)) {
+        if (gdb.running && SDL_AtomicGet(&debugger.paused) == DEBUG_PARKED) {
+            gdb.running = false;
+            gdb_send_stop();
+        }
+
+        struct pollfd pfd = { gdb.client, POLLIN, 0 };
+
+        if (poll(&pfd, 1, gdb.running ? 10 : 100) <= 0) {
+            continue;
+        }
+
+        uint8_t buffer[1024];
+        ssize_t size = recv(gdb.client, buffer, sizeof(buffer), 0);
+
+        if (size <= 0) {
+            break;
+        }
+
+        gdb_receive(buffer, (int) size);
+    }
+
+    // Detached or gone, let the game run on
+    debug_continue();
+
+    printf("[gdb] Debugger disconnected\n");
+}
+
+static int gdb_run(void *data)
+{
+    (void) data;
+
+    zone_thread("gdb");
+
+    while (!SDL_AtomicGet(&gdb.quit)) {
+        struct pollfd pfd = { gdb.server, POLLIN, 0 };
+
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+
+        gdb.client = accept(gdb.server, NULL, NULL);
+
+        if (gdb.client < 0) {
+            continue;
+        }
+
+        gdb_session();
+
+        close(gdb.client);
+        gdb.client = -1;
+    }
+
+    return 0;
+}
+
+/* A port number listens on localhost only, anything else is the path of a UNIX socket */
+bool gdb_start(const char *address)
+{
+    memset(&gdb, 0x00, sizeof(gdb_t));
+    gdb.client = -1;
+
+    char *end;
+    unsigned long port = strtoul(address, &end, 10);
+
+    if (*end == '\0' && port > 0 && port <= 0xFFFF) {
+        struct sockaddr_in addr;
+        memset(&addr, 0x00, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t) port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        int one = 1;
+        gdb.server = socket(AF_INET, SOCK_STREAM, 0);
+        setsockopt(gdb.server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        if (gdb.server < 0 || bind(gdb.server, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+            printf("[gdb] Unable to listen on port %lu\n", port);
+            exit(-1);
+        }
+    } else {
+        struct sockaddr_un addr;
+        memset(&addr, 0x00, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+
+        if (strlen(address) >= sizeof(addr.sun_path)) {
+            printf("[gdb] Socket path too long: %s\n", address);
+            exit(-1);
+        }
+
+        strcpy(addr.sun_path, address);
+        strcpy(gdb.unix_path, address);
+        unlink(address);
+
+        gdb.server = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if (gdb.server < 0 || bind(gdb.server, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+            printf("[gdb] Unable to listen on %s\n", address);
+            exit(-1);
+        }
+    }
+
+    if (listen(gdb.server, 1) != 0) {
+        printf("[gdb] Unable to listen on %s\n", address);
+        exit(-1);
+    }
+
+    // Nothing runs until the debugger continues
+    debug_pause();
+
+    gdb.thread = SDL_CreateThread(gdb_run, "gdb", NULL);
+
+    if (!gdb.thread) {
+        printf("[gdb] Unable to start server thread!\n");
+        exit(-1);
+    }
+
+    printf("[gdb] Waiting for a debugger on %s\n", address);
+
+    return true;
+}
+
+void gdb_stop()
+{
+    if (!gdb.thread) {
+        return;
+    }
+
+    SDL_AtomicSet(&gdb.quit, 1);
+    SDL_WaitThread(gdb.thread, NULL);
+    gdb.thread = NULL;
+
+    close(gdb.server);
+
+    if (gdb.unix_path[0]) {
+        unlink(gdb.unix_path);
+    }
+}
+
+#else
+
+bool gdb_start(const char *address)
+{
+    printf("[gdb] Not supported on Windows, unable to listen on %s\n", address);
+    exit(-1);
+}
+
+void gdb_stop()
+{
+}
+
+#endif
@@ -0,0 +1,344 @@
+#include "inflate.h"
+
+#include <string.h>
+#include <stdbool.h>
+
+#define INFLATE_MAX_BITS 15
+#define INFLATE_MAX_CODES 288
+
+typedef struct inflate_t {
+    const uint8_t *in;
+    size_t in_size;
+    size_t in_pos;
+
+    uint8_t *out;
+    size_t out_size;
+    size_t out_pos;
+
+    uint32_t bit_buffer;
+    int bit_count;
+
+    bool error;     // Ran out of input or output, or a code is invalid
+} inflate_t;
+
+/* Code lengths per symbol turned into counts per length and symbols in code order */
+typedef struct huffman_t {
+    uint16_t count[INFLATE_MAX_BITS + 1];
+    uint16_t symbol[INFLATE_MAX_CODES];
+} huffman_t;
+
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const uint16_t distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static const uint8_t distance_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+/* Order in which dynamic blocks send the code length code lengths */
+static const uint8_t length_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+static uint32_t bits(inflate_t *s, int count)
+{
+    while (s->bit_count < count) {
+        if (s->in_pos == s->in_size) {
+            s->error = true;
+            return 0;
+        }
+
+        s->bit_buffer |= (uint32_t) s->in[s->in_pos++] << s->bit_count;
+        s->bit_count += 8;
+    }
+
+    uint32_t value = s->bit_buffer & ((1u << count) - 1);
+
+    s->bit_buffer >>= count;
+    s->bit_count -= count;
+
+    return value;
+}
+
+/* Over-subscribed sets of lengths can't be decoded, incomplete ones only fail if a missing code shows up */
+static bool build(huffman_t *h, const uint8_t *lengths, int count)
+{
+    uint16_t offsets[INFLATE_MAX_BITS + 1];
+
+    memset(h->count, 0, sizeof(h->count));
+
+    for (int i=0; i < count; i++) {
+        h->count[lengths[i]]++;
+    }
+
+    int left = 1;
+
+    for (int length=1; length <= INFLATE_MAX_BITS; length++) {
+        left = (left << 1) - h->count[length];
+
+        if (left < 0) {
+            return false;
+        }
+    }
+
+    offsets[1] = 0;
+
+    for (int length=1; length < INFLATE_MAX_BITS; length++) {
+        offsets[length + 1] = offsets[length] + h->count[length];
+    }
+
+    for (int i=0; i < count; i++) {
+        if (lengths[i]) {
+            h->symbol[offsets[lengths[i]]++] = i;
+        }
+    }
+
+    return true;
+}
+
+static int decode(inflate_t *s, const huffman_t *h)
+{
+    int code = 0;
+    int first = 0;
+    int index = 0;
+
+    for (int length=1; length <= INFLATE_MAX_BITS; length++) {
+        code |= bits(s, 1);
+
+        int count = h->count[length];
+
+        if (code - count < first) {
+            return h->symbol[index + (code - first)];
+        }
+
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+
+    s->error = true;
+    return -1;
+}
+
+static void stored(inflate_t *s)
+{
+    // Starts at the next byte
+    s->bit_buffer = 0;
+    s->bit_count = 0;
+
+    if (s->in_size - s->in_pos < 4) {
+        s->error = true;
+        return;
+    }
+
+    const uint8_t *p = &s->in[s->in_pos];
+    size_t length = p[0] | p[1] << 8;
+
+    if ((size_t) (p[2] | p[3] << 8) != (~length & 0xFFFF) || s->in_size - s->in_pos - 4 < length || s->out_size - s->out_pos < length) {
+        s->error = true;
+        return;
+    }
+
+    memcpy(&s->out[s->out_pos], &p[4], length);
+    s->in_pos += 4 + length;
+    s->out_pos += length;
+}
+
+static void codes(inflate_t *s, const huffman_t *lengths, const huffman_t *distances)
+{
+    while (!s->error) {
+        int symbol = decode(s, lengths);
+
+        if (symbol < 256) {
+            if (s->out_pos == s->out_size) {
+                s->error = true;
+                return;
+            }
+
+            s->out[s->out_pos++] = (uint8_t) symbol;
+            continue;
+        }
+
+        if (symbol == 256) {
+            return;
+        }
+
+        symbol -= 257;
+
+        if (symbol >= 29) {
+            s->error = true;
+            return;
+        }
+
+        size_t length = length_base[symbol] + bits(s, length_extra[symbol]);
+        int code = decode(s, distances);
+
+        if (code < 0 || code >= 30) {
+            s->error = true;
+            return;
+        }
+
+        size_t distance = distance_base[code] + bits(s, distance_extra[code]);
+
+        if (s->error || distance > s->out_pos || s->out_size - s->out_pos < length) {
+            s->error = true;
+            return;
+        }
+
+        // Overlapping copies repeat the last bytes, so no memcpy
+        for (size_t i=0; i < length; i++) {
+            s->out[s->out_pos] = s->out[s->out_pos - distance];
+            s->out_pos++;
+        }
+    }
+}
+
+static void fixed(inflate_t *s)
+{
+    static huffman_t lengths;
+    static huffman_t distances;
+    static bool built = false;
+
+    if (!built) {
+        uint8_t code_lengths[INFLATE_MAX_CODES];
+
+        memset(&code_lengths[0], 8, 144);
+        memset(&code_lengths[144], 9, 112);
+        memset(&code_lengths[256], 7, 24);
+        memset(&code_lengths[280], 8, 8);
+        build(&lengths, code_lengths, 288);
+
+        memset(code_lengths, 5, 30);
+        build(&distances, code_lengths, 30);
+
+        built = true;
+    }
+
+    codes(s, &lengths, &distances);
+}
+
+static void dynamic(inflate_t *s)
+{
+    huffman_t lengths;
+    huffman_t distances;
+    uint8_t code_lengths[INFLATE_MAX_CODES + 32];
+
+    int literal_count = bits(s, 5) + 257;
+    int distance_count = bits(s, 5) + 1;
+    int length_count = bits(s, 4) + 4;
+
+    if (literal_count > 286 || distance_count > 30) {
+        s->error = true;
+        return;
+    }
+
+    memset(code_lengths, 0, 19);
+
+    for (int i=0; i < length_count; i++) {
+        code_lengths[length_order[i]] = (uint8_t) bits(s, 3);
+    }
+
+    if (s->error || !build(&lengths, code_lengths, 19)) {
+        s->error = true;
+        return;
+    }
+
+    // Literal/length and distance lengths are one sequence, repeats can cross from one into the other
+    int total = literal_count + distance_count;
+    int index = 0;
+
+    while (index < total && !s->error) {
+        int symbol = decode(s, &lengths);
+        int repeat;
+        uint8_t length = 0;
+
+        if (symbol < 0) {
+            return;
+        }
+
+        if (symbol < 16) {
+            code_lengths[index++] = (uint8_t) symbol;
+            continue;
+        }
+
+        if (symbol == 16) {
+            if (index == 0) {
+                s->error = true;
+                return;
+            }
+
+            length = code_lengths[index - 1];
+            repeat = 3 + bits(s, 2);
+        } else if (symbol == 17) {
+            repeat = 3 + bits(s, 3);
+        } else {
+            repeat = 11 + bits(s, 7);
+        }
+
+        if (index + repeat > total) {
+            s->error = true;
+            return;
+        }
+
+        while (repeat--) {
+            code_lengths[index++] = length;
+        }
+    }
+
+    // Without an end of block code nothing could be decoded
+    if (s->error || code_lengths[256] == 0 || !build(&lengths, code_lengths, literal_count) || !build(&distances, &code_lengths[literal_count], distance_count)) {
+        s->error = true;
+        return;
+    }
+
+    codes(s, &lengths, &distances);
+}
+
+/* Returns the bytes written to out, or -1 if the stream is corrupt or doesn't fit */
+long inflate_raw(const uint8_t *in, size_t in_size, uint8_t *out, size_t out_size)
+{
+    inflate_t s = {
+        .in = in,
+        .in_size = in_size,
+        .out = out,
+        .out_size = out_size
+    };
+
+    bool last = false;
+
+    while (!last && !s.error) {
+        last = bits(&s, 1);
+
+        switch (bits(&s, 2)) {
+            case 0:
+                stored(&s);
+                break;
+
+            case 1:
+                fixed(&s);
+                break;
+
+            case 2:
+                dynamic(&s);
+                break;
+
+            default:
+                s.error = true;
+                break;
+        }
+    }
+
+    return s.error ? -1 : (long) s.out_pos;
+}
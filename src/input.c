@@ -1,32 +1,41 @@
 #include "emulator.h"
 
 #ifdef INPUT_DEBUG
-#define DEBUG_INPUT(...) printf("[input] "); printf(__VA_ARGS__)
+#define DEBUG_INPUT(...) LOG(LOG_INPUT, LOG_LEVEL_DEBUG, __VA_ARGS__)
 #endif
 
 input_t input;
 
 void input_init()
 {
-    
+    input.state.value = 0;
+    input.direction = false;
+    input.action = false;
+    SDL_AtomicSet(&input.pressed, 0);
 }
 
 uint8_t input_read()
 {
     uint8_t result = 0x3F;
 
+    input.state.value = (uint8_t) SDL_AtomicGet(&input.pressed);
+
+    if (movie.mode != MOVIE_OFF) {
+        input.state.value = movie_input(input.state.value);
+    }
+
     if (input.direction) {
-        if (input.state.right) result &= ~(1 << 0);
-        if (input.state.left) result &= ~(1 << 1);
-        if (input.state.up) result &= ~(1 << 2);
-        if (input.state.down) result &= ~(1 << 3);
+        if (input.state.fields.right) result &= ~(1 << 0);
+        if (input.state.fields.left) result &= ~(1 << 1);
+        if (input.state.fields.up) result &= ~(1 << 2);
+        if (input.state.fields.down) result &= ~(1 << 3);
     }
 
     if (input.action) {
-        if (input.state.a) result &= ~(1 << 0);
-        if (input.state.b) result &= ~(1 << 1);
-        if (input.state.select) result &= ~(1 << 2);
-        if (input.state.start) result &= ~(1 << 3);
+        if (input.state.fields.a) result &= ~(1 << 0);
+        if (input.state.fields.b) result &= ~(1 << 1);
+        if (input.state.fields.select) result &= ~(1 << 2);
+        if (input.state.fields.start) result &= ~(1 << 3);
     }
 
     if (input.direction) result &= ~(1 << 4);
@@ -36,17 +45,17 @@ uint8_t input_read()
     DEBUG_INPUT("Read: %x\n", result);
 
     if (input.direction) {
-        DEBUG_INPUT(" Right:  %s\n", input.state.right ? "Pressed" : "Released");
-        DEBUG_INPUT(" Left:   %s\n", input.state.left ? "Pressed" : "Released");
-        DEBUG_INPUT(" Up:     %s\n", input.state.up ? "Pressed" : "Released");
-        DEBUG_INPUT(" Down:   %s\n", input.state.down ? "Pressed" : "Released");
+        DEBUG_INPUT(" Right:  %s\n", input.state.fields.right ? "Pressed" : "Released");
+        DEBUG_INPUT(" Left:   %s\n", input.state.fields.left ? "Pressed" : "Released");
+        DEBUG_INPUT(" Up:     %s\n", input.state.fields.up ? "Pressed" : "Released");
+        DEBUG_INPUT(" Down:   %s\n", input.state.fields.down ? "Pressed" : "Released");
     }
 
     if (input.action) {
-        DEBUG_INPUT(" A:      %s\n", input.state.a ? "Pressed" : "Released");
-        DEBUG_INPUT(" B:      %s\n", input.state.b ? "Pressed" : "Released");
-        DEBUG_INPUT(" Select: %s\n", input.state.select ? "Pressed" : "Released");
-        DEBUG_INPUT(" Start:  %s\n", input.state.start ? "Pressed" : "Released");
+        DEBUG_INPUT(" A:      %s\n", input.state.fields.a ? "Pressed" : "Released");
+        DEBUG_INPUT(" B:      %s\n", input.state.fields.b ? "Pressed" : "Released");
+        DEBUG_INPUT(" Select: %s\n", input.state.fields.select ? "Pressed" : "Released");
+        DEBUG_INPUT(" Start:  %s\n", input.state.fields.start ? "Pressed" : "Released");
     }
 
     #endif
@@ -80,42 +89,53 @@ void input_handle(SDL_KeyboardEvent *event)
     DEBUG_INPUT("Event Key: %s State: %s\n", SDL_GetKeyName(event->keysym.sym), release ? "Release" : "Press");
     #endif
 
+    input_state_t key;
+    key.value = 0;
+
     switch(event->keysym.scancode) {
         case SDL_SCANCODE_A:
-            input.state.a = !release;
+            key.fields.a = 1;
             break;
         
         case SDL_SCANCODE_B:
-            input.state.b = !release;
+            key.fields.b = 1;
             break;
 
         case SDL_SCANCODE_LSHIFT:
-            input.state.select = !release;
+            key.fields.select = 1;
             break;
 
         case SDL_SCANCODE_RETURN:
-            input.state.start = !release;
+            key.fields.start = 1;
             break;
 
         case SDL_SCANCODE_RIGHT:
-            input.state.right = !release;
+            key.fields.right = 1;
             break;
 
         case SDL_SCANCODE_LEFT:
-            input.state.left = !release;
+            key.fields.left = 1;
             break;
 
         case SDL_SCANCODE_UP:
-            input.state.up = !release;
+            key.fields.up = 1;
             break;
 
         case SDL_SCANCODE_DOWN:
-            input.state.down = !release;
+            key.fields.down = 1;
             break;
 
         default:
             break;            
     }
 
+    int pressed;
+    int updated;
+
+    do {
+        pressed = SDL_AtomicGet(&input.pressed);
+        updated = release ? (pressed & ~key.value) : (pressed | key.value);
+    } while (!SDL_AtomicCAS(&input.pressed, pressed, updated));
+
     //cpu_request_interrupt(CPU_IF_JOYPAD);
 }
\ No newline at end of file
@@ -3,7 +3,7 @@
 lcd_t lcd;
 
 #ifdef LCD_DEBUG
-#define DEBUG_LCD(...) printf("[lcd] "); printf(__VA_ARGS__)
+#define DEBUG_LCD(...) LOG(LOG_LCD, LOG_LEVEL_DEBUG, __VA_ARGS__)
 #endif
 
 const char *color_names[4] = {
@@ -13,24 +13,118 @@ const char *color_names[4] = {
     "Black"
 };
 
+/* The DMG shades as 15 bit colors */
+const uint16_t lcd_dmg_colors[4] = {
+    0x7FFF, // White
+    0x4A52, // Light Gray
+    0x1CE7, // Dark Gray
+    0x0000  // Black
+};
+
+const lcd_engine_t *lcd_engines[LCD_ENGINE_COUNT] = {
+    &lcd_scanline_engine,
+    &lcd_fifo_engine
+};
+
+static void set_palette(uint16_t *colors, uint8_t value)
+{
+    for (int i=0; i < 4; i++) {
+        colors[i] = lcd_dmg_colors[(value >> (i * 2)) & 3];
+    }
+}
+
+/* Updates the color of the palette RAM entry a byte at index belongs to */
+static void set_cgb_color(uint16_t colors[8][4], const uint8_t *palette_ram, uint8_t index)
+{
+    index &= 0x3E;
+    colors[index >> 3][(index >> 1) & 3] = (palette_ram[index] | (palette_ram[index + 1] << 8)) & 0x7FFF;
+}
+
 void lcd_init()
 {
+    if (!lcd.engine) {
+        lcd.engine = &lcd_scanline_engine;
+    }
+
     lcd.cycles = 0;
     lcd.regs.status.fields.mode = 1;
+
+    // The CGB boot ROM leaves every palette white
+    memset(lcd.bg_palette_ram, 0xFF, sizeof(lcd.bg_palette_ram));
+    memset(lcd.obj_palette_ram, 0xFF, sizeof(lcd.obj_palette_ram));
+    lcd.bg_palette_index = 0;
+    lcd.obj_palette_index = 0;
+
+    for (int i=0; i < 64; i += 2) {
+        set_cgb_color(lcd.bg_colors, lcd.bg_palette_ram, i);
+        set_cgb_color(lcd.obj_colors, lcd.obj_palette_ram, i);
+    }
+
+    if (!emulator.rom_info.cgb) {
+        set_palette(lcd.bg_colors[0], lcd.regs.bgp);
+        set_palette(lcd.obj_colors[0], lcd.regs.obp0);
+        set_palette(lcd.obj_colors[1], lcd.regs.obp1);
+    }
+
+    lcd.dirty.palettes = true;
+
+    // Lines that are never drawn stay white like a blank DMG screen
+    for (int i=0; i < LCD_WIDTH * LCD_HEIGHT; i++) {
+        lcd.color_buffer[i] = lcd_dmg_colors[0];
+        lcd.bg_buffer[i] = lcd_dmg_colors[0];
+    }
+
+    memset(lcd.bg_index, 0x00, sizeof(lcd.bg_index));
+
+    lcd.engine->reset();
+}
+
+bool lcd_select_engine(const char *name)
+{
+    for (int i=0; i < LCD_ENGINE_COUNT; i++) {
+        if (strcmp(lcd_engines[i]->name, name) == 0) {
+            lcd.engine = lcd_engines[i];
+            lcd.engine->reset();
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* BCPD/OCPD, the index in BCPS/OCPS can advance after each write */
+static void write_cgb_palette(uint16_t colors[8][4], uint8_t *palette_ram, uint8_t *index, uint8_t data)
+{
+    palette_ram[*index & 0x3F] = data;
+    set_cgb_color(colors, palette_ram, *index);
+    lcd.dirty.palettes = true;
+
+    if (*index & LCD_PALETTE_AUTO_INCREMENT) {
+        *index = LCD_PALETTE_AUTO_INCREMENT | ((*index + 1) & 0x3F);
+    }
 }
 
 void lcd_wb(uint8_t addr, uint8_t data)
 {
     switch(addr) {
         // Control
-        case 0x40:
-            lcd.regs.control.value =  data;
+        case 0x40: {
+            bool toggled = (lcd.regs.control.value ^ data) & LCD_CONTROL_LCD_ENABLE;
+
+            // The engine resets against the new value
+            lcd.regs.control.value = data;
+
+            if (toggled) {
+                lcd.engine->reset();
+            }
 
             #ifdef LCD_DEBUG
             DEBUG_LCD("-> Control: %x\n", data);
             #endif
 
             break;
+        }
         
         // Status
         case 0x41:
@@ -76,48 +170,101 @@ void lcd_wb(uint8_t addr, uint8_t data)
 
             break;
 
-        // DMA
-        case 0x46:
-            if (data > 0xDF) {
-                return;
+        // BGP
+        case 0x47:
+            lcd.regs.bgp = data;
+
+            // Only the CGB palette RAM counts in CGB mode
+            if (!emulator.rom_info.cgb) {
+                set_palette(lcd.bg_colors[0], data);
             }
 
-            uint16_t source = data * 0x100;
-            uint16_t destination = 0xFE00;
+            #ifdef LCD_DEBUG
+            DEBUG_LCD("-> BGP: %x\n", data);
+
+            DEBUG_LCD("Palette:\n");
+            DEBUG_LCD(" - 0 %s\n", color_names[data & 3]);
+            DEBUG_LCD(" - 1 %s\n", color_names[(data >> 2) & 3]);
+            DEBUG_LCD(" - 2 %s\n", color_names[(data >> 4) & 3]);
+            DEBUG_LCD(" - 3 %s\n", color_names[(data >> 6) & 3]);
 
-            // Transfer
-            for (int i=0; i < 0x9F; i++) {
-                mmu_wb(destination + i, mmu_rb(source + i));
-            }
+            #endif
 
-            cpu.cycles += 160;
+            break;
+
+        // OBP0
+        case 0x48:
+            lcd.regs.obp0 = data;
+
+            if (!emulator.rom_info.cgb) {
+                set_palette(lcd.obj_colors[0], data);
+            }
 
             #ifdef LCD_DEBUG
-            DEBUG_LCD("-> DMA: %x\n", data);
-            DEBUG_LCD("DMA transfer\n Source: %04X\n Destination: FE00\n", source);
+            DEBUG_LCD("-> OBP0: %x\n", data);
             #endif
 
             break;
 
-        // BGP
-        case 0x47:
-            lcd.regs.bgp = data;
+        // OBP1
+        case 0x49:
+            lcd.regs.obp1 = data;
 
-            lcd.palette[0] = lcd.regs.bgp & 3;
-            lcd.palette[1] = (lcd.regs.bgp >> 2) & 3;
-            lcd.palette[2] = (lcd.regs.bgp >> 4) & 3;
-            lcd.palette[3] = (lcd.regs.bgp >> 6) & 3;
+            if (!emulator.rom_info.cgb) {
+                set_palette(lcd.obj_colors[1], data);
+            }
 
             #ifdef LCD_DEBUG
-            DEBUG_LCD("-> BGP: %x\n", data);
+            DEBUG_LCD("-> OBP1: %x\n", data);
+            #endif
 
-            DEBUG_LCD("Palette:\n");
-            DEBUG_LCD(" - 0 %s\n", color_names[lcd.palette[0]]);
-            DEBUG_LCD(" - 1 %s\n", color_names[lcd.palette[1]]);
-            DEBUG_LCD(" - 2 %s\n", color_names[lcd.palette[2]]);
-            DEBUG_LCD(" - 3 %s\n", color_names[lcd.palette[3]]);
+            break;
+
+        // WY
+        case 0x4A:
+            lcd.regs.wy = data;
+
+            #ifdef LCD_DEBUG
+            DEBUG_LCD("-> WY: %x\n", data);
+            #endif
+
+            break;
 
+        // WX
+        case 0x4B:
+            lcd.regs.wx = data;
+
+            #ifdef LCD_DEBUG
+            DEBUG_LCD("-> WX: %x\n", data);
             #endif
+
+            break;
+    }
+
+    if (!emulator.rom_info.cgb) {
+        return;
+    }
+
+    switch(addr) {
+        // BCPS
+        case 0x68:
+            lcd.bg_palette_index = data & (LCD_PALETTE_AUTO_INCREMENT | 0x3F);
+            break;
+
+        // BCPD
+        case 0x69:
+            write_cgb_palette(lcd.bg_colors, lcd.bg_palette_ram, &lcd.bg_palette_index, data);
+            break;
+
+        // OCPS
+        case 0x6A:
+            lcd.obj_palette_index = data & (LCD_PALETTE_AUTO_INCREMENT | 0x3F);
+            break;
+
+        // OCPD
+        case 0x6B:
+            write_cgb_palette(lcd.obj_colors, lcd.obj_palette_ram, &lcd.obj_palette_index, data);
+            break;
     }
 }
 
@@ -156,216 +303,69 @@ uint8_t lcd_rb(uint8_t addr)
             value = lcd.regs.lyc;
             break;  
 
-        // BGP (Write only)
+        // BGP
         case 0x47:
-            value = 0;
+            value = lcd.regs.bgp;
             break;
-    }
-
-    return value;
-}
 
-static inline void set_pixel(uint8_t x, uint8_t y, uint8_t color_index)
-{
-    lcd.color_buffer[y * LCD_WIDTH + x] = lcd.palette[color_index];
-}
-
-void draw_bg_line()
-{
-    if (!lcd.regs.control.fields.bg_window_enable) {
-        memset(lcd.color_buffer, 0, LCD_WIDTH * LCD_HEIGHT);
-        return;
-    }
-
-    uint16_t bg_tile_map_area = lcd.regs.control.fields.bg_tile_map_area ? 0x9C00 : 0x9800;
-    uint16_t bg_tile_data_area = lcd.regs.control.fields.bg_tile_data_area ? 0x8000 : 0x8800;
-
-    uint8_t scrolled_line = (lcd.regs.ly + lcd.regs.scy);
-    uint16_t scrolled_line_map_offset = (scrolled_line / 8) * TILES_PER_SCANLINE;
+        // OBP0
+        case 0x48:
+            value = lcd.regs.obp0;
+            break;
 
-    for (int x=0; x < LCD_WIDTH; x++) {
-        uint8_t scrolled_x = lcd.regs.scx + x;
+        // OBP1
+        case 0x49:
+            value = lcd.regs.obp1;
+            break;
 
-        uint8_t tile_x = scrolled_x >> 3;
-        uint8_t tile_offset_x = scrolled_x & 7;
-        uint8_t tile_offset_y = scrolled_line & 7;
+        // WY
+        case 0x4A:
+            value = lcd.regs.wy;
+            break;
 
-        uint16_t map_offset = scrolled_line_map_offset + tile_x;
-        uint8_t tile_index = mmu_rb(bg_tile_map_area + map_offset);
+        // WX
+        case 0x4B:
+            value = lcd.regs.wx;
+            break;
 
-        uint16_t tile_offset;
+        // BCPS
+        case 0x68:
+            value = emulator.rom_info.cgb ? lcd.bg_palette_index | 0x40 : 0xFF;
+            break;
 
-        if (lcd.regs.control.fields.bg_tile_data_area) {
-            tile_offset = (tile_index * BYTES_PER_TILE) + (tile_offset_y * 2);
-        } else {
-            tile_offset = (((int8_t) tile_index + 128) * BYTES_PER_TILE) + (tile_offset_y * 2);
-        }
+        // BCPD
+        case 0x69:
+            value = emulator.rom_info.cgb ? lcd.bg_palette_ram[lcd.bg_palette_index & 0x3F] : 0xFF;
+            break;
 
-        uint8_t bit_h = (mmu_rb(bg_tile_data_area + tile_offset + 1) >> (7 - tile_offset_x)) & 1;
-        uint8_t bit_l = (mmu_rb(bg_tile_data_area + tile_offset) >> (7 - tile_offset_x)) & 1;
+        // OCPS
+        case 0x6A:
+            value = emulator.rom_info.cgb ? lcd.obj_palette_index | 0x40 : 0xFF;
+            break;
 
-        uint8_t color_index = (bit_h << 1) | bit_l;
-        set_pixel(x, lcd.regs.ly, color_index);
+        // OCPD
+        case 0x6B:
+            value = emulator.rom_info.cgb ? lcd.obj_palette_ram[lcd.obj_palette_index & 0x3F] : 0xFF;
+            break;
     }
+
+    return value;
 }
 
-void draw_window_line()
+void lcd_step(uint32_t cycles)
 {
-    if (!(lcd.regs.control.fields.window_enable && lcd.regs.control.fields.bg_window_enable)) {
-        return;
-    }
-
-    uint16_t window_tile_data_area = lcd.regs.control.fields.bg_tile_data_area ? 0x8000 : 0x8800;
-    uint16_t window_tile_map_area = lcd.regs.control.fields.window_tile_map_area ? 0x9C00 : 0x9800;
-
-    if (lcd.regs.wx > 166) return;
-    if (lcd.regs.wy > 143) return;
-
-    uint8_t scrolled_line = lcd.regs.ly - lcd.regs.wy; 
-    uint16_t scrolled_line_map_offset = (scrolled_line / 8) * TILES_PER_SCANLINE;
-
-    for (int x=0; x < LCD_WIDTH; x++) {
-        uint8_t scrolled_x = x + lcd.regs.wy - 7;
-
-        uint8_t tile_x = scrolled_x >> 3;
-        uint8_t tile_offset_x = scrolled_x & 7;
-        uint8_t tile_offset_y = scrolled_line & 7;
-
-        uint16_t map_offset = scrolled_line_map_offset + tile_x;
-        uint8_t tile_index = mmu_rb(window_tile_map_area + map_offset);
-
-        uint16_t tile_offset;
-
-        if (lcd.regs.control.fields.bg_tile_data_area) {
-            tile_offset = (tile_index * BYTES_PER_TILE) + (tile_offset_y * 2);
-        } else {
-            tile_offset = (((int8_t) tile_index + 128) * BYTES_PER_TILE) + (tile_offset_y * 2);
-        }
-
-        uint8_t bit_h = (mmu_rb(window_tile_data_area + tile_offset + 1) >> (7 - tile_offset_x)) & 1;
-        uint8_t bit_l = (mmu_rb(window_tile_data_area + tile_offset) >> (7 - tile_offset_x)) & 1;
-
-        uint8_t color_index = (bit_h << 1) | bit_l;
-        set_pixel(x, lcd.regs.ly, color_index);
+    if (lcd.regs.control.fields.lcd_ppu_enable) {
+        lcd.engine->step(cycles);
     }
 }
 
-void draw_sprites()
+/* UINT32_MAX while the LCD is off, it can't raise interrupts then */
+uint32_t lcd_next_event()
 {
-    if (!lcd.regs.control.fields.obj_enable) {
-        return;
+    if (!lcd.regs.control.fields.lcd_ppu_enable) {
+        return UINT32_MAX;
     }
 
-    uint8_t sprite_size = lcd.regs.control.fields.obj_size ? 2 : 1;
-
-    for (int i=0; i < 40; i++) {
-        uint16_t oam_offset = i * 4;
-        lcd_oam_t* oam_entry = (lcd_oam_t *) &mmu.oam[oam_offset];
-    
-        uint8_t tile_index = lcd.regs.control.fields.obj_size ? oam_entry->tile_index & 0xFE : oam_entry->tile_index;
-        uint16_t tile_offset = tile_index * BYTES_PER_TILE * sprite_size;
-        uint8_t tile_x = oam_entry->x - 8;
-        uint8_t tile_y = oam_entry->y - 16;
-        bool flip_x = oam_entry->flags.fields.x_flip;
-        bool flip_y = oam_entry->flags.fields.y_flip;
-
-        if (tile_x == 0 || tile_x >= 160) continue;
-        if (tile_y == 0 || tile_y >= 168) continue;
-
-        for (int y=0; y < TILE_HEIGHT * sprite_size; y++) {
-            uint8_t tile_offset_y = y * 2;
-            uint8_t screen_y = flip_y ? (tile_y + 8 - y) : (tile_y + y);
-
-            for (int x=0; x < 8; x++) {
-                uint8_t bit_h = (mmu_rb(0x8000 + tile_offset + tile_offset_y + 1) >> (7 - x)) & 1;
-                uint8_t bit_l = (mmu_rb(0x8000 + tile_offset + tile_offset_y) >> (7 - x)) & 1;
-
-                uint8_t screen_x = flip_x ? (tile_x + 8 - x) : (tile_x + x);
-
-                uint8_t color_index = (bit_h << 1) | bit_l;
-
-                if (color_index == 0) {
-                    continue;
-                }
-
-                if (oam_entry->flags.fields.bg_window_over_obj && (lcd.color_buffer[screen_y * LCD_WIDTH + screen_x] != 0)) {
-                    continue;
-                }
-
-                set_pixel(screen_x, screen_y, color_index);
-            }
-        }
-    }
+    return lcd.engine->next_event();
 }
 
-void lcd_step(uint32_t cycles)
-{
-    if (lcd.regs.control.fields.lcd_ppu_enable) {
-        lcd.cycles += cycles;
-
-        if (lcd.regs.status.fields.mode == LCD_MODE_HBLANK) {
-            if (lcd.cycles >= 204) {
-                lcd.cycles -= 204;
-
-                draw_bg_line();
-                draw_window_line();
-
-                lcd.regs.ly++;
-
-                if (lcd.regs.ly == 143) {
-                    lcd.regs.status.fields.mode = LCD_MODE_VBLANK;                    
-                    cpu_request_interrupt(CPU_IF_VBLANK);
-               } else {
-                    if (lcd.regs.status.fields.mode_2_stat) {
-                        cpu_request_interrupt(CPU_IF_LCD_STAT);
-                    }
-
-                    lcd.regs.status.fields.mode = LCD_MODE_OAM;
-                }
-            }
-        
-        } else if (lcd.regs.status.fields.mode == LCD_MODE_VBLANK) {
-            if (lcd.cycles >= 456) {
-                lcd.cycles -= 456;
-
-                lcd.regs.ly++;
-
-                if (lcd.regs.ly == 153) {
-                    draw_sprites();
-                    render();
-                    
-                    lcd.regs.ly = 0;
-                    lcd.regs.status.fields.mode = LCD_MODE_OAM;
-                }
-            }
-
-        } else if (lcd.regs.status.fields.mode == LCD_MODE_OAM) {
-            if (lcd.cycles >= 80) {
-                lcd.cycles -= 80;
-
-                lcd.regs.status.fields.mode = LCD_MODE_VRAM;
-            }
-
-        } else if (lcd.regs.status.fields.mode == LCD_MODE_VRAM) {
-            if (lcd.cycles >= 172) {
-                lcd.cycles -= 172;
-
-                if (lcd.regs.status.fields.mode_0_stat) {
-                    cpu_request_interrupt(CPU_IF_LCD_STAT);
-                }
-
-                if (lcd.regs.ly == lcd.regs.lyc) {
-                    lcd.regs.status.fields.lyc = 1;
-
-                    if (lcd.regs.status.fields.lyc_stat) {
-                        cpu_request_interrupt(CPU_IF_LCD_STAT);
-                    }
-                } else {
-                    lcd.regs.status.fields.lyc = 0;
-                }
-
-                lcd.regs.status.fields.mode = LCD_MODE_HBLANK;
-            }
-        }
-    }
-}
\ No newline at end of file
@@ -0,0 +1,453 @@
+#include "emulator.h"
+
+/*
+    Pixel FIFO engine: steps the PPU one dot at a time like the hardware
+    fetcher. Mode 3 length depends on SCX, the window and sprites, and
+    register writes in the middle of a line apply from the next pixel on.
+*/
+
+#define DOTS_PER_LINE 456
+#define OAM_SCAN_DOTS 80
+#define LINES_PER_FRAME 154
+
+#define FETCHER_TILE        0
+#define FETCHER_DATA_LOW    1
+#define FETCHER_DATA_HIGH   2
+#define FETCHER_PUSH        3
+
+/* Dots lost at the start of mode 3 (the first tile fetch is thrown away) */
+#define FETCHER_WARMUP      6
+#define SPRITE_FETCH_DOTS   6
+
+typedef struct fifo_pixel_t {
+    uint8_t color;
+    uint8_t palette;
+    uint8_t priority;
+    uint8_t sprite;     // OAM index, decides between overlapping sprites on a CGB
+} fifo_pixel_t;
+
+typedef struct pixel_fifo_t {
+    fifo_pixel_t pixels[16];
+    uint8_t head;
+    uint8_t size;
+} pixel_fifo_t;
+
+typedef struct lcd_fifo_t {
+    uint16_t dot;
+
+    /* OAM scan */
+    uint8_t sprites[SPRITES_PER_LINE_LIMIT];
+    uint8_t sprite_count;
+    uint16_t sprites_fetched;
+
+    /* Background fetcher */
+    uint8_t fetcher_state;
+    uint8_t fetcher_dots;
+    uint8_t fetcher_x;
+    uint8_t tile_index;
+    lcd_bg_attributes_t tile_attributes;
+    uint8_t tile_row;
+    uint8_t tile_low;
+    uint8_t tile_high;
+
+    pixel_fifo_t bg;
+    pixel_fifo_t obj;
+
+    uint8_t x;
+    uint8_t discard;
+    uint8_t stall;
+
+    /* Window */
+    bool window_triggered;
+    bool window_active;
+    uint8_t window_line;
+
+    bool stat_line;
+} lcd_fifo_t;
+
+static lcd_fifo_t fifo;
+
+static const uint32_t all_lines[LCD_DIRTY_WORDS] = {
+    0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF
+};
+
+static inline void fifo_clear(pixel_fifo_t *queue)
+{
+    queue->head = 0;
+    queue->size = 0;
+}
+
+static inline void fifo_push(pixel_fifo_t *queue, fifo_pixel_t pixel)
+{
+    queue->pixels[(queue->head + queue->size) & 15] = pixel;
+    queue->size++;
+}
+
+static inline fifo_pixel_t fifo_pop(pixel_fifo_t *queue)
+{
+    fifo_pixel_t pixel = queue->pixels[queue->head];
+
+    queue->head = (queue->head + 1) & 15;
+    queue->size--;
+
+    return pixel;
+}
+
+static inline fifo_pixel_t* fifo_at(pixel_fifo_t *queue, uint8_t index)
+{
+    return &queue->pixels[(queue->head + index) & 15];
+}
+
+/* Offset into VRAM of the given row of a background/window tile */
+static inline uint16_t tile_data_offset(uint8_t tile_index, uint8_t row)
+{
+    uint16_t bank_offset = fifo.tile_attributes.fields.tile_vram_bank * MMU_VRAM_BANK_SIZE;
+
+    if (lcd.regs.control.fields.bg_tile_data_area) {
+        return bank_offset + (tile_index * BYTES_PER_TILE) + (row * 2);
+    }
+
+    return bank_offset + 0x1000 + ((int8_t) tile_index * BYTES_PER_TILE) + (row * 2);
+}
+
+/* STAT interrupts fire on the rising edge of the combined condition */
+static void update_stat()
+{
+    lcd.regs.status.fields.lyc = (lcd.regs.ly == lcd.regs.lyc);
+
+    uint8_t mode = lcd.regs.status.fields.mode;
+
+    bool stat_line = (lcd.regs.status.fields.lyc && lcd.regs.status.fields.lyc_stat) ||
+                     (mode == LCD_MODE_HBLANK && lcd.regs.status.fields.mode_0_stat) ||
+                     (mode == LCD_MODE_VBLANK && lcd.regs.status.fields.mode_1_stat) ||
+                     (mode == LCD_MODE_OAM && lcd.regs.status.fields.mode_2_stat);
+
+    if (stat_line && !fifo.stat_line) {
+        cpu_request_interrupt(CPU_IF_LCD_STAT);
+    }
+
+    fifo.stat_line = stat_line;
+}
+
+static inline void set_mode(uint8_t mode)
+{
+    lcd.regs.status.fields.mode = mode;
+    update_stat();
+}
+
+static void oam_scan()
+{
+    uint8_t height = lcd.regs.control.fields.obj_size ? 16 : 8;
+
+    fifo.sprite_count = 0;
+    fifo.sprites_fetched = 0;
+
+    for (int i=0; i < 40 && fifo.sprite_count < SPRITES_PER_LINE_LIMIT; i++) {
+        lcd_oam_t *oam_entry = (lcd_oam_t *) &mmu.oam[i * 4];
+        int top = oam_entry->y - 16;
+
+        if (lcd.regs.ly >= top && lcd.regs.ly < top + height) {
+            fifo.sprites[fifo.sprite_count++] = i;
+        }
+    }
+}
+
+static void start_line()
+{
+    fifo_clear(&fifo.bg);
+    fifo_clear(&fifo.obj);
+
+    fifo.fetcher_state = FETCHER_TILE;
+    fifo.fetcher_dots = 0;
+    fifo.fetcher_x = 0;
+
+    fifo.x = 0;
+    fifo.discard = lcd.regs.scx & 7;
+    fifo.stall = FETCHER_WARMUP;
+    fifo.window_active = false;
+}
+
+static void step_fetcher()
+{
+    // Every step but the push takes two dots
+    if (fifo.fetcher_state != FETCHER_PUSH) {
+        if (++fifo.fetcher_dots < 2) {
+            return;
+        }
+
+        fifo.fetcher_dots = 0;
+    }
+
+    switch(fifo.fetcher_state) {
+        case FETCHER_TILE: {
+            uint16_t map_offset;
+            uint8_t tile_x;
+            uint8_t line;
+
+            if (fifo.window_active) {
+                map_offset = lcd.regs.control.fields.window_tile_map_area ? 0x1C00 : 0x1800;
+                tile_x = fifo.fetcher_x;
+                line = fifo.window_line;
+            } else {
+                map_offset = lcd.regs.control.fields.bg_tile_map_area ? 0x1C00 : 0x1800;
+                tile_x = (lcd.regs.scx >> 3) + fifo.fetcher_x;
+                line = lcd.regs.ly + lcd.regs.scy;
+            }
+
+            map_offset += (line >> 3) * TILES_PER_SCANLINE + (tile_x & 31);
+
+            fifo.tile_index = mmu.vram[map_offset];
+            fifo.tile_attributes.value = emulator.rom_info.cgb ? mmu.vram[MMU_VRAM_BANK_SIZE + map_offset] : 0;
+            fifo.tile_row = fifo.tile_attributes.fields.y_flip ? 7 - (line & 7) : line & 7;
+            fifo.fetcher_state = FETCHER_DATA_LOW;
+            break;
+        }
+
+        case FETCHER_DATA_LOW:
+            fifo.tile_low = mmu.vram[tile_data_offset(fifo.tile_index, fifo.tile_row)];
+            fifo.fetcher_state = FETCHER_DATA_HIGH;
+            break;
+
+        case FETCHER_DATA_HIGH:
+            fifo.tile_high = mmu.vram[tile_data_offset(fifo.tile_index, fifo.tile_row) + 1];
+            fifo.fetcher_state = FETCHER_PUSH;
+            break;
+
+        case FETCHER_PUSH:
+            // Only pushes into an empty FIFO, otherwise retries next dot
+            if (fifo.bg.size) {
+                return;
+            }
+
+            for (int i=0; i < 8; i++) {
+                uint8_t bit = fifo.tile_attributes.fields.x_flip ? i : 7 - i;
+
+                fifo_pixel_t pixel = {
+                    .color = (((fifo.tile_high >> bit) & 1) << 1) | ((fifo.tile_low >> bit) & 1),
+                    .palette = fifo.tile_attributes.fields.palette_number,
+                    .priority = fifo.tile_attributes.fields.bg_over_obj
+                };
+
+                fifo_push(&fifo.bg, pixel);
+            }
+
+            fifo.fetcher_x++;
+            fifo.fetcher_state = FETCHER_TILE;
+            break;
+    }
+}
+
+/* Selected sprite that starts at or before the current pixel, lowest X first */
+static int pending_sprite()
+{
+    if (!lcd.regs.control.fields.obj_enable) {
+        return -1;
+    }
+
+    int result = -1;
+
+    for (int i=0; i < fifo.sprite_count; i++) {
+        if (fifo.sprites_fetched & (1 << i)) {
+            continue;
+        }
+
+        lcd_oam_t *oam_entry = (lcd_oam_t *) &mmu.oam[fifo.sprites[i] * 4];
+
+        if (oam_entry->x > fifo.x + 8) {
+            continue;
+        }
+
+        if (result < 0 || oam_entry->x < ((lcd_oam_t *) &mmu.oam[fifo.sprites[result] * 4])->x) {
+            result = i;
+        }
+    }
+
+    return result;
+}
+
+static void fetch_sprite(int index)
+{
+    lcd_oam_t *oam_entry = (lcd_oam_t *) &mmu.oam[fifo.sprites[index] * 4];
+    uint8_t height = lcd.regs.control.fields.obj_size ? 16 : 8;
+    uint8_t tile_index = lcd.regs.control.fields.obj_size ? oam_entry->tile_index & 0xFE : oam_entry->tile_index;
+    uint8_t row = lcd.regs.ly - (oam_entry->y - 16);
+
+    if (oam_entry->flags.fields.y_flip) {
+        row = height - 1 - row;
+    }
+
+    bool cgb = emulator.rom_info.cgb;
+    uint16_t tile_offset = tile_index * BYTES_PER_TILE + row * 2;
+
+    if (cgb) {
+        tile_offset += oam_entry->flags.fields.tile_vram_bank * MMU_VRAM_BANK_SIZE;
+    }
+
+    uint8_t low = mmu.vram[tile_offset];
+    uint8_t high = mmu.vram[tile_offset + 1];
+
+    while (fifo.obj.size < 8) {
+        fifo_pixel_t transparent = { 0 };
+        fifo_push(&fifo.obj, transparent);
+    }
+
+    for (int i=0; i < 8; i++) {
+        int screen_x = oam_entry->x - 8 + i;
+
+        if (screen_x < fifo.x) {
+            continue;
+        }
+
+        uint8_t bit = oam_entry->flags.fields.x_flip ? i : 7 - i;
+        uint8_t color = (((high >> bit) & 1) << 1) | ((low >> bit) & 1);
+
+        // Earlier sprites win, later ones only fill transparent pixels unless a CGB prefers their OAM index
+        fifo_pixel_t *pixel = fifo_at(&fifo.obj, screen_x - fifo.x);
+
+        if (color != 0 && (pixel->color == 0 || (cgb && fifo.sprites[index] < pixel->sprite))) {
+            pixel->color = color;
+            pixel->palette = cgb ? oam_entry->flags.fields.palette_number_cgb : oam_entry->flags.fields.palette_number_non_cgb;
+            pixel->priority = oam_entry->flags.fields.bg_window_over_obj;
+            pixel->sprite = fifo.sprites[index];
+        }
+    }
+
+    // Background fetcher has to finish its current tile first
+    uint8_t progress = fifo.fetcher_state * 2 + fifo.fetcher_dots;
+
+    fifo.sprites_fetched |= 1 << index;
+    fifo.stall += SPRITE_FETCH_DOTS + (progress < 5 ? 5 - progress : 0);
+}
+
+static void draw_dot()
+{
+    if (fifo.stall) {
+        fifo.stall--;
+        return;
+    }
+
+    step_fetcher();
+
+    if (!fifo.bg.size) {
+        return;
+    }
+
+    // Window restarts the fetcher once it is reached
+    if (!fifo.window_active && fifo.window_triggered && lcd.regs.control.fields.window_enable && fifo.x + 7 >= lcd.regs.wx) {
+        fifo.window_active = true;
+
+        fifo_clear(&fifo.bg);
+        fifo.fetcher_state = FETCHER_TILE;
+        fifo.fetcher_dots = 0;
+        fifo.fetcher_x = 0;
+        return;
+    }
+
+    int sprite = pending_sprite();
+
+    if (sprite >= 0) {
+        fetch_sprite(sprite);
+        return;
+    }
+
+    fifo_pixel_t bg = fifo_pop(&fifo.bg);
+
+    if (fifo.discard) {
+        fifo.discard--;
+        return;
+    }
+
+    // On a CGB LCDC bit 0 only takes the priority away from the background
+    bool bg_enabled = lcd.regs.control.fields.bg_window_enable;
+    uint8_t color_index = (bg_enabled || emulator.rom_info.cgb) ? bg.color : 0;
+    uint16_t color = lcd.bg_colors[bg.palette][color_index];
+
+    if (fifo.obj.size) {
+        fifo_pixel_t obj = fifo_pop(&fifo.obj);
+
+        if (obj.color && lcd.regs.control.fields.obj_enable && !(bg_enabled && color_index && (obj.priority || bg.priority))) {
+            color = lcd.obj_colors[obj.palette][obj.color];
+        }
+    }
+
+    lcd.color_buffer[lcd.regs.ly * LCD_WIDTH + fifo.x] = color;
+    fifo.x++;
+}
+
+static void fifo_dot()
+{
+    if (lcd.regs.ly < LCD_HEIGHT) {
+        if (fifo.dot == 0) {
+            if (lcd.regs.ly == lcd.regs.wy) {
+                fifo.window_triggered = true;
+            }
+
+            set_mode(LCD_MODE_OAM);
+        } else if (fifo.dot == OAM_SCAN_DOTS) {
+            oam_scan();
+            start_line();
+            set_mode(LCD_MODE_VRAM);
+        } else if (lcd.regs.status.fields.mode == LCD_MODE_VRAM) {
+            draw_dot();
+
+            if (fifo.x == LCD_WIDTH) {
+                if (fifo.window_active) {
+                    fifo.window_line++;
+                }
+
+                set_mode(LCD_MODE_HBLANK);
+                dma_hblank();
+            }
+        }
+    }
+
+    if (++fifo.dot < DOTS_PER_LINE) {
+        return;
+    }
+
+    fifo.dot = 0;
+    lcd.regs.ly++;
+
+    if (lcd.regs.ly == LCD_HEIGHT) {
+        lcd.regs.status.fields.mode = LCD_MODE_VBLANK;
+        cpu_request_interrupt(CPU_IF_VBLANK);
+
+        video_publish(lcd.color_buffer, all_lines);
+    } else if (lcd.regs.ly == LINES_PER_FRAME) {
+        lcd.regs.ly = 0;
+
+        fifo.window_triggered = false;
+        fifo.window_line = 0;
+    }
+
+    update_stat();
+}
+
+static void fifo_step(uint32_t cycles)
+{
+    for (uint32_t i=0; i < cycles; i++) {
+        fifo_dot();
+    }
+}
+
+/* Also used when the LCD is switched on or off */
+static void fifo_reset()
+{
+    memset(&fifo, 0x00, sizeof(lcd_fifo_t));
+
+    lcd.regs.ly = 0;
+    lcd.regs.status.fields.mode = LCD_MODE_HBLANK;
+}
+
+/* STAT can change on any dot */
+static uint32_t fifo_next_event()
+{
+    return 1;
+}
+
+const lcd_engine_t lcd_fifo_engine = {
+    .name = "fifo",
+    .reset = fifo_reset,
+    .step = fifo_step,
+    .next_event = fifo_next_event
+};
@@ -0,0 +1,473 @@
+#include "emulator.h"
+
+/*
+    Scanline engine: renders whole lines at the end of HBlank with fixed
+    mode lengths. Fast, but ignores register writes in the middle of a line.
+*/
+
+static inline void set_sprite_pixel(uint8_t x, uint8_t y, uint8_t color_index, uint8_t palette_number)
+{
+    lcd.color_buffer[y * LCD_WIDTH + x] = lcd.obj_colors[palette_number][color_index];
+}
+
+/* Attributes are always 0 on a DMG */
+static inline void set_bg_pixel(uint8_t x, uint8_t y, uint8_t color_index, lcd_bg_attributes_t attributes)
+{
+    lcd.bg_buffer[y * LCD_WIDTH + x] = lcd.bg_colors[attributes.fields.palette_number][color_index];
+    lcd.bg_index[y * LCD_WIDTH + x] = color_index | (attributes.fields.bg_over_obj ? LCD_BG_PRIORITY : 0);
+}
+
+static inline lcd_bg_attributes_t bg_attributes(uint16_t map_offset)
+{
+    lcd_bg_attributes_t attributes = {
+        .value = emulator.rom_info.cgb ? mmu.vram[MMU_VRAM_BANK_SIZE + map_offset] : 0
+    };
+
+    return attributes;
+}
+
+/* Color index of a background/window tile pixel */
+static inline uint8_t tile_pixel(uint8_t tile_index, lcd_bg_attributes_t attributes, uint8_t x, uint8_t y)
+{
+    uint16_t tile_offset;
+
+    if (attributes.fields.x_flip) x = 7 - x;
+    if (attributes.fields.y_flip) y = 7 - y;
+
+    if (lcd.regs.control.fields.bg_tile_data_area) {
+        tile_offset = (tile_index * BYTES_PER_TILE) + (y * 2);
+    } else {
+        tile_offset = 0x1000 + ((int8_t) tile_index * BYTES_PER_TILE) + (y * 2);
+    }
+
+    tile_offset += attributes.fields.tile_vram_bank * MMU_VRAM_BANK_SIZE;
+
+    uint8_t bit_h = (mmu.vram[tile_offset + 1] >> (7 - x)) & 1;
+    uint8_t bit_l = (mmu.vram[tile_offset] >> (7 - x)) & 1;
+
+    return (bit_h << 1) | bit_l;
+}
+
+static inline void mark_line(uint32_t *lines, uint8_t y)
+{
+    lines[y >> 5] |= 1u << (y & 31);
+}
+
+/* Offset into both VRAM banks, the maps in bank 1 hold the CGB attributes */
+void lcd_vram_written(uint16_t offset)
+{
+    uint16_t bank_offset = offset & (MMU_VRAM_BANK_SIZE - 1);
+
+    if (bank_offset < 0x1800) {
+        uint16_t tile = (offset / MMU_VRAM_BANK_SIZE) * (LCD_TILE_COUNT / 2) + bank_offset / BYTES_PER_TILE;
+        lcd.dirty.tiles[tile >> 5] |= 1u << (tile & 31);
+    } else {
+        lcd.dirty.map_rows |= 1ULL << ((bank_offset - 0x1800) / TILES_PER_SCANLINE);
+    }
+}
+
+void lcd_oam_written()
+{
+    lcd.dirty.oam = true;
+}
+
+/*
+    A write counts for the rest of the frame it happened in and the whole
+    next one, so lines drawn before the write still pick it up.
+*/
+static inline bool tile_dirty(uint16_t tile)
+{
+    return ((lcd.dirty.tiles[tile >> 5] | lcd.dirty_previous.tiles[tile >> 5]) >> (tile & 31)) & 1;
+}
+
+static bool map_row_dirty(uint16_t map_area, uint8_t row)
+{
+    uint8_t map_row = ((map_area - 0x9800) / TILES_PER_SCANLINE) + row;
+
+    if (((lcd.dirty.map_rows | lcd.dirty_previous.map_rows) >> map_row) & 1) {
+        return true;
+    }
+
+    uint16_t map_offset = map_area - 0x8000 + row * TILES_PER_SCANLINE;
+    const uint8_t *tile_indices = &mmu.vram[map_offset];
+
+    for (int i=0; i < TILES_PER_SCANLINE; i++) {
+        uint16_t tile;
+
+        if (lcd.regs.control.fields.bg_tile_data_area) {
+            tile = tile_indices[i];
+        } else {
+            tile = 256 + (int8_t) tile_indices[i];
+        }
+
+        tile += bg_attributes(map_offset + i).fields.tile_vram_bank * (LCD_TILE_COUNT / 2);
+
+        if (tile_dirty(tile)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool line_needs_redraw()
+{
+    lcd_line_inputs_t inputs = {
+        .control = lcd.regs.control.value,
+        .scy = lcd.regs.scy,
+        .scx = lcd.regs.scx,
+        .wy = lcd.regs.wy,
+        .wx = lcd.regs.wx,
+        .bgp = lcd.regs.bgp,
+        .valid = 1
+    };
+
+    lcd_line_inputs_t *previous = &lcd.line_inputs[lcd.regs.ly];
+    bool changed = memcmp(&inputs, previous, sizeof(lcd_line_inputs_t)) != 0;
+    *previous = inputs;
+
+    if (changed || lcd.dirty.palettes || lcd.dirty_previous.palettes) {
+        return true;
+    }
+
+    // Only the DMG can switch the background off
+    if (!lcd.regs.control.fields.bg_window_enable && !emulator.rom_info.cgb) {
+        return false;
+    }
+
+    uint16_t bg_tile_map_area = lcd.regs.control.fields.bg_tile_map_area ? 0x9C00 : 0x9800;
+
+    if (map_row_dirty(bg_tile_map_area, (uint8_t) (lcd.regs.ly + lcd.regs.scy) / 8)) {
+        return true;
+    }
+
+    if (lcd.regs.control.fields.window_enable && lcd.regs.wx <= 166 && lcd.regs.wy <= 143) {
+        uint16_t window_tile_map_area = lcd.regs.control.fields.window_tile_map_area ? 0x9C00 : 0x9800;
+
+        if (map_row_dirty(window_tile_map_area, (uint8_t) (lcd.regs.ly - lcd.regs.wy) / 8)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void draw_bg_line()
+{
+    ZONE("draw_bg_line");
+
+    if (!lcd.regs.control.fields.bg_window_enable && !emulator.rom_info.cgb) {
+        for (int x=0; x < LCD_WIDTH; x++) {
+            lcd.bg_buffer[lcd.regs.ly * LCD_WIDTH + x] = lcd_dmg_colors[0];
+        }
+
+        memset(&lcd.bg_index[lcd.regs.ly * LCD_WIDTH], 0, LCD_WIDTH);
+        return;
+    }
+
+    uint16_t bg_tile_map_area = lcd.regs.control.fields.bg_tile_map_area ? 0x9C00 : 0x9800;
+
+    uint8_t scrolled_line = (lcd.regs.ly + lcd.regs.scy);
+    uint16_t scrolled_line_map_offset = (scrolled_line / 8) * TILES_PER_SCANLINE;
+
+    for (int x=0; x < LCD_WIDTH; x++) {
+        uint8_t scrolled_x = lcd.regs.scx + x;
+
+        uint8_t tile_x = scrolled_x >> 3;
+        uint8_t tile_offset_x = scrolled_x & 7;
+        uint8_t tile_offset_y = scrolled_line & 7;
+
+        uint16_t map_offset = bg_tile_map_area - 0x8000 + scrolled_line_map_offset + tile_x;
+        uint8_t tile_index = mmu.vram[map_offset];
+        lcd_bg_attributes_t attributes = bg_attributes(map_offset);
+
+        uint8_t color_index = tile_pixel(tile_index, attributes, tile_offset_x, tile_offset_y);
+        set_bg_pixel(x, lcd.regs.ly, color_index, attributes);
+    }
+}
+
+void draw_window_line()
+{
+    ZONE("draw_window_line");
+
+    if (!(lcd.regs.control.fields.window_enable && (lcd.regs.control.fields.bg_window_enable || emulator.rom_info.cgb))) {
+        return;
+    }
+
+    uint16_t window_tile_map_area = lcd.regs.control.fields.window_tile_map_area ? 0x9C00 : 0x9800;
+
+    if (lcd.regs.wx > 166) return;
+    if (lcd.regs.wy > 143) return;
+    if (lcd.regs.ly < lcd.regs.wy) return;
+
+    uint8_t scrolled_line = lcd.regs.ly - lcd.regs.wy; 
+    uint16_t scrolled_line_map_offset = (scrolled_line / 8) * TILES_PER_SCANLINE;
+
+    // The window starts at screen column WX - 7 and covers the rest of the line
+    int start_x = lcd.regs.wx < 7 ? 0 : lcd.regs.wx - 7;
+
+    for (int x=start_x; x < LCD_WIDTH; x++) {
+        uint8_t scrolled_x = x + 7 - lcd.regs.wx;
+
+        uint8_t tile_x = scrolled_x >> 3;
+        uint8_t tile_offset_x = scrolled_x & 7;
+        uint8_t tile_offset_y = scrolled_line & 7;
+
+        uint16_t map_offset = window_tile_map_area - 0x8000 + scrolled_line_map_offset + tile_x;
+        uint8_t tile_index = mmu.vram[map_offset];
+        lcd_bg_attributes_t attributes = bg_attributes(map_offset);
+
+        uint8_t color_index = tile_pixel(tile_index, attributes, tile_offset_x, tile_offset_y);
+        set_bg_pixel(x, lcd.regs.ly, color_index, attributes);
+    }
+}
+
+void draw_sprites()
+{
+    ZONE("draw_sprites");
+
+    if (!lcd.regs.control.fields.obj_enable) {
+        return;
+    }
+
+    uint8_t sprite_size = lcd.regs.control.fields.obj_size ? 2 : 1;
+    bool cgb = emulator.rom_info.cgb;
+
+    for (int n=0; n < 40; n++) {
+        // Later sprites end up on top, on a CGB the lowest OAM index has to win
+        int i = cgb ? 39 - n : n;
+        uint16_t oam_offset = i * 4;
+        lcd_oam_t* oam_entry = (lcd_oam_t *) &mmu.oam[oam_offset];
+    
+        uint8_t tile_index = lcd.regs.control.fields.obj_size ? oam_entry->tile_index & 0xFE : oam_entry->tile_index;
+        uint16_t tile_offset = tile_index * BYTES_PER_TILE * sprite_size;
+        uint8_t palette_number = oam_entry->flags.fields.palette_number_non_cgb;
+
+        if (cgb) {
+            tile_offset += oam_entry->flags.fields.tile_vram_bank * MMU_VRAM_BANK_SIZE;
+            palette_number = oam_entry->flags.fields.palette_number_cgb;
+        }
+        uint8_t tile_x = oam_entry->x - 8;
+        uint8_t tile_y = oam_entry->y - 16;
+        bool flip_x = oam_entry->flags.fields.x_flip;
+        bool flip_y = oam_entry->flags.fields.y_flip;
+
+        if (tile_x == 0 || tile_x >= 160) continue;
+        if (tile_y == 0 || tile_y >= 168) continue;
+
+        for (int y=0; y < TILE_HEIGHT * sprite_size; y++) {
+            uint8_t tile_offset_y = y * 2;
+            uint8_t screen_y = flip_y ? (tile_y + 8 - y) : (tile_y + y);
+
+            for (int x=0; x < 8; x++) {
+                uint8_t bit_h = (mmu.vram[tile_offset + tile_offset_y + 1] >> (7 - x)) & 1;
+                uint8_t bit_l = (mmu.vram[tile_offset + tile_offset_y] >> (7 - x)) & 1;
+
+                uint8_t screen_x = flip_x ? (tile_x + 8 - x) : (tile_x + x);
+
+                if (screen_x >= LCD_WIDTH || screen_y >= LCD_HEIGHT) {
+                    continue;
+                }
+
+                uint8_t color_index = (bit_h << 1) | bit_l;
+
+                if (color_index == 0) {
+                    continue;
+                }
+
+                // With LCDC bit 0 clear a CGB always draws sprites on top
+                uint8_t bg = lcd.bg_index[screen_y * LCD_WIDTH + screen_x];
+
+                if (lcd.regs.control.fields.bg_window_enable && (bg & 3) && (oam_entry->flags.fields.bg_window_over_obj || (bg & LCD_BG_PRIORITY))) {
+                    continue;
+                }
+
+                set_sprite_pixel(screen_x, screen_y, color_index, palette_number);
+            }
+        }
+    }
+}
+
+/* Same placement rules as draw_sprites(), but only records the lines touched */
+void collect_sprite_lines()
+{
+    memset(lcd.sprite_lines, 0x00, sizeof(lcd.sprite_lines));
+
+    if (!lcd.regs.control.fields.obj_enable) {
+        return;
+    }
+
+    uint8_t sprite_size = lcd.regs.control.fields.obj_size ? 2 : 1;
+
+    for (int i=0; i < 40; i++) {
+        lcd_oam_t* oam_entry = (lcd_oam_t *) &mmu.oam[i * 4];
+
+        uint8_t tile_x = oam_entry->x - 8;
+        uint8_t tile_y = oam_entry->y - 16;
+        bool flip_y = oam_entry->flags.fields.y_flip;
+
+        if (tile_x == 0 || tile_x >= 160) continue;
+        if (tile_y == 0 || tile_y >= 168) continue;
+
+        for (int y=0; y < TILE_HEIGHT * sprite_size; y++) {
+            uint8_t screen_y = flip_y ? (tile_y + 8 - y) : (tile_y + y);
+
+            if (screen_y < LCD_HEIGHT) {
+                mark_line(lcd.sprite_lines, screen_y);
+            }
+        }
+    }
+}
+
+/* Copies changed background lines into the color buffer and puts the sprites on top */
+void compose_frame()
+{
+    ZONE("compose_frame");
+
+    uint32_t previous_sprite_lines[LCD_DIRTY_WORDS];
+    memcpy(previous_sprite_lines, lcd.sprite_lines, sizeof(previous_sprite_lines));
+
+    collect_sprite_lines();
+
+    lcd_line_inputs_t sprite_inputs = {
+        .control = lcd.regs.control.value,
+        .obp0 = lcd.regs.obp0,
+        .obp1 = lcd.regs.obp1,
+        .valid = 1
+    };
+
+    bool sprites_changed = lcd.dirty.oam || lcd.dirty.palettes || memcmp(&sprite_inputs, &lcd.sprite_inputs, sizeof(lcd_line_inputs_t)) != 0;
+    lcd.sprite_inputs = sprite_inputs;
+
+    for (int i=0; i < LCD_TILE_COUNT / 32; i++) {
+        if (lcd.dirty.tiles[i]) {
+            sprites_changed = true;
+        }
+    }
+
+    for (int i=0; i < LCD_DIRTY_WORDS; i++) {
+        lcd.dirty_lines[i] = lcd.redrawn_lines[i];
+
+        if (sprites_changed) {
+            lcd.dirty_lines[i] |= lcd.sprite_lines[i] | previous_sprite_lines[i];
+        }
+
+        lcd.redrawn_lines[i] = 0;
+    }
+
+    for (int y=0; y < LCD_HEIGHT; y++) {
+        if ((lcd.dirty_lines[y >> 5] >> (y & 31)) & 1) {
+            memcpy(&lcd.color_buffer[y * LCD_WIDTH], &lcd.bg_buffer[y * LCD_WIDTH], LCD_WIDTH * sizeof(lcd.color_buffer[0]));
+        }
+    }
+
+    draw_sprites();
+
+    // Start a new generation of dirty bits
+    lcd.dirty_previous = lcd.dirty;
+    memset(&lcd.dirty, 0x00, sizeof(lcd_vram_dirty_t));
+}
+
+static void scanline_step(uint32_t cycles)
+{
+    lcd.cycles += cycles;
+
+    if (lcd.regs.status.fields.mode == LCD_MODE_HBLANK) {
+        if (lcd.cycles >= 204) {
+            lcd.cycles -= 204;
+
+            if (line_needs_redraw()) {
+                draw_bg_line();
+                draw_window_line();
+
+                mark_line(lcd.redrawn_lines, lcd.regs.ly);
+            }
+
+            lcd.regs.ly++;
+
+            if (lcd.regs.ly == 143) {
+                lcd.regs.status.fields.mode = LCD_MODE_VBLANK;                    
+                cpu_request_interrupt(CPU_IF_VBLANK);
+           } else {
+                if (lcd.regs.status.fields.mode_2_stat) {
+                    cpu_request_interrupt(CPU_IF_LCD_STAT);
+                }
+
+                lcd.regs.status.fields.mode = LCD_MODE_OAM;
+            }
+        }
+    
+    } else if (lcd.regs.status.fields.mode == LCD_MODE_VBLANK) {
+        if (lcd.cycles >= 456) {
+            lcd.cycles -= 456;
+
+            lcd.regs.ly++;
+
+            if (lcd.regs.ly == 153) {
+                compose_frame();
+                video_publish(lcd.color_buffer, lcd.dirty_lines);
+                
+                lcd.regs.ly = 0;
+                lcd.regs.status.fields.mode = LCD_MODE_OAM;
+            }
+        }
+
+    } else if (lcd.regs.status.fields.mode == LCD_MODE_OAM) {
+        if (lcd.cycles >= 80) {
+            lcd.cycles -= 80;
+
+            lcd.regs.status.fields.mode = LCD_MODE_VRAM;
+        }
+
+    } else if (lcd.regs.status.fields.mode == LCD_MODE_VRAM) {
+        if (lcd.cycles >= 172) {
+            lcd.cycles -= 172;
+
+            if (lcd.regs.status.fields.mode_0_stat) {
+                cpu_request_interrupt(CPU_IF_LCD_STAT);
+            }
+
+            if (lcd.regs.ly == lcd.regs.lyc) {
+                lcd.regs.status.fields.lyc = 1;
+
+                if (lcd.regs.status.fields.lyc_stat) {
+                    cpu_request_interrupt(CPU_IF_LCD_STAT);
+                }
+            } else {
+                lcd.regs.status.fields.lyc = 0;
+            }
+
+            lcd.regs.status.fields.mode = LCD_MODE_HBLANK;
+            dma_hblank();
+        }
+    }
+}
+
+static void scanline_reset()
+{
+    memset(lcd.line_inputs, 0x00, sizeof(lcd.line_inputs));
+    memset(lcd.sprite_lines, 0x00, sizeof(lcd.sprite_lines));
+    memset(lcd.redrawn_lines, 0x00, sizeof(lcd.redrawn_lines));
+}
+
+/* Each step handles at most one mode change */
+static uint32_t scanline_next_event()
+{
+    static const uint32_t mode_cycles[4] = {
+        [LCD_MODE_HBLANK] = 204,
+        [LCD_MODE_VBLANK] = 456,
+        [LCD_MODE_OAM] = 80,
+        [LCD_MODE_VRAM] = 172
+    };
+
+    uint32_t length = mode_cycles[lcd.regs.status.fields.mode];
+
+    return (lcd.cycles < length) ? length - lcd.cycles : 1;
+}
+
+const lcd_engine_t lcd_scanline_engine = {
+    .name = "scanline",
+    .reset = scanline_reset,
+    .step = scanline_step,
+    .next_event = scanline_next_event
+};
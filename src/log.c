@@ -0,0 +1,473 @@
+#include "emulator.h"
+
+#include <stdarg.h>
+
+uint8_t log_levels[LOG_MODULE_COUNT] = {
+    [0 ... LOG_MODULE_COUNT - 1] = LOG_DEFAULT_LEVEL
+};
+
+static const char *module_names[LOG_MODULE_COUNT] = {
+    [LOG_CPU] = "cpu",
+    [LOG_MMU] = "mmu",
+    [LOG_LCD] = "lcd",
+    [LOG_TIMER] = "timer",
+    [LOG_SOUND] = "sound",
+    [LOG_MBC] = "mbc",
+    [LOG_INPUT] = "input",
+    [LOG_SERIAL] = "serial"
+};
+
+static const char *level_names[] = {
+    [LOG_LEVEL_OFF] = "off",
+    [LOG_LEVEL_ERROR] = "error",
+    [LOG_LEVEL_WARN] = "warn",
+    [LOG_LEVEL_INFO] = "info",
+    [LOG_LEVEL_DEBUG] = "debug",
+    [LOG_LEVEL_TRACE] = "trace"
+};
+
+static log_t log_queue;
+
+#define LENGTH_INT   0
+#define LENGTH_CHAR  1
+#define LENGTH_SHORT 2
+#define LENGTH_LONG  3
+#define LENGTH_LLONG 4
+#define LENGTH_SIZE  5
+
+typedef struct log_spec_t {
+    const char *start;
+    const char *end;
+    char conversion;
+    uint8_t length;
+
+    // '*' widths and precisions, each takes an int argument before the value
+    uint8_t stars;
+} log_spec_t;
+
+/* Finds the next conversion, the literal text before it is [p, spec->start) */
+static const char* next_spec(const char *p, log_spec_t *spec)
+{
+    while (*p && *p != '%') {
+        p++;
+    }
+
+    if (!*p) {
+        return NULL;
+    }
+
+    spec->start = p++;
+    spec->length = LENGTH_INT;
+    spec->stars = 0;
+
+    while (*p && strchr("-+ #0", *p)) p++;
+
+    while (*p && (strchr("0123456789.*", *p))) {
+        if (*p++ == '*') {
+            spec->stars++;
+        }
+    }
+
+    switch(*p) {
+        case 'h':
+            p++;
+            spec->length = LENGTH_SHORT;
+            if (*p == 'h') { p++; spec->length = LENGTH_CHAR; }
+            break;
+        case 'l':
+            p++;
+            spec->length = LENGTH_LONG;
+            if (*p == 'l') { p++; spec->length = LENGTH_LLONG; }
+            break;
+        case 'z':
+        case 'j':
+        case 't':
+            p++;
+            spec->length = LENGTH_SIZE;
+            break;
+        case 'L':
+            p++;
+            break;
+    }
+
+    spec->conversion = *p;
+    spec->end = *p ? p + 1 : p;
+
+    return spec->end;
+}
+
+static uint64_t read_integer(va_list *args, uint8_t length, bool is_signed)
+{
+    switch(length) {
+        case LENGTH_LONG:
+            return is_signed ? (uint64_t) va_arg(*args, long) : va_arg(*args, unsigned long);
+        case LENGTH_LLONG:
+            return is_signed ? (uint64_t) va_arg(*args, long long) : va_arg(*args, unsigned long long);
+        case LENGTH_SIZE:
+            return va_arg(*args, size_t);
+        case LENGTH_CHAR:
+            return is_signed ? (uint64_t) (signed char) va_arg(*args, int) : (uint8_t) va_arg(*args, unsigned int);
+        case LENGTH_SHORT:
+            return is_signed ? (uint64_t) (short) va_arg(*args, int) : (uint16_t) va_arg(*args, unsigned int);
+        default:
+            return is_signed ? (uint64_t) va_arg(*args, int) : va_arg(*args, unsigned int);
+    }
+}
+
+/* Claims a slot, returns NULL if the logging thread is a whole ring behind */
+static log_record_t* log_claim(uint32_t *position)
+{
+    uint32_t head = (uint32_t) SDL_AtomicGet(&log_queue.head);
+
+    while (true) {
+        log_record_t *record = &log_queue.ring[head & (LOG_RING_SIZE - 1)];
+        int32_t diff = (int32_t) ((uint32_t) SDL_AtomicGet(&record->sequence) - head);
+
+        if (diff == 0) {
+            if (SDL_AtomicCAS(&log_queue.head, (int) head, (int) (head + 1))) {
+                *position = head;
+                return record;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        }
+
+        head = (uint32_t) SDL_AtomicGet(&log_queue.head);
+    }
+}
+
+void log_write(uint8_t module, uint8_t level, const char *format, ...)
+{
+    uint32_t position;
+    log_record_t *record = log_claim(&position);
+
+    if (!record) {
+        SDL_AtomicIncRef(&log_queue.dropped);
+        return;
+    }
+
+    record->module = module;
+    record->level = level;
+    record->format = format;
+    record->count = 0;
+    record->strings_used = 0;
+    record->strings[LOG_STRING_SIZE - 1] = '\0';
+
+    va_list args;
+    va_start(args, format);
+
+    log_spec_t spec;
+    const char *p = format;
+
+    while ((p = next_spec(p, &spec)) && record->count < LOG_MAX_ARGS) {
+        for (int i=0; i < spec.stars && record->count < LOG_MAX_ARGS; i++) {
+            record->args[record->count++] = (uint64_t) (int64_t) va_arg(args, int);
+        }
+
+        if (record->count == LOG_MAX_ARGS) {
+            break;
+        }
+
+        uint64_t *arg = &record->args[record->count];
+
+        switch(spec.conversion) {
+            case 'd':
+            case 'i':
+                *arg = read_integer(&args, spec.length, true);
+                break;
+
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+            case 'c':
+                *arg = read_integer(&args, spec.length, false);
+                break;
+
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G': {
+                double value = va_arg(args, double);
+                memcpy(arg, &value, sizeof(double));
+                break;
+            }
+
+            case 'p':
+                *arg = (uint64_t) (uintptr_t) va_arg(args, void *);
+                break;
+
+            case 's': {
+                const char *string = va_arg(args, const char *);
+                // The last byte always stays '\0' for strings that no longer fit
+                size_t free_space = LOG_STRING_SIZE - 1 - record->strings_used;
+                size_t length = string ? strlen(string) : 0;
+
+                if (free_space == 0) {
+                    *arg = LOG_STRING_SIZE - 1;
+                    break;
+                }
+
+                if (length >= free_space) {
+                    length = free_space - 1;
+                }
+
+                *arg = record->strings_used;
+                memcpy(&record->strings[record->strings_used], string ? string : "", length);
+                record->strings[record->strings_used + length] = '\0';
+                record->strings_used += length + 1;
+                break;
+            }
+
+            default:
+                // %% or something we can't capture
+                continue;
+        }
+
+        record->count++;
+    }
+
+    va_end(args);
+
+    // Publish the record to the logging thread
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&record->sequence, (int) (position + 1));
+}
+
+/* Formats one conversion with the captured arguments, '*' are written out and the length modifier is replaced with ll */
+static int format_spec(char *out, size_t size, const log_spec_t *spec, const log_record_t *record, uint8_t *index)
+{
+    char text[64];
+    size_t length = 0;
+
+    for (const char *p = spec->start; p < spec->end - 1 && length < sizeof(text) - 16; p++) {
+        if (*p == '*') {
+            int value = (int) record->args[(*index)++];
+
+            // A negative precision counts as none
+            if (value < 0 && length && text[length - 1] == '.') {
+                length--;
+                continue;
+            }
+
+            length += snprintf(&text[length], sizeof(text) - length, "%d", value);
+        } else if (!strchr("hlzjtL", *p)) {
+            text[length++] = *p;
+        }
+    }
+
+    uint64_t arg = record->args[(*index)++];
+
+    switch(spec->conversion) {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            text[length++] = 'l';
+            text[length++] = 'l';
+            text[length++] = spec->conversion;
+            text[length] = '\0';
+            return snprintf(out, size, text, (long long) arg);
+
+        case 'c':
+            text[length++] = 'c';
+            text[length] = '\0';
+            return snprintf(out, size, text, (int) arg);
+
+        case 's':
+            text[length++] = 's';
+            text[length] = '\0';
+            return snprintf(out, size, text, &record->strings[arg]);
+
+        case 'p':
+            text[length++] = 'p';
+            text[length] = '\0';
+            return snprintf(out, size, text, (void *) (uintptr_t) arg);
+
+        default: {
+            double value;
+            memcpy(&value, &arg, sizeof(double));
+
+            text[length++] = spec->conversion;
+            text[length] = '\0';
+            return snprintf(out, size, text, value);
+        }
+    }
+}
+
+static void log_print(const log_record_t *record)
+{
+    char line[512];
+    size_t length = snprintf(line, sizeof(line), "[%s] ", module_names[record->module]);
+
+    log_spec_t spec;
+    const char *literal = record->format;
+    const char *p = record->format;
+    uint8_t index = 0;
+
+    while ((p = next_spec(p, &spec)) && length < sizeof(line)) {
+        size_t literal_length = spec.start - literal;
+
+        if (literal_length > sizeof(line) - length - 1) {
+            literal_length = sizeof(line) - length - 1;
+        }
+
+        memcpy(&line[length], literal, literal_length);
+        length += literal_length;
+        literal = spec.end;
+
+        if (spec.conversion == '%') {
+            if (length < sizeof(line) - 1) {
+                line[length++] = '%';
+            }
+        } else if (index + spec.stars < record->count) {
+            int written = format_spec(&line[length], sizeof(line) - length, &spec, record, &index);
+            length += (written > 0) ? (size_t) written : 0;
+        }
+    }
+
+    if (length < sizeof(line) - 1) {
+        snprintf(&line[length], sizeof(line) - length, "%s", literal);
+    }
+
+    line[sizeof(line) - 1] = '\0';
+    fputs(line, stdout);
+}
+
+/* Prints everything that has been published so far, returns the number of records */
+static uint32_t log_drain()
+{
+    uint32_t count = 0;
+
+    while (true) {
+        log_record_t *record = &log_queue.ring[log_queue.tail & (LOG_RING_SIZE - 1)];
+
+        if ((uint32_t) SDL_AtomicGet(&record->sequence) != log_queue.tail + 1) {
+            return count;
+        }
+
+        SDL_MemoryBarrierAcquire();
+        log_print(record);
+
+        // Hand the slot back to the writers for the next lap
+        SDL_AtomicSet(&record->sequence, (int) (log_queue.tail + LOG_RING_SIZE));
+        log_queue.tail++;
+        count++;
+    }
+}
+
+static int log_run(void *data)
+{
+    (void) data;
+
+    while (true) {
+        if (log_drain()) {
+            continue;
+        }
+
+        fflush(stdout);
+
+        if (!SDL_AtomicGet(&log_queue.running)) {
+            break;
+        }
+
+        SDL_Delay(1);
+    }
+
+    return 0;
+}
+
+void log_init()
+{
+    for (int i=0; i < LOG_RING_SIZE; i++) {
+        SDL_AtomicSet(&log_queue.ring[i].sequence, i);
+    }
+
+    SDL_AtomicSet(&log_queue.head, 0);
+    SDL_AtomicSet(&log_queue.dropped, 0);
+    SDL_AtomicSet(&log_queue.running, 1);
+    log_queue.tail = 0;
+
+    log_queue.thread = SDL_CreateThread(log_run, "log", NULL);
+
+    if (!log_queue.thread) {
+        printf("Unable to create logging thread!\n");
+        exit(-1);
+    }
+
+    // Flush whatever is left when exiting from anywhere
+    atexit(log_quit);
+}
+
+void log_quit()
+{
+    if (!log_queue.thread) {
+        return;
+    }
+
+    SDL_AtomicSet(&log_queue.running, 0);
+    SDL_WaitThread(log_queue.thread, NULL);
+    log_queue.thread = NULL;
+
+    if (SDL_AtomicGet(&log_queue.dropped)) {
+        printf("[log] %d messages dropped\n", SDL_AtomicGet(&log_queue.dropped));
+    }
+}
+
+static int parse_level(const char *name, size_t length)
+{
+    for (int i=0; i <= LOG_LEVEL_TRACE; i++) {
+        if (strlen(level_names[i]) == length && strncmp(level_names[i], name, length) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* Parses "module=level[,module=level...]", "all" sets every module */
+bool log_configure(const char *spec)
+{
+    while (*spec) {
+        const char *end = strchr(spec, ',');
+        const char *equals = strchr(spec, '=');
+
+        if (!end) {
+            end = spec + strlen(spec);
+        }
+
+        if (!equals || equals > end) {
+            return false;
+        }
+
+        int level = parse_level(equals + 1, end - equals - 1);
+
+        if (level < 0) {
+            return false;
+        }
+
+        size_t name_length = equals - spec;
+        bool found = false;
+
+        for (int i=0; i < LOG_MODULE_COUNT; i++) {
+            bool all = (name_length == 3 && strncmp(spec, "all", 3) == 0);
+
+            if (all || (strlen(module_names[i]) == name_length && strncmp(module_names[i], spec, name_length) == 0)) {
+                log_levels[i] = (uint8_t) level;
+                found = true;
+            }
+        }
+
+        if (!found) {
+            return false;
+        }
+
+        spec = *end ? end + 1 : end;
+    }
+
+    return true;
+}
@@ -1,129 +1,66 @@
 #include "emulator.h"
 
 #include <SDL2/SDL.h>
+#include <getopt.h>
 
-const char* cartridge_type_names[0xFF] = {
-    [0x00] = "ROMONLY",
-    [0x01] = "MBC1",
-    [0x02] = "MBC1+RAM",
-    [0x03] = "MBC1+RAM+BATTERY",
-    [0x05] = "MBC2",
-    [0x06] = "MBC2+BATTERY",
-    [0x13] = "MBC3+RAM+BATTERY"
-};
-
-const uint32_t default_palette[4] = {
-    0xFFFFFFFF, // White
-    0xFF969696, // Light Grey
-    0xFF3B3B3B, // Dark Grey
-    0xFF000000 // Black
-};
-
-/* Original Gameboy palette
-
-uint8_t default_palette[4] = {
-    0xFF9BBC0F,
-    0xFF8BAC0F,
-    0xFF306230,
-    0xFF0F380F
-};
-
-*/
-
-void load_rom(const char *path)
+/* Runs the selected filter on the CPU, the renderer only stretches it by the remaining integer factor */
+void render_scaled(video_frame_t *frame, const uint32_t *dirty_lines)
 {
-    FILE *rom_fp = fopen(path, "rb");
+    int factor = scale.filter->factor;
 
-    fseek(rom_fp, 0, SEEK_END);
-    long size = ftell(rom_fp);
-    fseek(rom_fp, 0, SEEK_SET);
-
-    emulator.rom = (uint8_t *) malloc(size);
-    fread(emulator.rom, size, 1, rom_fp);
-    fclose(rom_fp);
-
-    memcpy(mmu.rom, emulator.rom, (size > 0x8000) ? 0x8000 : size);
-
-    printf("[emulator] Loaded %s (%ld bytes)\n", path, size);
-
-    // Title
-    memcpy(emulator.rom_info.title, &emulator.rom[ROM_TITLE_OFFSET], 16);
+    if (emulator.scaled_factor != factor) {
+        if (emulator.scaled_texture) {
+            SDL_DestroyTexture(emulator.scaled_texture);
+        }
 
-    // Cartridge type
-    emulator.rom_info.cartridge_type = emulator.rom[ROM_CARTRIDGE_TYPE_OFFSET];
-    strcpy(emulator.rom_info.cartridge_type_name, cartridge_type_names[emulator.rom_info.cartridge_type]);
-    
-    switch(emulator.rom_info.cartridge_type) {
-        case ROM_CARTRIDGE_TYPE_ROMONLY:
-            mbc.type = MBC_TYPE_NOMBC;
-            break;
+        emulator.scaled_texture = SDL_CreateTexture(emulator.renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, LCD_WIDTH * factor, LCD_HEIGHT * factor);
 
-        case ROM_CARTRIDGE_TYPE_MBC1:
-        case ROM_CARTRIDGE_TYPE_MBC1RAM:
-        case ROM_CARTRIDGE_TYPE_MBC1RAMBAT:
-            mbc.type = MBC_TYPE_MBC1;
-            break;
+        if (!emulator.scaled_texture) {
+            printf("Unable to create texture!\n");
+            exit(-1);
+        }
 
-        case ROM_CARTRIDGE_TYPE_MBC2:
-        case ROM_CARTRIDGE_TYPE_MBC2BAT:
-            mbc.type = MBC_TYPE_MBC2;
-            break;
+        emulator.scaled_factor = factor;
+    }
 
-        case ROM_CARTRIDGE_TYPE_MBC3TIMERBAT:
-        case ROM_CARTRIDGE_TYPE_MBC3TIMERRAMBAT:
-        case ROM_CARTRIDGE_TYPE_MBC3:
-        case ROM_CARTRIDGE_TYPE_MBC3RAM:
-        case ROM_CARTRIDGE_TYPE_MBC3RAMBAT:
-            mbc.type = MBC_TYPE_MBC3;
-            break;
+    bool dirty = false;
 
-        default:
-            mbc.type = MBC_TYPE_NOMBC;
-            break;
+    for (int i=0; i < LCD_DIRTY_WORDS; i++) {
+        dirty |= (dirty_lines[i] != 0);
     }
 
-    // ROM banks
-    emulator.rom_info.rom_banks = 2 << emulator.rom[ROM_ROM_SIZE_OFFSET];
-    mbc.rom_banks = emulator.rom_info.rom_banks;
-    mbc.rom = (uint8_t *) malloc(0x4000 * mbc.rom_banks);
-    memcpy(mbc.rom, emulator.rom, size);
-
-    // RAM banks
-    switch(emulator.rom[ROM_RAM_SIZE_OFFSET]) {
-        // No RAM
-        case 0x00:
-            emulator.rom_info.ram_banks = 0;
-            break;
+    // Scaler output depends on the neighbours, just redo the whole frame if anything changed
+    if (dirty) {
+        void* pixels_ptr;
+        int pitch;
+        SDL_LockTexture(emulator.scaled_texture, NULL, &pixels_ptr, &pitch);
+        scale_frame(frame->pixels, (uint32_t *) pixels_ptr, pitch / sizeof(uint32_t));
+        SDL_UnlockTexture(emulator.scaled_texture);
+    }
 
-        // 1 bank
-        case 0x02:
-            emulator.rom_info.ram_banks = 1;
-            break;
+    SDL_RenderCopy(emulator.renderer, emulator.scaled_texture, NULL, NULL);
+    SDL_RenderPresent(emulator.renderer);
+}
 
-        // 4 banks
-        case 0x03:
-            emulator.rom_info.ram_banks = 4;
-            break;
+void render(video_frame_t *frame, const uint32_t *dirty_lines)
+{
+    ZONE("render");
 
-        // 16 banks
-        case 0x04:
-            emulator.rom_info.ram_banks = 16;
-            break;
+    static const scale_filter_t *rendered_filter = NULL;
+    uint32_t all_lines[LCD_DIRTY_WORDS];
 
-        // 8 banks
-        case 0x05:
-            emulator.rom_info.ram_banks = 8;
-            break;
+    // The textures are stale after switching filters
+    if (rendered_filter != scale.filter) {
+        memset(all_lines, 0xFF, sizeof(all_lines));
+        dirty_lines = all_lines;
+        rendered_filter = scale.filter;
     }
 
-    mbc.ram_banks = emulator.rom_info.ram_banks;
-    mbc.ram = (uint8_t *) malloc(0x2000 * mbc.ram_banks);
-
-    mbc_init();
-}
+    if (scale.filter->func) {
+        render_scaled(frame, dirty_lines);
+        return;
+    }
 
-void render()
-{
     /*
     for (int window_y=0; window_y < LCD_HEIGHT * LCD_SCALE; window_y++) {
         for (int window_x=0; window_x < LCD_WIDTH * LCD_SCALE; window_x++) {
@@ -142,21 +79,37 @@ void render()
     }
     */
 
-    handle_events();
+    // Only upload runs of rows that changed since the last presented frame
+    for (int y=0; y < LCD_HEIGHT; y++) {
+        if (!video_line_dirty(dirty_lines, y)) {
+            continue;
+        }
 
-    void* pixels_ptr;
-    int pitch;
-    SDL_LockTexture(emulator.texture, NULL, &pixels_ptr, &pitch);
+        int rows = 1;
 
-    uint32_t *pixels = (uint32_t *) pixels_ptr;
+        while (y + rows < LCD_HEIGHT && video_line_dirty(dirty_lines, y + rows)) {
+            rows++;
+        }
 
-    for (int y=0; y < LCD_HEIGHT; y++) {
-        for (int x=0; x < LCD_WIDTH; x++) {
-            pixels[y * LCD_WIDTH + x] = default_palette[lcd.color_buffer[y * LCD_WIDTH + x]];
+        SDL_Rect rect = { 0, y, LCD_WIDTH, rows };
+
+        void* pixels_ptr;
+        int pitch;
+        SDL_LockTexture(emulator.texture, &rect, &pixels_ptr, &pitch);
+
+        for (int row=0; row < rows; row++) {
+            uint32_t *pixels = (uint32_t *) ((uint8_t *) pixels_ptr + row * pitch);
+            const uint16_t *colors = &frame->pixels[(y + row) * LCD_WIDTH];
+
+            for (int x=0; x < LCD_WIDTH; x++) {
+                pixels[x] = video_colors[colors[x] & (VIDEO_COLOR_COUNT - 1)];
+            }
         }
-    }
 
-    SDL_UnlockTexture(emulator.texture);
+        SDL_UnlockTexture(emulator.texture);
+
+        y += rows;
+    }
 
     SDL_RenderCopy(emulator.renderer, emulator.texture, NULL, NULL);
     SDL_RenderPresent(emulator.renderer);
@@ -164,14 +117,46 @@ void render()
 
 void handle_events()
 {
+    ZONE("handle_events");
+
     // Handle SDL events
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
         switch(event.type) {
             case SDL_QUIT:
-                emulator.running = false;
+                SDL_AtomicSet(&emulator.running, 0);
                 break;
             case SDL_KEYDOWN:
+                // Hotkeys
+                if (event.key.keysym.scancode == SDL_SCANCODE_F1) {
+                    if (!event.key.repeat) {
+                        scale_next();
+                    }
+                    break;
+                }
+
+                if (event.key.keysym.scancode == SDL_SCANCODE_F5) {
+                    if (!event.key.repeat) {
+                        if (SDL_AtomicGet(&debugger.paused)) {
+                            debug_continue();
+                        } else {
+                            debug_pause();
+                        }
+                    }
+                    break;
+                }
+
+                if (event.key.keysym.scancode == SDL_SCANCODE_F10) {
+                    if (SDL_AtomicGet(&debugger.paused)) {
+                        debug_step();
+                    } else {
+                        debug_pause();
+                    }
+                    break;
+                }
+
+                input_handle(&event.key);
+                break;
             case SDL_KEYUP:
                 input_handle(&event.key);
                 break;
@@ -181,8 +166,448 @@ void handle_events()
     }
 }
 
+static const struct option options[] = {
+    { "ppu",    required_argument,  NULL, 'p' },
+    { "bench",  required_argument,  NULL, 'b' },
+    { "hash",   required_argument,  NULL, 'H' },
+    { "test",   required_argument,  NULL, 'T' },
+    { "filter", required_argument,  NULL, 'f' },
+    { "capture-video",  required_argument,  NULL, 'v' },
+    { "capture-audio",  required_argument,  NULL, 'a' },
+    { "trace",  required_argument,  NULL, 't' },
+    { "profile", required_argument, NULL, 'P' },
+    { "zones",  required_argument,  NULL, 'z' },
+    { "log",    required_argument,  NULL, 'l' },
+    { "break",  required_argument,  NULL, 'B' },
+    { "watch",  required_argument,  NULL, 'w' },
+    { "gdb",    required_argument,  NULL, 'g' },
+    { "sym",    required_argument,  NULL, 's' },
+    { "rtc",    required_argument,  NULL, 'c' },
+    { "record", required_argument,  NULL, 'r' },
+    { "replay", required_argument,  NULL, 'R' },
+    { "gamedb", required_argument,  NULL, 'D' },
+    { "help",   no_argument,        NULL, 'h' },
+    { NULL,     0,                  NULL, 0 }
+};
+
+void usage(const char *name)
+{
+    printf("Usage: %s [options] rom.gb\n", name);
+    printf("  --ppu <scanline|fifo>  PPU engine (default: scanline)\n");
+    printf("  --bench <frames>       Run every PPU engine headless for the given frames and report the speed\n");
+    printf("  --hash <frame,...>     Run headless and print screen and state hashes at each frame (with --replay for input)\n");
+    printf("  --test <frames>        Run a blargg or mooneye test ROM headless for at most the given frames, exits with 0 (passed), 1 (failed) or 2 (timeout)\n");
+    printf("  --filter <name>        Upscaling filter: none, nearest, scale2x, scale3x, xbr, crt (F1 cycles)\n");
+    printf("  --capture-video <file> Stream every frame as Y4M into a file or named pipe\n");
+    printf("  --capture-audio <file> Stream the audio as float WAV into a file or named pipe\n");
+    printf("  --trace <file>         Record a binary instruction trace, see tools/tracedump.c\n");
+    printf("  --profile <prefix>     Profile opcodes, addresses and calls into <prefix>.txt and <prefix>.folded\n");
+    printf("  --zones <file.json>    Record timing zones of the hot paths for about:tracing / Perfetto\n");
+    printf("  --log <module=level>   Comma separated log levels (off, error, warn, info, debug, trace) for cpu, mmu, lcd, timer, sound, mbc, input, serial or all\n");
+    printf("  --rtc <host|emulated>  Time source of the MBC3 clock (default: host, emulated for --record, --replay, --hash and --test)\n");
+    printf("  --sym <file>           RGBDS symbols for disassembly, profiles and breakpoints (default: <rom>.sym if present)\n");
+    printf("  --break <addr>         Pause before executing the hex address or symbol (F5 continues, F10 steps), can be repeated\n");
+    printf("  --watch <start[-end][:r|w|rw]>  Pause on reads and/or writes in the hex address or symbol range, can be repeated\n");
+    printf("  --gdb <port|socket>    Wait for a gdb remote debugger on a localhost port or UNIX socket\n");
+    printf("  --record <file>        Record the joypad from power-on into an input movie\n");
+    printf("  --replay <file>        Replay an input movie headless and check the final state, exits with 1 on a mismatch\n");
+    printf("  --gamedb <file>        Cartridge database with header fixes and PPU engines per ROM (default: ~/.local/share/gameboy-emulator/gamedb.txt)\n");
+}
+
+/* An explicit file has to exist, otherwise <rom>.sym is picked up if it's there */
+void load_symbols(const char *sym_path, const char *rom_path)
+{
+    char path[1024];
+
+    if (sym_path) {
+        if (!symbols_load(sym_path)) {
+            printf("Unable to open %s\n", sym_path);
+            exit(-1);
+        }
+
+        printf("[emulator] Loaded symbols from %s\n", sym_path);
+        return;
+    }
+
+    if (!rom_path) {
+        return;
+    }
+
+    snprintf(path, sizeof(path), "%s", rom_path);
+
+    char *extension = strrchr(path, '.');
+
+    if (extension && !strchr(extension, '/')) {
+        *extension = '\0';
+    }
+
+    strncat(path, ".sym", sizeof(path) - strlen(path) - 1);
+
+    if (symbols_load(path)) {
+        printf("[emulator] Loaded symbols from %s\n", path);
+    }
+}
+
+/* Runs the same ROM on each PPU engine, without video or audio output */
+void bench(uint32_t frames)
+{
+    double real_time_fps = (double) CYCLES_PER_SECOND / CYCLES_PER_FRAME;
+
+    for (int i=0; i < LCD_ENGINE_COUNT; i++) {
+        lcd_select_engine(lcd_engines[i]->name);
+        emulator_reset();
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        emulator_run_frames(frames);
+        double seconds = (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+        printf("[bench] %-8s %u frames in %.3fs | %.1f fps | %.2fx real time\n",
+                lcd_engines[i]->name,
+                frames,
+                seconds,
+                frames / seconds,
+                frames / seconds / real_time_fps
+            );
+    }
+
+    // Cost of each upscaling filter on the last frame
+    scale_init();
+    scale_bench(lcd.color_buffer, frames);
+    scale_quit();
+}
+
+/* Prints hashes of the screen and the whole state at each frame, for tools/regress.c */
+int checkpoints(const char *list)
+{
+    uint32_t frame = 0;
+    uint64_t start = SDL_GetPerformanceCounter();
+    const char *p = list;
+
+    while (*p) {
+        char *end;
+        uint32_t checkpoint = strtoul(p, &end, 10);
+
+        if (end == p || checkpoint < frame || (*end && *end != ',')) {
+            printf("Invalid checkpoints: %s\n", list);
+            return -1;
+        }
+
+        emulator_run_frames(checkpoint - frame);
+        frame = checkpoint;
+
+        printf("[hash] %u %016llx %016llx\n",
+                frame,
+                (unsigned long long) movie_hash(0, lcd.color_buffer, sizeof(lcd.color_buffer)),
+                (unsigned long long) movie_state_hash()
+            );
+
+        p = *end ? end + 1 : end;
+    }
+
+    double seconds = (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    printf("[hash] time %.3f\n", seconds);
+
+    return 0;
+}
+
+/* Blargg's tests print their result on the serial port, mooneye's end with LD B,B and Fibonacci numbers in the registers */
+int test_result()
+{
+    if (serial.output_length) {
+        if (strstr(serial.output, "Passed")) {
+            return 0;
+        }
+
+        if (strstr(serial.output, "Failed")) {
+            return 1;
+        }
+    }
+
+    if (cpu.software_break) {
+        cpu.software_break = false;
+
+        if (cpu.regs.b == 3 && cpu.regs.c == 5 && cpu.regs.d == 8 && cpu.regs.e == 13 && cpu.regs.h == 21 && cpu.regs.l == 34) {
+            return 0;
+        }
+
+        if (cpu.regs.b == 0x42 && cpu.regs.c == 0x42 && cpu.regs.d == 0x42 && cpu.regs.e == 0x42 && cpu.regs.h == 0x42 && cpu.regs.l == 0x42) {
+            return 1;
+        }
+    }
+
+    return -1;
+}
+
+/* Runs a test ROM headless until it reports a result, returns 0 if it passed, 1 if it failed and 2 on a timeout */
+int run_test(uint32_t frames)
+{
+    uint64_t cycles = (uint64_t) frames * CYCLES_PER_FRAME;
+    uint64_t start = SDL_GetPerformanceCounter();
+    uint32_t checked = 0;
+    int result = -1;
+
+    while (emulator.total_cycles < cycles && !cpu.stopped && !debugger.hit) {
+        emulator_step();
+
+        if (serial.output_length == checked && !cpu.software_break) {
+            continue;
+        }
+
+        checked = serial.output_length;
+
+        if ((result = test_result()) >= 0) {
+            // Blargg's tests print details after the verdict, e.g. the number of failed tests
+            cycles = emulator.total_cycles + CYCLES_PER_FRAME * 10;
+            break;
+        }
+    }
+
+    while (result >= 0 && emulator.total_cycles < cycles && !cpu.stopped && !debugger.hit) {
+        emulator_step();
+    }
+
+    double seconds = (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+    if (serial.output_length) {
+        printf("%s\n", serial.output);
+    }
+
+    if (result < 0) {
+        result = 2;
+    }
+
+    printf("[test] %s after %u frames in %.3fs\n",
+            (result == 0) ? "Passed" : (result == 1) ? "Failed" : "Timeout",
+            (uint32_t) (emulator.total_cycles / CYCLES_PER_FRAME),
+            seconds
+        );
+
+    return result;
+}
+
 int main(int argc, char *argv[])
-{    
+{
+    uint32_t bench_frames = 0;
+    const char *hash_frames = NULL;
+    uint32_t test_frames = 0;
+    const char *capture_video = NULL;
+    const char *capture_audio = NULL;
+    const char *trace_path = NULL;
+    const char *profile_prefix = NULL;
+    const char *zones_path = NULL;
+    const char *gdb_address = NULL;
+    const char *sym_path = NULL;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    const char *break_args[DEBUG_MAX_POINTS];
+    const char *watch_args[DEBUG_MAX_POINTS];
+    int break_count = 0;
+    int watch_count = 0;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch(option) {
+            case 'p':
+                if (!lcd_select_engine(optarg)) {
+                    printf("Unknown PPU engine: %s\n", optarg);
+                    exit(-1);
+                }
+
+                rom_config.ppu_selected = true;
+                break;
+
+            case 'b':
+                bench_frames = strtoul(optarg, NULL, 10);
+                break;
+
+            case 'H':
+                hash_frames = optarg;
+                break;
+
+            case 'T':
+                test_frames = strtoul(optarg, NULL, 10);
+                break;
+
+            case 'f':
+                if (!scale_select(optarg)) {
+                    printf("Unknown filter: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case 'l':
+                if (!log_configure(optarg)) {
+                    printf("Invalid log levels: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case 'B':
+                if (break_count < DEBUG_MAX_POINTS) {
+                    break_args[break_count++] = optarg;
+                }
+                break;
+
+            case 'w':
+                if (watch_count < DEBUG_MAX_POINTS) {
+                    watch_args[watch_count++] = optarg;
+                }
+                break;
+
+            case 's':
+                sym_path = optarg;
+                break;
+
+            case 'c':
+                if (strcmp(optarg, "host") == 0) {
+                    mbc.rtc_source = MBC_RTC_HOST;
+                } else if (strcmp(optarg, "emulated") == 0) {
+                    mbc.rtc_source = MBC_RTC_EMULATED;
+                } else {
+                    printf("Unknown RTC source: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+
+            case 'r':
+                record_path = optarg;
+                break;
+
+            case 'R':
+                replay_path = optarg;
+                break;
+
+            case 'D':
+                rom_config.db_path = optarg;
+                break;
+
+            case 'g':
+                gdb_address = optarg;
+                break;
+
+            case 't':
+                trace_path = optarg;
+                break;
+
+            case 'P':
+                profile_prefix = optarg;
+                break;
+
+            case 'z':
+                zones_path = optarg;
+                break;
+
+            case 'v':
+                capture_video = optarg;
+                break;
+
+            case 'a':
+                capture_audio = optarg;
+                break;
+
+            default:
+                usage(argv[0]);
+                exit(option == 'h' ? 0 : -1);
+        }
+    }
+
+    const char *rom_path = (optind < argc) ? argv[optind] : NULL;
+
+    log_init();
+    load_symbols(sym_path, rom_path);
+
+    // Runs that have to be repeatable can't depend on the wall clock
+    if (record_path || replay_path || hash_frames || test_frames || bench_frames) {
+        mbc.rtc_source = MBC_RTC_EMULATED;
+    }
+
+    // Parsed once the symbols are known, they can name addresses
+    for (int i=0; i < break_count; i++) {
+        if (!debug_parse_break(break_args[i])) {
+            printf("Invalid breakpoint: %s\n", break_args[i]);
+            exit(-1);
+        }
+    }
+
+    for (int i=0; i < watch_count; i++) {
+        if (!debug_parse_watch(watch_args[i])) {
+            printf("Invalid watchpoint: %s\n", watch_args[i]);
+            exit(-1);
+        }
+    }
+
+    if (bench_frames) {
+        if (!rom_path) {
+            usage(argv[0]);
+            exit(-1);
+        }
+
+        emulator_reset();
+        load_rom(rom_path);
+        bench(bench_frames);
+
+        return 0;
+    }
+
+    if (test_frames) {
+        if (!rom_path) {
+            usage(argv[0]);
+            exit(-1);
+        }
+
+        emulator_reset();
+        load_rom(rom_path);
+
+        return run_test(test_frames);
+    }
+
+    if (hash_frames) {
+        if (!rom_path) {
+            usage(argv[0]);
+            exit(-1);
+        }
+
+        emulator_reset();
+        load_rom(rom_path);
+
+        // Only the inputs are taken from the movie, the checkpoints decide when to stop
+        if (replay_path) {
+            movie_play(replay_path);
+        }
+
+        return checkpoints(hash_frames);
+    }
+
+    // Fixed workload, the trace and profile can be taken of it too
+    if (replay_path) {
+        if (!rom_path) {
+            usage(argv[0]);
+            exit(-1);
+        }
+
+        emulator_reset();
+        load_rom(rom_path);
+        movie_play(replay_path);
+
+        if (trace_path) {
+            trace_start(trace_path);
+        }
+
+        if (profile_prefix) {
+            profile_start();
+        }
+
+        int result = movie_replay();
+
+        trace_stop();
+
+        if (profile_prefix) {
+            profile_dump(profile_prefix);
+        }
+
+        return result;
+    }
+
     // Init SDL
     if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) == -1) {
         printf("Unable to init SDL!\n");
@@ -223,36 +648,82 @@ int main(int argc, char *argv[])
 
     SDL_PauseAudioDevice(emulator.audiodev_id, 0);
 
+    scale_init();
+
     // Init emulator
-    cpu_init();
-    mmu_init();
-    lcd_init();
-    input_init();
-    sound_init();
+    emulator_reset();
 
-    if (argc != 1) {
-        load_rom(argv[1]);
+    if (rom_path) {
+        load_rom(rom_path);
     }
 
-    emulator.running = true;
-    uint32_t last_cycles = 0;
-    while (emulator.running) {
-        uint64_t start = SDL_GetPerformanceCounter();
-        
-		//SDL_RenderClear(emulator.renderer);
+    // A recording starts from power-on, it can't carry over a save
+    if (rom_path && !record_path) {
+        save_start(rom_path);
+    }
+
+    capture_start(capture_video, capture_audio);
 
-        if (cpu.stopped || !lcd.regs.control.fields.lcd_ppu_enable) {
-            handle_events();
+    if (record_path) {
+        movie_record(record_path);
+    }
+
+    if (trace_path) {
+        trace_start(trace_path);
+    }
+
+    if (profile_prefix) {
+        profile_start();
+    }
+
+    if (zones_path) {
+        zone_thread("main");
+        zones_start();
+    }
+
+    // Emulation runs on its own thread, this one only presents frames and pumps events
+    SDL_AtomicSet(&emulator.running, 1);
+
+    if (gdb_address) {
+        gdb_start(gdb_address);
+    }
+
+    emulator.thread = SDL_CreateThread(emulator_run, "emulator", NULL);
+
+    if (!emulator.thread) {
+        printf("Unable to create emulator thread!\n");
+        exit(-1);
+    }
+
+    while (SDL_AtomicGet(&emulator.running)) {
+        handle_events();
+
+        uint32_t dirty_lines[LCD_DIRTY_WORDS];
+        video_frame_t *frame = video_acquire(dirty_lines);
+
+        if (frame) {
+            render(frame, dirty_lines);
+        } else {
+            SDL_Delay(1);
         }
+    }
+
+    SDL_WaitThread(emulator.thread, NULL);
+    gdb_stop();
+    movie_stop();
+    save_stop();
+    capture_stop();
+    trace_stop();
+
+    if (profile_prefix) {
+        profile_dump(profile_prefix);
+    }
 
-        cpu_step();
-        timer_tick(cpu.cycles - last_cycles);
-        cpu_serve_interrupts();
-        lcd_step(cpu.cycles - last_cycles);
-        sound_step(cpu.cycles - last_cycles);
-        last_cycles = cpu.cycles;
+    scale_quit();
+    scale_report();
 
-        uint64_t end = SDL_GetPerformanceCounter();
+    if (zones_path) {
+        zones_dump(zones_path);
     }
 
     SDL_CloseAudioDevice(emulator.audiodev_id);
@@ -1,77 +1,433 @@
 #include "emulator.h"
 
+#include <time.h>
+
 #ifdef MBC_DEBUG
-#define DEBUG_MBC(...) printf("[mbc] "); printf(__VA_ARGS__)
+#define DEBUG_MBC(...) LOG(LOG_MBC, LOG_LEVEL_DEBUG, __VA_ARGS__)
 #endif
 
 mbc_t mbc;
 
-void mbc_init()
+/* Unmapped or disabled areas read as FF, writes to them are dropped */
+static uint8_t open_bus[0x2000];
+static uint8_t discarded[0x2000];
+
+/* Every byte is the selected RTC register, so reads stay a page lookup */
+static uint8_t rtc_page[0x2000];
+
+static uint64_t rtc_now()
+{
+    return (mbc.rtc_source == MBC_RTC_HOST) ? (uint64_t) time(NULL) : emulator.total_cycles;
+}
+
+static uint64_t rtc_rate()
+{
+    return (mbc.rtc_source == MBC_RTC_HOST) ? 1 : CYCLES_PER_SECOND;
+}
+
+static uint64_t rtc_seconds()
 {
-    if (mbc.type == MBC_TYPE_MBC1) {
-        mbc.rom_bank = 0x01;
+    if (mbc.rtc.halted) {
+        return mbc.rtc.base;
     }
+
+    return mbc.rtc.base + (rtc_now() - mbc.rtc.reference) / rtc_rate();
 }
 
-uint8_t mbc_rb(uint16_t addr)
+/* Restarts the clock at the given time, the 9 bit day counter overflows into the carry flag */
+static void rtc_set(uint64_t seconds)
 {
-    uint8_t result = 0;
+    uint64_t days = seconds / 86400;
 
-    if (mbc.type == MBC_TYPE_MBC1) {
-        if (addr <= 0x3FFF) {
-            if (mbc.banking_mode == 0) {
-                result = mbc.rom[addr];
-            } else if (mbc.banking_mode == 1) {
-                if (mbc.rom_bank == 0x20 || mbc.rom_bank == 0x40 || mbc.rom_bank == 0x60) {
-                    result = mbc.rom[0x4000 * mbc.rom_bank + addr];
-                }
-            }
-        } else if (addr >= 0x4000 && addr <= 0x7FFF) {
-            uint8_t rom_bank = (mbc.ram_bank << 5) + mbc.rom_bank;
+    if (days >= 512) {
+        mbc.rtc.carry = true;
+        seconds -= (days / 512) * 512 * 86400;
+    }
 
-            if (!mbc.rom_bank) {
-                rom_bank++;
-            }
+    mbc.rtc.base = seconds;
+    mbc.rtc.reference = rtc_now();
+}
+
+/* Little endian, as other emulators store the clock */
+static void put_le(uint8_t *p, uint64_t value, int size)
+{
+    for (int i=0; i < size; i++) {
+        p[i] = (uint8_t) (value >> (i * 8));
+    }
+}
 
-            // Switchable rom bank
-            result = mbc.rom[0x4000 * rom_bank + (addr - 0x4000)];
-        } else if (addr >= 0xA000 && addr <= 0xBFFF) {
-            if (mbc.ram_enabled) {
-                result = mbc.ram[0x2000 * (mbc.ram_bank & 3) + (addr - 0x4000)];
+static uint64_t get_le(const uint8_t *p, int size)
+{
+    uint64_t value = 0;
+
+    for (int i=0; i < size; i++) {
+        value |= (uint64_t) p[i] << (i * 8);
+    }
+
+    return value;
+}
+
+/* Live and latched registers as u32 each, then the host time they were saved at */
+void mbc_rtc_store()
+{
+    uint64_t seconds = rtc_seconds();
+    uint32_t days = (uint32_t) (seconds / 86400);
+    uint8_t *p = mbc.rtc_file;
+
+    put_le(&p[0], seconds % 60, 4);
+    put_le(&p[4], (seconds / 60) % 60, 4);
+    put_le(&p[8], (seconds / 3600) % 24, 4);
+    put_le(&p[12], days & 0xFF, 4);
+    put_le(&p[16], ((days >> 8) & MBC_RTC_DAY_HIGH)
+                    | (mbc.rtc.halted ? MBC_RTC_HALT : 0)
+                    | (mbc.rtc.carry ? MBC_RTC_DAY_CARRY : 0), 4);
+
+    for (int i=0; i < 5; i++) {
+        put_le(&p[20 + i * 4], mbc.rtc.latched[i], 4);
+    }
+
+    put_le(&p[40], (uint64_t) time(NULL), 8);
+
+    save_written(mbc.rtc_file - save.data, SAVE_RTC_SIZE);
+}
+
+/* A host clock catches up on the time the emulator was closed, an emulated one can't */
+static void rtc_load()
+{
+    const uint8_t *p = mbc.rtc_file;
+    uint8_t high = (uint8_t) get_le(&p[16], 4);
+    uint64_t days = (get_le(&p[12], 4) & 0xFF) | ((high & MBC_RTC_DAY_HIGH) << 8);
+    uint64_t seconds = ((days * 24 + (get_le(&p[8], 4) % 24)) * 60 + (get_le(&p[4], 4) % 60)) * 60 + (get_le(&p[0], 4) % 60);
+    uint64_t saved = get_le(&p[40], 8);
+    uint64_t now = (uint64_t) time(NULL);
+
+    mbc.rtc.halted = high & MBC_RTC_HALT;
+    mbc.rtc.carry = high & MBC_RTC_DAY_CARRY;
+
+    // 0 is a new save
+    if (mbc.rtc_source == MBC_RTC_HOST && !mbc.rtc.halted && saved && now > saved) {
+        seconds += now - saved;
+    }
+
+    rtc_set(seconds);
+
+    for (int i=0; i < 5; i++) {
+        mbc.rtc.latched[i] = (uint8_t) get_le(&p[20 + i * 4], 4);
+    }
+}
+
+static void rtc_latch()
+{
+    rtc_set(rtc_seconds());
+
+    uint64_t seconds = mbc.rtc.base;
+    uint32_t days = (uint32_t) (seconds / 86400);
+
+    mbc.rtc.latched[MBC_RTC_SECONDS] = seconds % 60;
+    mbc.rtc.latched[MBC_RTC_MINUTES] = (seconds / 60) % 60;
+    mbc.rtc.latched[MBC_RTC_HOURS] = (seconds / 3600) % 24;
+    mbc.rtc.latched[MBC_RTC_DAYS_LOW] = days & 0xFF;
+    mbc.rtc.latched[MBC_RTC_DAYS_HIGH] = ((days >> 8) & MBC_RTC_DAY_HIGH)
+                                        | (mbc.rtc.halted ? MBC_RTC_HALT : 0)
+                                        | (mbc.rtc.carry ? MBC_RTC_DAY_CARRY : 0);
+
+    if (mbc.rtc_file) {
+        mbc_rtc_store();
+    }
+}
+
+static void rtc_write(uint8_t reg, uint8_t data)
+{
+    uint64_t seconds = rtc_seconds();
+    uint64_t days = seconds / 86400;
+    uint64_t hours = (seconds / 3600) % 24;
+    uint64_t minutes = (seconds / 60) % 60;
+
+    seconds %= 60;
+
+    switch(reg) {
+        case MBC_RTC_SECONDS:
+            seconds = data & 0x3F;
+            break;
+
+        case MBC_RTC_MINUTES:
+            minutes = data & 0x3F;
+            break;
+
+        case MBC_RTC_HOURS:
+            hours = data & 0x1F;
+            break;
+
+        case MBC_RTC_DAYS_LOW:
+            days = (days & 0x100) | data;
+            break;
+
+        case MBC_RTC_DAYS_HIGH:
+            days = (days & 0xFF) | ((data & MBC_RTC_DAY_HIGH) << 8);
+            mbc.rtc.carry = data & MBC_RTC_DAY_CARRY;
+            mbc.rtc.halted = data & MBC_RTC_HALT;
+            break;
+    }
+
+    rtc_set(((days * 24 + hours) * 60 + minutes) * 60 + seconds);
+
+    // Read back as written until the next latch
+    mbc.rtc.latched[reg] = data;
+
+    if (mbc.rtc_file) {
+        mbc_rtc_store();
+    }
+}
+
+/* Recomputes the pages from the banking registers and RAM storage, so accesses don't have to */
+void mbc_map()
+{
+    uint32_t rom0 = 0;
+    uint32_t romx = 1;
+    uint32_t ram = 0;
+
+    switch(mbc.type) {
+        case MBC_TYPE_MBC1:
+            // The RAM bank register doubles as the upper ROM bank bits
+            romx = ((mbc.ram_bank & 3) << 5) | mbc.rom_bank;
+
+            if (mbc.banking_mode == 1) {
+                rom0 = (mbc.ram_bank & 3) << 5;
+                ram = mbc.ram_bank & 3;
             }
+            break;
+
+        case MBC_TYPE_MBC2:
+        case MBC_TYPE_MBC3:
+        case MBC_TYPE_MBC5:
+            romx = mbc.rom_bank;
+            ram = mbc.ram_bank;
+            break;
+    }
+
+    if (mbc.rom_banks) {
+        rom0 %= mbc.rom_banks;
+        romx %= mbc.rom_banks;
+    }
+
+    mbc.rom0_bank = rom0;
+    mbc.romx_bank = romx;
+
+    for (int i=0; i < 8; i++) {
+        mbc.read_pages[i] = open_bus;
+    }
+
+    if (mbc.rom) {
+        mbc.read_pages[0] = &mbc.rom[rom0 * 0x4000];
+        mbc.read_pages[1] = &mbc.rom[rom0 * 0x4000 + 0x2000];
+        mbc.read_pages[2] = &mbc.rom[romx * 0x4000];
+        mbc.read_pages[3] = &mbc.rom[romx * 0x4000 + 0x2000];
+    }
+
+    mbc.ram_write = discarded;
+
+    // MBC2 mirrors its nibbles and saves track what changed, the clock sets this to false below
+    mbc.ram_direct = (mbc.type != MBC_TYPE_MBC2 && !save.enabled);
+
+    if (!mbc.ram_enabled) {
+        return;
+    }
+
+    // RTC writes are handled by mbc_wb, ram_write stays on the discarded page
+    if (mbc.type == MBC_TYPE_MBC3 && ram >= 0x08) {
+        mbc.ram_direct = false;
+
+        if (ram <= 0x0C) {
+            memset(rtc_page, mbc.rtc.latched[ram - 0x08], sizeof(rtc_page));
+            mbc.read_pages[5] = rtc_page;
+        }
+
+        return;
+    }
+
+    if (mbc.ram && mbc.ram_banks) {
+        mbc.ram_write = &mbc.ram[(ram % mbc.ram_banks) * 0x2000];
+        mbc.read_pages[5] = mbc.ram_write;
+    }
+}
+
+void mbc_init()
+{
+    mbc.rom_bank = 0x01;
+    mbc.ram_bank = 0x00;
+    mbc.banking_mode = 0;
+    mbc.ram_enabled = false;
+
+    memset(&mbc.rtc, 0x00, sizeof(mbc_rtc_t));
+    mbc.rtc.reference = rtc_now();
+    mbc.rtc.latch = 0xFF;
+
+    // The battery keeps the clock across resets
+    if (mbc.rtc_file) {
+        rtc_load();
+    }
+
+    memset(open_bus, 0xFF, sizeof(open_bus));
+    mbc_map();
+}
+
+static void mbc1_wb(uint16_t addr, uint8_t data)
+{
+    if (addr <= 0x1FFF) {
+        mbc.ram_enabled = (data & 0xF) == 0xA; 
+
+        DEBUG_MBC("MBC1: %s RAM\n", mbc.ram_enabled ? "Enabled" : "Disabled");
+    } else if (addr >= 0x2000 && addr <= 0x3FFF) {
+        // Bank 0 can't be selected, 20/40/60 map 21/41/61
+        mbc.rom_bank = (data & 0x1F) ? (data & 0x1F) : 1;
+
+        DEBUG_MBC("MBC1: Selected rom bank: %d\n", mbc.rom_bank);
+    } else if (addr >= 0x4000 && addr <= 0x5FFF) {
+        mbc.ram_bank = data & 3;
+
+        DEBUG_MBC("MBC1: Selected ram bank: %d\n", mbc.ram_bank);
+    } else if (addr >= 0x6000 && addr <= 0x7FFF) {
+        mbc.banking_mode = data & 0x01;
+
+        DEBUG_MBC("MBC1: Set banking mode: %d\n", mbc.banking_mode);
+    }
+}
+
+/* Address bit 8 tells the two registers apart */
+static void mbc2_wb(uint16_t addr, uint8_t data)
+{
+    if (addr > 0x3FFF) {
+        return;
+    }
+
+    if (!(addr & 0x100)) {
+        mbc.ram_enabled = (data & 0xF) == 0xA;
+
+        DEBUG_MBC("MBC2: %s RAM\n", mbc.ram_enabled ? "Enabled" : "Disabled");
+    } else {
+        mbc.rom_bank = (data & 0x0F) ? (data & 0x0F) : 1;
+
+        DEBUG_MBC("MBC2: Selected rom bank: %d\n", mbc.rom_bank);
+    }
+}
+
+static void mbc3_wb(uint16_t addr, uint8_t data)
+{
+    if (addr <= 0x1FFF) {
+        mbc.ram_enabled = (data & 0xF) == 0xA;
+
+        DEBUG_MBC("MBC3: %s RAM and RTC\n", mbc.ram_enabled ? "Enabled" : "Disabled");
+    } else if (addr >= 0x2000 && addr <= 0x3FFF) {
+        mbc.rom_bank = (data & 0x7F) ? (data & 0x7F) : 1;
+
+        DEBUG_MBC("MBC3: Selected rom bank: %d\n", mbc.rom_bank);
+    } else if (addr >= 0x4000 && addr <= 0x5FFF) {
+        mbc.ram_bank = data & 0x0F;
+
+        DEBUG_MBC("MBC3: Selected ram bank / RTC register: %02X\n", mbc.ram_bank);
+    } else if (addr >= 0x6000 && addr <= 0x7FFF) {
+        if (mbc.rtc.latch == 0x00 && data == 0x01) {
+            rtc_latch();
+
+            DEBUG_MBC("MBC3: Latched RTC %02X:%02X:%02X day %d\n",
+                    mbc.rtc.latched[MBC_RTC_HOURS],
+                    mbc.rtc.latched[MBC_RTC_MINUTES],
+                    mbc.rtc.latched[MBC_RTC_SECONDS],
+                    mbc.rtc.latched[MBC_RTC_DAYS_LOW] | ((mbc.rtc.latched[MBC_RTC_DAYS_HIGH] & 1) << 8)
+                );
         }
+
+        mbc.rtc.latch = data;
     }
+}
+
+static void mbc5_wb(uint16_t addr, uint8_t data)
+{
+    if (addr <= 0x1FFF) {
+        mbc.ram_enabled = (data == 0x0A);
+
+        DEBUG_MBC("MBC5: %s RAM\n", mbc.ram_enabled ? "Enabled" : "Disabled");
+    } else if (addr >= 0x2000 && addr <= 0x2FFF) {
+        // Unlike the others bank 0 can be mapped at 4000 too
+        mbc.rom_bank = (mbc.rom_bank & 0x100) | data;
+
+        DEBUG_MBC("MBC5: Selected rom bank: %d\n", mbc.rom_bank);
+    } else if (addr >= 0x3000 && addr <= 0x3FFF) {
+        mbc.rom_bank = (mbc.rom_bank & 0xFF) | ((data & 1) << 8);
 
-    return result;
+        DEBUG_MBC("MBC5: Selected rom bank: %d\n", mbc.rom_bank);
+    } else if (addr >= 0x4000 && addr <= 0x5FFF) {
+        mbc.ram_bank = data & 0x0F;
+
+        DEBUG_MBC("MBC5: Selected ram bank: %d\n", mbc.ram_bank);
+    }
 }
 
 void mbc_wb(uint16_t addr, uint8_t data)
 {
-    if (mbc.type == MBC_TYPE_MBC1) {
-        if (addr <= 0x1FFF) {
-            mbc.ram_enabled = (data & 0xF) == 0xA; 
+    if (addr >= 0xA000 && addr <= 0xBFFF) {
+        if (!mbc.ram_enabled) {
+            return;
+        }
+
+        if (mbc.type == MBC_TYPE_MBC3 && mbc.ram_bank >= 0x08 && mbc.ram_bank <= 0x0C) {
+            rtc_write(mbc.ram_bank - 0x08, data);
+            mbc_map();
+            return;
+        }
 
-            DEBUG_MBC("MBC1: %s RAM\n", mbc.ram_enabled ? "Enabled" : "Disabled");
-        } else if (addr >= 0x2000 && addr <= 0x3FFF) {
-            if (data == 0x00) {
-                mbc.rom_bank = 1;
-            } else {
-                mbc.rom_bank = (data & 0x1F);
+        // 512 half bytes, mirrored across the whole area, the upper half reads as 1s
+        if (mbc.type == MBC_TYPE_MBC2) {
+            for (int i=0; i < 0x2000; i += 0x200) {
+                mbc.ram_write[i + (addr & 0x1FF)] = data | 0xF0;
             }
 
-            DEBUG_MBC("MBC1: Selected rom bank: %d\n", mbc.rom_bank);
-        } else if (addr >= 0x4000 && addr <= 0x5FFF) {
-            mbc.ram_bank = data;
+            if (save.enabled && mbc.ram_write != discarded) {
+                save_written(mbc.ram_write - mbc.ram, 0x2000);
+            }
 
-            DEBUG_MBC("MBC1: Selected ram bank: %d\n", mbc.rom_bank & 3);
-        } else if (addr >= 0x6000 && addr <= 0x7FFF) {
-            mbc.banking_mode = data & 0x01;
+            return;
+        }
 
-            DEBUG_MBC("MBC1: Set banking mode: %d\n", mbc.banking_mode);
-        } else if (addr >= 0xA000 && addr <= 0xBFFF) {
-            if (mbc.ram_enabled) {
-                mbc.ram[0x2000 * (mbc.ram_bank & 3) + (addr - 0x4000)] = data;
-            }
+        mbc.ram_write[addr - 0xA000] = data;
+
+        if (save.enabled && mbc.ram_write != discarded) {
+            save_written(mbc.ram_write - mbc.ram + (addr - 0xA000), 1);
         }
+
+        return;
+    }
+
+    switch(mbc.type) {
+        case MBC_TYPE_MBC1:
+            mbc1_wb(addr, data);
+            break;
+
+        case MBC_TYPE_MBC2:
+            mbc2_wb(addr, data);
+            break;
+
+        case MBC_TYPE_MBC3:
+            mbc3_wb(addr, data);
+            break;
+
+        case MBC_TYPE_MBC5:
+            mbc5_wb(addr, data);
+            break;
+
+        default:
+            return;
     }
+
+    mbc_map();
+}
+
+/* ROM bank mapped at addr, used to tell code in different banks apart */
+uint16_t mbc_bank(uint16_t addr)
+{
+    if (addr < 0x4000 || addr >= 0x8000) {
+        return 0;
+    }
+
+    return mbc.romx_bank;
 }
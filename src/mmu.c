@@ -3,19 +3,20 @@
 mmu_t mmu;
 
 #ifdef MMU_DEBUG
-#define DEBUG_MMU(...) printf("[mmu] "); printf(__VA_ARGS__)
+#define DEBUG_MMU(...) LOG(LOG_MMU, LOG_LEVEL_DEBUG, __VA_ARGS__)
 #endif
 
 void mmu_init()
 {
     memset(mmu.rom, 0x00, 0x8000);
-    memset(mmu.vram, 0x00, 0x2000);
-    memset(mmu.sram, 0x00, 0x2000);
-    memset(mmu.wram, 0x00, 0x8000);
+    memset(mmu.vram, 0x00, sizeof(mmu.vram));
+    memset(mmu.wram, 0x00, sizeof(mmu.wram));
     memset(mmu.oam, 0x00, 0x0100);
     memset(mmu.hram, 0x00, 0x007F);
 
     mmu.boot_rom_mapped = true;
+    mmu.vram_bank = 0;
+    mmu.wram_bank = 1;
 
     // Load bootrom
     memcpy(mmu.boot_rom, boot_rom, 0x100);
@@ -28,27 +29,44 @@ void mmu_load(uint8_t *data, uint16_t size)
 
 void mmu_wb(uint16_t addr, uint8_t data)
 {
-    if (addr <= 0x7FFF) {
+    if (debug_pages[addr >> 8] & DEBUG_WATCH_WRITE) {
+        debug_check_write(addr, data);
+    }
+
+    if (dma.active && addr < 0xFF00) {
+        // OAM DMA owns the bus, only IO and HRAM are reachable
+        #if defined MMU_DEBUG
+        DEBUG_MMU("Write during OAM DMA dropped (%x:%x)\n", addr, data);
+        #endif
+    } else if (addr <= 0x7FFF) {
         // ROM
         if (emulator.rom_info.cartridge_type != ROM_CARTRIDGE_TYPE_ROMONLY) {
             mbc_wb(addr, data);
         }
 
         #if defined MMU_DEBUG
-        DEBUG_MMU("[mmu] Illegal write operation inside ROM area (%x:%x)\n", addr, data);
+        DEBUG_MMU("Illegal write operation inside ROM area (%x:%x)\n", addr, data);
         #endif
     } else if (addr >= 0x8000 && addr <= 0x9FFF) {
         // VRAM
-        mmu.vram[addr - 0x8000] = data;
+        uint16_t offset = mmu_vram_offset(addr);
+
+        if (mmu.vram[offset] != data) {
+            mmu.vram[offset] = data;
+            lcd_vram_written(offset);
+        }
     } else if (addr >= 0xA000 && addr <= 0xBFFF) {
-        // SRAM (From cartridge)
-        mmu.sram[addr - 0xA000] = data;
+        // Cartridge RAM or MBC3 clock
+        mbc_ram_wb(addr, data);
     } else if (addr >= 0xC000 && addr <= 0xDFFF) {
         // WRAM
-        mmu.wram[addr - 0xC000] = data;
+        mmu.wram[mmu_wram_offset(addr)] = data;
     } else if (addr >= 0xFE00 && addr <= 0xFE9F) {
         // OAM
-        mmu.oam[addr - 0xFE00] = data; 
+        if (mmu.oam[addr - 0xFE00] != data) {
+            mmu.oam[addr - 0xFE00] = data;
+            lcd_oam_written();
+        }
     } else if (addr >= 0xFEA0 && addr <= 0xFEFF) {
         return;
     } else if (addr >= 0xFF00 && addr <= 0xFF7F) {
@@ -56,34 +74,44 @@ void mmu_wb(uint16_t addr, uint8_t data)
         if (addr == 0xFF00) {
             // Joypad
             input_write(data);            
-        } else if (addr == 0xFF01) {
-            // Serial transfer data
-            mmu.serial_data = data;
-        } else if (addr == 0xFF02) {
-            mmu.serial_control.value = data;  
-
-            if (mmu.serial_control.fields.start_flag) {
-                mmu.serial_control.fields.start_flag = 0;
-                //cpu_request_interrupt(CPU_IF_SERIAL);
-
-                #ifdef MMU_DEBUG
-                DEBUG_MMU("Serial Transfer -> %c\n", mmu.serial_out);
-                #endif
-            }
+        } else if (addr == 0xFF01 || addr == 0xFF02) {
+            // Serial
+            serial_wb(addr & 0xFF, data);
         } else if (addr >= 0xFF04 && addr <= 0xFF07) {
             // Timer
             timer_wb(addr & 0xFF, data);
         } else if (addr == 0xFF0F) {
             // Interrupt flags
-            cpu.ifr = data;
+            cpu_set_interrupt_flags(data);
         } else if (addr >= 0xFF10 && addr <= 0xFF26) {
             // Sound controller
             sound_wb(addr & 0xFF, data);
+        } else if (addr == 0xFF46 || (addr >= 0xFF51 && addr <= 0xFF55)) {
+            // OAM DMA and HDMA
+            dma_wb(addr & 0xFF, data);
         } else if (addr >= 0xFF40 && addr <= 0xFF4B) {
             lcd_wb(addr & 0xFF, data);
-        } else if (addr == 0xFF50) {
+        } else if (addr >= 0xFF68 && addr <= 0xFF6B) {
+            // CGB palettes
+            lcd_wb(addr & 0xFF, data);
+        } else if (addr == 0xFF4D) {
+            // KEY1, the switch happens on the next STOP
+            cpu.speed_switch = emulator.rom_info.cgb && (data & 1);
+        } else if (addr == 0xFF4F) {
+            // VBK
+            mmu.vram_bank = emulator.rom_info.cgb ? (data & 1) : 0;
+        } else if (addr == 0xFF70) {
+            // SVBK, bank 0 selects 1 as well
+            mmu.wram_bank = (emulator.rom_info.cgb && (data & 7)) ? (data & 7) : 1;
+        } else if (addr == 0xFF50 && mmu.boot_rom_mapped) {
+            // Only the first write counts, games can't map the boot ROM back or touch A through it
             mmu.boot_rom_mapped = false;
 
+            // Only the DMG boot ROM is built in, hand over like the CGB one does
+            if (emulator.rom_info.cgb) {
+                cpu.regs.a = 0x11;
+            }
+
             #ifdef MMU_DEBUG
             DEBUG_MMU("Unmapped boot rom\n");
             #endif
@@ -115,27 +143,26 @@ uint8_t mmu_rb(uint16_t addr)
 {
     uint8_t result;
 
-    if (addr <= 0x7FFF) {
+    if (dma.active && addr < 0xFF00) {
+        // OAM DMA owns the bus, only IO and HRAM are reachable
+        result = 0xFF;
+    } else if (addr <= 0x7FFF) {
         // Check if boot rom is still mapped
         if (addr <= 0x00FF && mmu.boot_rom_mapped) {
             // Boot ROM
             result = mmu.boot_rom[addr];
         } else {
-            if (emulator.rom_info.cartridge_type == ROM_CARTRIDGE_TYPE_ROMONLY) {
-                result = emulator.rom[addr];
-            } else {
-                result = mbc_rb(addr);
-            }
+            result = mbc_rb(addr);
         }
     } else if (addr >= 0x8000 && addr <= 0x9FFF) {
         // VRAM
-        result = mmu.vram[addr - 0x8000];
+        result = mmu.vram[mmu_vram_offset(addr)];
     } else if (addr >= 0xA000 && addr <= 0xBFFF) {
-        // SRAM (From cartridge)
-        result = mmu.sram[addr - 0xA000];
+        // Cartridge RAM or MBC3 clock
+        result = mbc_rb(addr);
     } else if (addr >= 0xC000 && addr <= 0xDFFF) {
         // WRAM
-        result = mmu.wram[addr - 0xC000];
+        result = mmu.wram[mmu_wram_offset(addr)];
     } else if (addr >= 0xFE00 && addr <= 0xFE9F) {
         // OAM
         result = mmu.oam[addr - 0xFE00];
@@ -145,10 +172,9 @@ uint8_t mmu_rb(uint16_t addr)
         // IO
         if (addr == 0xFF00) {
             result = input_read();
-        } else if (addr == 0xFF01) {
-            result = mmu.serial_data;
-        } else if (addr == 0xFF02) {
-            result = mmu.serial_control.value;
+        } else if (addr == 0xFF01 || addr == 0xFF02) {
+            // Serial
+            result = serial_rb(addr & 0xFF);
         } else if (addr >= 0xFF04 && addr <= 0xFF07) {
             // Timer
             result = timer_rb(addr & 0xFF);
@@ -158,8 +184,22 @@ uint8_t mmu_rb(uint16_t addr)
         } else if (addr >= 0xFF10 && addr <= 0xFF26) {
             // Sound controller
             result = sound_rb(addr & 0xFF);
+        } else if (addr == 0xFF46 || (addr >= 0xFF51 && addr <= 0xFF55)) {
+            result = dma_rb(addr & 0xFF);
         } else if (addr >= 0xFF40 && addr <= 0xFF4B) {
             result = lcd_rb(addr & 0xFF);
+        } else if (addr >= 0xFF68 && addr <= 0xFF6B) {
+            result = lcd_rb(addr & 0xFF);
+        } else if (!emulator.rom_info.cgb) {
+            result = 0xFF;
+        } else if (addr == 0xFF4D) {
+            result = (cpu.double_speed ? 0x80 : 0x00) | (cpu.speed_switch ? 0x01 : 0x00) | 0x7E;
+        } else if (addr == 0xFF4F) {
+            result = mmu.vram_bank | 0xFE;
+        } else if (addr == 0xFF70) {
+            result = mmu.wram_bank | 0xF8;
+        } else {
+            result = 0xFF;
         }
     } else if (addr >= 0xFF80 && addr <= 0xFFFE) {
         result = mmu.hram[addr - 0xFF80];
@@ -176,6 +216,10 @@ uint8_t mmu_rb(uint16_t addr)
     DEBUG_MMU("Read from %04X -> %x\n", addr, result);
     #endif
 
+    if (debug_pages[addr >> 8] & DEBUG_WATCH_READ) {
+        debug_check_read(addr, result);
+    }
+
     return result;
 }
 
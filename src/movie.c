@@ -0,0 +1,331 @@
+#include "emulator.h"
+
+movie_t movie;
+
+#define MOVIE_HEADER_SIZE 36
+#define MOVIE_ENGINE_SIZE 16
+
+#define HASH_OFFSET 0xCBF29CE484222325ULL
+#define HASH_PRIME  0x100000001B3ULL
+
+/* FNV-1a, a hash of 0 starts a new one */
+uint64_t movie_hash(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *) data;
+
+    if (!hash) {
+        hash = HASH_OFFSET;
+    }
+
+    for (size_t i=0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * HASH_PRIME;
+    }
+
+    return hash;
+}
+
+/* Everything a game can observe, plus the picture */
+uint64_t movie_state_hash()
+{
+    uint8_t regs[] = {
+        cpu.regs.a, cpu.regs.f, cpu.regs.b, cpu.regs.c, cpu.regs.d, cpu.regs.e, cpu.regs.h, cpu.regs.l,
+        cpu.regs.sp & 0xFF, cpu.regs.sp >> 8, cpu.regs.pc & 0xFF, cpu.regs.pc >> 8,
+        cpu.ime, cpu.ie, cpu.ifr, cpu.halted,
+        timer.counter & 0xFF, timer.counter >> 8, timer.tima, timer.tma, timer.tac,
+        serial.data, serial.control,
+        mbc.romx_bank & 0xFF, mbc.romx_bank >> 8, mbc.ram_bank,
+        dma.reg, dma.bytes, dma.hdma_blocks,
+        mmu.vram_bank, mmu.wram_bank, cpu.double_speed, cpu.speed_switch
+    };
+
+    uint8_t cycles[8];
+
+    for (int i=0; i < 8; i++) {
+        cycles[i] = (uint8_t) (emulator.total_cycles >> (i * 8));
+    }
+
+    uint64_t hash = movie_hash(0, regs, sizeof(regs));
+    hash = movie_hash(hash, cycles, sizeof(cycles));
+    hash = movie_hash(hash, mmu.vram, sizeof(mmu.vram));
+    hash = movie_hash(hash, mmu.wram, sizeof(mmu.wram));
+    hash = movie_hash(hash, mmu.oam, sizeof(mmu.oam));
+    hash = movie_hash(hash, mmu.hram, sizeof(mmu.hram));
+    hash = movie_hash(hash, lcd.bg_palette_ram, sizeof(lcd.bg_palette_ram));
+    hash = movie_hash(hash, lcd.obj_palette_ram, sizeof(lcd.obj_palette_ram));
+    hash = movie_hash(hash, mbc.ram, (size_t) mbc.ram_banks * 0x2000);
+    hash = movie_hash(hash, lcd.color_buffer, sizeof(lcd.color_buffer));
+
+    return hash;
+}
+
+static void put_u64(uint8_t *p, uint64_t value)
+{
+    for (int i=0; i < 8; i++) {
+        p[i] = (uint8_t) (value >> (i * 8));
+    }
+}
+
+static uint64_t get_u64(const uint8_t *p)
+{
+    uint64_t value = 0;
+
+    for (int i=0; i < 8; i++) {
+        value |= (uint64_t) p[i] << (i * 8);
+    }
+
+    return value;
+}
+
+/* Like the trace varints but 64 bit, long stretches without input don't fit 32 */
+static void write_record(uint8_t type, uint64_t cycles, const uint8_t *payload, int size)
+{
+    uint8_t record[1 + 10 + 8];
+    uint8_t *p = record;
+    uint64_t delta = cycles - movie.cycles;
+
+    *p++ = type;
+
+    while (delta >= 0x80) {
+        *p++ = (uint8_t) (delta | 0x80);
+        delta >>= 7;
+    }
+
+    *p++ = (uint8_t) delta;
+
+    memcpy(p, payload, size);
+    p += size;
+
+    fwrite(record, 1, p - record, movie.fp);
+    movie.cycles = cycles;
+}
+
+static const uint8_t* read_varint(const uint8_t *p, const uint8_t *end, uint64_t *value)
+{
+    *value = 0;
+
+    for (int shift=0; p < end && shift < 64; shift += 7) {
+        uint8_t byte = *p++;
+        *value |= (uint64_t) (byte & 0x7F) << shift;
+
+        if (!(byte & 0x80)) {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+/* Decodes the record at p, sets end_cycles and end_hash on MOVIE_END */
+static const uint8_t* read_record(const uint8_t *p, uint8_t *type, uint64_t *cycles, uint8_t *state)
+{
+    uint64_t delta;
+
+    if (p >= movie.end) {
+        return NULL;
+    }
+
+    *type = *p++;
+
+    if (!(p = read_varint(p, movie.end, &delta))) {
+        return NULL;
+    }
+
+    *cycles += delta;
+
+    switch (*type) {
+        case MOVIE_INPUT:
+            if (p >= movie.end) return NULL;
+            *state = *p++;
+            return p;
+
+        case MOVIE_END:
+            if (movie.end - p < 8) return NULL;
+            movie.end_cycles = *cycles;
+            movie.end_hash = get_u64(p);
+            return p + 8;
+
+        default:
+            return NULL;
+    }
+}
+
+/* Moves next_cycles / next_state to the following input, or past the end */
+static void next_input()
+{
+    uint8_t type;
+
+    if (!(movie.p = read_record(movie.p, &type, &movie.next_cycles, &movie.next_state)) || type != MOVIE_INPUT) {
+        movie.p = movie.end;
+        movie.next_cycles = UINT64_MAX;
+    }
+}
+
+bool movie_record(const char *path)
+{
+    memset(&movie, 0x00, sizeof(movie_t));
+
+    movie.fp = fopen(path, "wb");
+
+    if (!movie.fp) {
+        printf("[movie] Unable to open %s\n", path);
+        exit(-1);
+    }
+
+    uint8_t header[MOVIE_HEADER_SIZE] = { 0 };
+    memcpy(header, MOVIE_MAGIC, 8);
+    header[8] = MOVIE_VERSION;
+    put_u64(&header[12], movie_hash(0, emulator.rom, emulator.rom_size));
+    strncpy((char *) &header[20], lcd.engine->name, MOVIE_ENGINE_SIZE - 1);
+    fwrite(header, 1, sizeof(header), movie.fp);
+
+    movie.mode = MOVIE_RECORD;
+
+    return true;
+}
+
+/* Loads and checks the whole movie, then puts the emulator back into its power-on state */
+bool movie_play(const char *path)
+{
+    memset(&movie, 0x00, sizeof(movie_t));
+
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp) {
+        printf("[movie] Unable to open %s\n", path);
+        exit(-1);
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    movie.data = (uint8_t *) malloc(size);
+
+    if (!movie.data || fread(movie.data, 1, size, fp) != (size_t) size) {
+        printf("[movie] Unable to read %s\n", path);
+        exit(-1);
+    }
+
+    fclose(fp);
+
+    const uint8_t *header = movie.data;
+
+    if (size < MOVIE_HEADER_SIZE || memcmp(header, MOVIE_MAGIC, 8) != 0 || header[8] != MOVIE_VERSION) {
+        printf("[movie] %s is not a version %d movie\n", path, MOVIE_VERSION);
+        exit(-1);
+    }
+
+    if (get_u64(&header[12]) != movie_hash(0, emulator.rom, emulator.rom_size)) {
+        printf("[movie] %s was recorded with a different ROM\n", path);
+        exit(-1);
+    }
+
+    char engine[MOVIE_ENGINE_SIZE] = { 0 };
+    memcpy(engine, &header[20], MOVIE_ENGINE_SIZE - 1);
+
+    if (!lcd_select_engine(engine)) {
+        printf("[movie] Unknown PPU engine: %s\n", engine);
+        exit(-1);
+    }
+
+    movie.end = movie.data + size;
+
+    // Validate up front, a truncated movie would otherwise only show up as a hash mismatch
+    const uint8_t *p = movie.data + MOVIE_HEADER_SIZE;
+    uint8_t type = MOVIE_INPUT;
+    uint64_t cycles = 0;
+    uint8_t state;
+
+    while (type != MOVIE_END) {
+        if (!(p = read_record(p, &type, &cycles, &state))) {
+            printf("[movie] %s is truncated or corrupt\n", path);
+            exit(-1);
+        }
+
+        movie.inputs += (type == MOVIE_INPUT);
+    }
+
+    movie.p = movie.data + MOVIE_HEADER_SIZE;
+    next_input();
+
+    emulator_reset();
+    movie.mode = MOVIE_PLAY;
+
+    return true;
+}
+
+void movie_stop()
+{
+    if (movie.mode == MOVIE_RECORD) {
+        uint8_t payload[8];
+        uint64_t hash = movie_state_hash();
+
+        put_u64(payload, hash);
+        write_record(MOVIE_END, emulator.total_cycles, payload, sizeof(payload));
+        fclose(movie.fp);
+
+        printf("[movie] Recorded %u inputs over %llu frames | hash %016llx\n",
+                movie.inputs,
+                (unsigned long long) (emulator.total_cycles / CYCLES_PER_FRAME),
+                (unsigned long long) hash
+            );
+    }
+
+    free(movie.data);
+    movie.data = NULL;
+    movie.mode = MOVIE_OFF;
+}
+
+/* Called by input_read on the emulator thread, returns the joypad state the game sees */
+uint8_t movie_input(uint8_t pressed)
+{
+    if (movie.mode == MOVIE_PLAY) {
+        while (emulator.total_cycles >= movie.next_cycles) {
+            movie.state = movie.next_state;
+            next_input();
+        }
+
+        return movie.state;
+    }
+
+    if (pressed != movie.state) {
+        write_record(MOVIE_INPUT, emulator.total_cycles, &pressed, 1);
+        movie.state = pressed;
+        movie.inputs++;
+    }
+
+    return pressed;
+}
+
+/* Runs a loaded movie headless as fast as possible, returns 0 if the final state matches */
+int movie_replay()
+{
+    uint64_t start = SDL_GetPerformanceCounter();
+
+    while (emulator.total_cycles < movie.end_cycles && !cpu.stopped && !debugger.hit) {
+        emulator_step();
+    }
+
+    double seconds = (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    double frames = (double) emulator.total_cycles / CYCLES_PER_FRAME;
+    uint64_t hash = movie_state_hash();
+    bool matches = (emulator.total_cycles == movie.end_cycles && hash == movie.end_hash);
+
+    printf("[movie] Replayed %u inputs over %.0f frames in %.3fs | %.1f fps | %.2fx real time\n",
+            movie.inputs,
+            frames,
+            seconds,
+            frames / seconds,
+            frames / seconds / ((double) CYCLES_PER_SECOND / CYCLES_PER_FRAME)
+        );
+
+    printf("[movie] Final state %016llx, expected %016llx: %s\n",
+            (unsigned long long) hash,
+            (unsigned long long) movie.end_hash,
+            matches ? "match" : "MISMATCH"
+        );
+
+    movie_stop();
+
+    return matches ? 0 : 1;
+}
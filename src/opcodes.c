@@ -0,0 +1,440 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "opcodes.h"
+#include "symbols.h"
+
+/* Cycles are the total, fetch of the immediate bytes and taken branches included */
+const opcode_info_t opcode_table[256] = {
+    [0x00] = { "NOP",             1,  4,  0, OPERAND_NONE, 0 },
+    [0x01] = { "LD BC,nn",        3, 12,  0, OPERAND_NN,   0 },
+    [0x02] = { "LD (BC),A",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x03] = { "INC BC",          1,  8,  0, OPERAND_NONE, 0 },
+    [0x04] = { "INC B",           1,  4,  0, OPERAND_NONE, 0 },
+    [0x05] = { "DEC B",           1,  4,  0, OPERAND_NONE, 0 },
+    [0x06] = { "LD B,n",          2,  8,  0, OPERAND_N,    0 },
+    [0x07] = { "RLCA",            1,  4,  0, OPERAND_NONE, 0 },
+    [0x08] = { "LD (nn),SP",      3, 20,  0, OPERAND_NN,   0 },
+    [0x09] = { "ADD HL,BC",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x0A] = { "LD A,(BC)",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x0B] = { "DEC BC",          1,  8,  0, OPERAND_NONE, 0 },
+    [0x0C] = { "INC C",           1,  4,  0, OPERAND_NONE, 0 },
+    [0x0D] = { "DEC C",           1,  4,  0, OPERAND_NONE, 0 },
+    [0x0E] = { "LD C,n",          2,  8,  0, OPERAND_N,    0 },
+    [0x0F] = { "RRCA",            1,  4,  0, OPERAND_NONE, 0 },
+
+    [0x10] = { "STOP",            2,  4,  0, OPERAND_NONE, 0 },
+    [0x11] = { "LD DE,nn",        3, 12,  0, OPERAND_NN,   0 },
+    [0x12] = { "LD (DE),A",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x13] = { "INC DE",          1,  8,  0, OPERAND_NONE, 0 },
+    [0x14] = { "INC D",           1,  4,  0, OPERAND_NONE, 0 },
+    [0x15] = { "DEC D",           1,  4,  0, OPERAND_NONE, 0 },
+    [0x16] = { "LD D,n",          2,  8,  0, OPERAND_N,    0 },
+    [0x17] = { "RLA",             1,  4,  0, OPERAND_NONE, 0 },
+    [0x18] = { "JR PC+dd",        2, 12,  0, OPERAND_REL,  OPCODE_JUMP },
+    [0x19] = { "ADD HL,DE",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x1A] = { "LD A,(DE)",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x1B] = { "DEC DE",          1,  8,  0, OPERAND_NONE, 0 },
+    [0x1C] = { "INC E",           1,  4,  0, OPERAND_NONE, 0 },
+    [0x1D] = { "DEC E",           1,  4,  0, OPERAND_NONE, 0 },
+    [0x1E] = { "LD E,n",          2,  8,  0, OPERAND_N,    0 },
+    [0x1F] = { "RRA",             1,  4,  0, OPERAND_NONE, 0 },
+
+    [0x20] = { "JR NZ,PC+dd",     2,  8, 12, OPERAND_REL,  OPCODE_JUMP | OPCODE_CONDITIONAL },
+    [0x21] = { "LD HL,nn",        3, 12,  0, OPERAND_NN,   0 },
+    [0x22] = { "LDI (HL),A",      1,  8,  0, OPERAND_NONE, 0 },
+    [0x23] = { "INC HL",          1,  8,  0, OPERAND_NONE, 0 },
+    [0x24] = { "INC H",           1,  4,  0, OPERAND_NONE, 0 },
+    [0x25] = { "DEC H",           1,  4,  0, OPERAND_NONE, 0 },
+    [0x26] = { "LD H,n",          2,  8,  0, OPERAND_N,    0 },
+    [0x27] = { "DAA",             1,  4,  0, OPERAND_NONE, 0 },
+    [0x28] = { "JR Z,PC+dd",      2,  8, 12, OPERAND_REL,  OPCODE_JUMP | OPCODE_CONDITIONAL },
+    [0x29] = { "ADD HL,HL",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x2A] = { "LDI A,(HL)",      1,  8,  0, OPERAND_NONE, 0 },
+    [0x2B] = { "DEC HL",          1,  8,  0, OPERAND_NONE, 0 },
+    [0x2C] = { "INC L",           1,  4,  0, OPERAND_NONE, 0 },
+    [0x2D] = { "DEC L",           1,  4,  0, OPERAND_NONE, 0 },
+    [0x2E] = { "LD L,n",          2,  8,  0, OPERAND_N,    0 },
+    [0x2F] = { "CPL",             1,  4,  0, OPERAND_NONE, 0 },
+
+    [0x30] = { "JR NC,PC+dd",     2,  8, 12, OPERAND_REL,  OPCODE_JUMP | OPCODE_CONDITIONAL },
+    [0x31] = { "LD SP,nn",        3, 12,  0, OPERAND_NN,   0 },
+    [0x32] = { "LDD (HL),A",      1,  8,  0, OPERAND_NONE, 0 },
+    [0x33] = { "INC SP",          1,  8,  0, OPERAND_NONE, 0 },
+    [0x34] = { "INC (HL)",        1, 12,  0, OPERAND_NONE, 0 },
+    [0x35] = { "DEC (HL)",        1, 12,  0, OPERAND_NONE, 0 },
+    [0x36] = { "LD (HL),n",       2, 12,  0, OPERAND_N,    0 },
+    [0x37] = { "SCF",             1,  4,  0, OPERAND_NONE, 0 },
+    [0x38] = { "JR C,PC+dd",      2,  8, 12, OPERAND_REL,  OPCODE_JUMP | OPCODE_CONDITIONAL },
+    [0x39] = { "ADD HL,SP",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x3A] = { "LDD A,(HL)",      1,  8,  0, OPERAND_NONE, 0 },
+    [0x3B] = { "DEC SP",          1,  8,  0, OPERAND_NONE, 0 },
+    [0x3C] = { "INC A",           1,  4,  0, OPERAND_NONE, 0 },
+    [0x3D] = { "DEC A",           1,  4,  0, OPERAND_NONE, 0 },
+    [0x3E] = { "LD A,n",          2,  8,  0, OPERAND_N,    0 },
+    [0x3F] = { "CCF",             1,  4,  0, OPERAND_NONE, 0 },
+
+    [0x40] = { "LD B,B",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x41] = { "LD B,C",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x42] = { "LD B,D",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x43] = { "LD B,E",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x44] = { "LD B,H",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x45] = { "LD B,L",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x46] = { "LD B,(HL)",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x47] = { "LD B,A",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x48] = { "LD C,B",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x49] = { "LD C,C",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x4A] = { "LD C,D",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x4B] = { "LD C,E",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x4C] = { "LD C,H",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x4D] = { "LD C,L",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x4E] = { "LD C,(HL)",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x4F] = { "LD C,A",          1,  4,  0, OPERAND_NONE, 0 },
+
+    [0x50] = { "LD D,B",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x51] = { "LD D,C",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x52] = { "LD D,D",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x53] = { "LD D,E",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x54] = { "LD D,H",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x55] = { "LD D,L",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x56] = { "LD D,(HL)",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x57] = { "LD D,A",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x58] = { "LD E,B",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x59] = { "LD E,C",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x5A] = { "LD E,D",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x5B] = { "LD E,E",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x5C] = { "LD E,H",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x5D] = { "LD E,L",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x5E] = { "LD E,(HL)",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x5F] = { "LD E,A",          1,  4,  0, OPERAND_NONE, 0 },
+
+    [0x60] = { "LD H,B",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x61] = { "LD H,C",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x62] = { "LD H,D",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x63] = { "LD H,E",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x64] = { "LD H,H",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x65] = { "LD H,L",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x66] = { "LD H,(HL)",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x67] = { "LD H,A",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x68] = { "LD L,B",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x69] = { "LD L,C",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x6A] = { "LD L,D",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x6B] = { "LD L,E",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x6C] = { "LD L,H",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x6D] = { "LD L,L",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x6E] = { "LD L,(HL)",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x6F] = { "LD L,A",          1,  4,  0, OPERAND_NONE, 0 },
+
+    [0x70] = { "LD (HL),B",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x71] = { "LD (HL),C",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x72] = { "LD (HL),D",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x73] = { "LD (HL),E",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x74] = { "LD (HL),H",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x75] = { "LD (HL),L",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x76] = { "HALT",            1,  4,  0, OPERAND_NONE, 0 },
+    [0x77] = { "LD (HL),A",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x78] = { "LD A,B",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x79] = { "LD A,C",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x7A] = { "LD A,D",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x7B] = { "LD A,E",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x7C] = { "LD A,H",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x7D] = { "LD A,L",          1,  4,  0, OPERAND_NONE, 0 },
+    [0x7E] = { "LD A,(HL)",       1,  8,  0, OPERAND_NONE, 0 },
+    [0x7F] = { "LD A,A",          1,  4,  0, OPERAND_NONE, 0 },
+
+    [0x80] = { "ADD A,B",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x81] = { "ADD A,C",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x82] = { "ADD A,D",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x83] = { "ADD A,E",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x84] = { "ADD A,H",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x85] = { "ADD A,L",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x86] = { "ADD A,(HL)",      1,  8,  0, OPERAND_NONE, 0 },
+    [0x87] = { "ADD A,A",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x88] = { "ADC A,B",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x89] = { "ADC A,C",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x8A] = { "ADC A,D",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x8B] = { "ADC A,E",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x8C] = { "ADC A,H",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x8D] = { "ADC A,L",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x8E] = { "ADC A,(HL)",      1,  8,  0, OPERAND_NONE, 0 },
+    [0x8F] = { "ADC A,A",         1,  4,  0, OPERAND_NONE, 0 },
+
+    [0x90] = { "SUB A,B",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x91] = { "SUB A,C",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x92] = { "SUB A,D",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x93] = { "SUB A,E",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x94] = { "SUB A,H",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x95] = { "SUB A,L",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x96] = { "SUB A,(HL)",      1,  8,  0, OPERAND_NONE, 0 },
+    [0x97] = { "SUB A,A",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x98] = { "SBC A,B",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x99] = { "SBC A,C",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x9A] = { "SBC A,D",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x9B] = { "SBC A,E",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x9C] = { "SBC A,H",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x9D] = { "SBC A,L",         1,  4,  0, OPERAND_NONE, 0 },
+    [0x9E] = { "SBC A,(HL)",      1,  8,  0, OPERAND_NONE, 0 },
+    [0x9F] = { "SBC A,A",         1,  4,  0, OPERAND_NONE, 0 },
+
+    [0xA0] = { "AND B",           1,  4,  0, OPERAND_NONE, 0 },
+    [0xA1] = { "AND C",           1,  4,  0, OPERAND_NONE, 0 },
+    [0xA2] = { "AND D",           1,  4,  0, OPERAND_NONE, 0 },
+    [0xA3] = { "AND E",           1,  4,  0, OPERAND_NONE, 0 },
+    [0xA4] = { "AND H",           1,  4,  0, OPERAND_NONE, 0 },
+    [0xA5] = { "AND L",           1,  4,  0, OPERAND_NONE, 0 },
+    [0xA6] = { "AND (HL)",        1,  8,  0, OPERAND_NONE, 0 },
+    [0xA7] = { "AND A",           1,  4,  0, OPERAND_NONE, 0 },
+    [0xA8] = { "XOR B",           1,  4,  0, OPERAND_NONE, 0 },
+    [0xA9] = { "XOR C",           1,  4,  0, OPERAND_NONE, 0 },
+    [0xAA] = { "XOR D",           1,  4,  0, OPERAND_NONE, 0 },
+    [0xAB] = { "XOR E",           1,  4,  0, OPERAND_NONE, 0 },
+    [0xAC] = { "XOR H",           1,  4,  0, OPERAND_NONE, 0 },
+    [0xAD] = { "XOR L",           1,  4,  0, OPERAND_NONE, 0 },
+    [0xAE] = { "XOR (HL)",        1,  8,  0, OPERAND_NONE, 0 },
+    [0xAF] = { "XOR A",           1,  4,  0, OPERAND_NONE, 0 },
+
+    [0xB0] = { "OR B",            1,  4,  0, OPERAND_NONE, 0 },
+    [0xB1] = { "OR C",            1,  4,  0, OPERAND_NONE, 0 },
+    [0xB2] = { "OR D",            1,  4,  0, OPERAND_NONE, 0 },
+    [0xB3] = { "OR E",            1,  4,  0, OPERAND_NONE, 0 },
+    [0xB4] = { "OR H",            1,  4,  0, OPERAND_NONE, 0 },
+    [0xB5] = { "OR L",            1,  4,  0, OPERAND_NONE, 0 },
+    [0xB6] = { "OR (HL)",         1,  8,  0, OPERAND_NONE, 0 },
+    [0xB7] = { "OR A",            1,  4,  0, OPERAND_NONE, 0 },
+    [0xB8] = { "CP B",            1,  4,  0, OPERAND_NONE, 0 },
+    [0xB9] = { "CP C",            1,  4,  0, OPERAND_NONE, 0 },
+    [0xBA] = { "CP D",            1,  4,  0, OPERAND_NONE, 0 },
+    [0xBB] = { "CP E",            1,  4,  0, OPERAND_NONE, 0 },
+    [0xBC] = { "CP H",            1,  4,  0, OPERAND_NONE, 0 },
+    [0xBD] = { "CP L",            1,  4,  0, OPERAND_NONE, 0 },
+    [0xBE] = { "CP (HL)",         1,  8,  0, OPERAND_NONE, 0 },
+    [0xBF] = { "CP A",            1,  4,  0, OPERAND_NONE, 0 },
+
+    [0xC0] = { "RET NZ",          1,  8, 20, OPERAND_NONE, OPCODE_RET | OPCODE_CONDITIONAL },
+    [0xC1] = { "POP BC",          1, 12,  0, OPERAND_NONE, 0 },
+    [0xC2] = { "JP NZ,nn",        3, 12, 16, OPERAND_NN,   OPCODE_JUMP | OPCODE_CONDITIONAL },
+    [0xC3] = { "JP nn",           3, 16,  0, OPERAND_NN,   OPCODE_JUMP },
+    [0xC4] = { "CALL NZ,nn",      3, 12, 24, OPERAND_NN,   OPCODE_CALL | OPCODE_CONDITIONAL },
+    [0xC5] = { "PUSH BC",         1, 16,  0, OPERAND_NONE, 0 },
+    [0xC6] = { "ADD A,n",         2,  8,  0, OPERAND_N,    0 },
+    [0xC7] = { "RST $00",         1, 16,  0, OPERAND_NONE, OPCODE_CALL },
+    [0xC8] = { "RET Z",           1,  8, 20, OPERAND_NONE, OPCODE_RET | OPCODE_CONDITIONAL },
+    [0xC9] = { "RET",             1, 16,  0, OPERAND_NONE, OPCODE_RET },
+    [0xCA] = { "JP Z,nn",         3, 12, 16, OPERAND_NN,   OPCODE_JUMP | OPCODE_CONDITIONAL },
+    [0xCB] = { "PREFIX CB",       1,  4,  0, OPERAND_NONE, OPCODE_PREFIX },
+    [0xCC] = { "CALL Z,nn",       3, 12, 24, OPERAND_NN,   OPCODE_CALL | OPCODE_CONDITIONAL },
+    [0xCD] = { "CALL nn",         3, 24,  0, OPERAND_NN,   OPCODE_CALL },
+    [0xCE] = { "ADC A,n",         2,  8,  0, OPERAND_N,    0 },
+    [0xCF] = { "RST $08",         1, 16,  0, OPERAND_NONE, OPCODE_CALL },
+
+    [0xD0] = { "RET NC",          1,  8, 20, OPERAND_NONE, OPCODE_RET | OPCODE_CONDITIONAL },
+    [0xD1] = { "POP DE",          1, 12,  0, OPERAND_NONE, 0 },
+    [0xD2] = { "JP NC,nn",        3, 12, 16, OPERAND_NN,   OPCODE_JUMP | OPCODE_CONDITIONAL },
+    [0xD3] = { "DB",              1,  4,  0, OPERAND_NONE, OPCODE_ILLEGAL },
+    [0xD4] = { "CALL NC,nn",      3, 12, 24, OPERAND_NN,   OPCODE_CALL | OPCODE_CONDITIONAL },
+    [0xD5] = { "PUSH DE",         1, 16,  0, OPERAND_NONE, 0 },
+    [0xD6] = { "SUB A,n",         2,  8,  0, OPERAND_N,    0 },
+    [0xD7] = { "RST $10",         1, 16,  0, OPERAND_NONE, OPCODE_CALL },
+    [0xD8] = { "RET C",           1,  8, 20, OPERAND_NONE, OPCODE_RET | OPCODE_CONDITIONAL },
+    [0xD9] = { "RETI",            1, 16,  0, OPERAND_NONE, OPCODE_RET },
+    [0xDA] = { "JP C,nn",         3, 12, 16, OPERAND_NN,   OPCODE_JUMP | OPCODE_CONDITIONAL },
+    [0xDB] = { "DB",              1,  4,  0, OPERAND_NONE, OPCODE_ILLEGAL },
+    [0xDC] = { "CALL C,nn",       3, 12, 24, OPERAND_NN,   OPCODE_CALL | OPCODE_CONDITIONAL },
+    [0xDD] = { "DB",              1,  4,  0, OPERAND_NONE, OPCODE_ILLEGAL },
+    [0xDE] = { "SBC A,n",         2,  8,  0, OPERAND_N,    0 },
+    [0xDF] = { "RST $18",         1, 16,  0, OPERAND_NONE, OPCODE_CALL },
+
+    [0xE0] = { "LD (FF00+n),A",   2, 12,  0, OPERAND_IO,   0 },
+    [0xE1] = { "POP HL",          1, 12,  0, OPERAND_NONE, 0 },
+    [0xE2] = { "LD (FF00+C),A",   1,  8,  0, OPERAND_NONE, 0 },
+    [0xE3] = { "DB",              1,  4,  0, OPERAND_NONE, OPCODE_ILLEGAL },
+    [0xE4] = { "DB",              1,  4,  0, OPERAND_NONE, OPCODE_ILLEGAL },
+    [0xE5] = { "PUSH HL",         1, 16,  0, OPERAND_NONE, 0 },
+    [0xE6] = { "AND n",           2,  8,  0, OPERAND_N,    0 },
+    [0xE7] = { "RST $20",         1, 16,  0, OPERAND_NONE, OPCODE_CALL },
+    [0xE8] = { "ADD SP,dd",       2, 16,  0, OPERAND_SP,   0 },
+    [0xE9] = { "JP HL",           1,  4,  0, OPERAND_NONE, OPCODE_JUMP },
+    [0xEA] = { "LD (nn),A",       3, 16,  0, OPERAND_NN,   0 },
+    [0xEB] = { "DB",              1,  4,  0, OPERAND_NONE, OPCODE_ILLEGAL },
+    [0xEC] = { "DB",              1,  4,  0, OPERAND_NONE, OPCODE_ILLEGAL },
+    [0xED] = { "DB",              1,  4,  0, OPERAND_NONE, OPCODE_ILLEGAL },
+    [0xEE] = { "XOR n",           2,  8,  0, OPERAND_N,    0 },
+    [0xEF] = { "RST $28",         1, 16,  0, OPERAND_NONE, OPCODE_CALL },
+
+    [0xF0] = { "LD A,(FF00+n)",   2, 12,  0, OPERAND_IO,   0 },
+    [0xF1] = { "POP AF",          1, 12,  0, OPERAND_NONE, 0 },
+    [0xF2] = { "LD A,(FF00+C)",   1,  8,  0, OPERAND_NONE, 0 },
+    [0xF3] = { "DI",              1,  4,  0, OPERAND_NONE, 0 },
+    [0xF4] = { "DB",              1,  4,  0, OPERAND_NONE, OPCODE_ILLEGAL },
+    [0xF5] = { "PUSH AF",         1, 16,  0, OPERAND_NONE, 0 },
+    [0xF6] = { "OR n",            2,  8,  0, OPERAND_N,    0 },
+    [0xF7] = { "RST $30",         1, 16,  0, OPERAND_NONE, OPCODE_CALL },
+    [0xF8] = { "LD HL,SP+dd",     2, 12,  0, OPERAND_SP,   0 },
+    [0xF9] = { "LD SP,HL",        1,  8,  0, OPERAND_NONE, 0 },
+    [0xFA] = { "LD A,(nn)",       3, 16,  0, OPERAND_NN,   0 },
+    [0xFB] = { "EI",              1,  4,  0, OPERAND_NONE, 0 },
+    [0xFC] = { "DB",              1,  4,  0, OPERAND_NONE, OPCODE_ILLEGAL },
+    [0xFD] = { "DB",              1,  4,  0, OPERAND_NONE, OPCODE_ILLEGAL },
+    [0xFE] = { "CP n",            2,  8,  0, OPERAND_N,    0 },
+    [0xFF] = { "RST $38",         1, 16,  0, OPERAND_NONE, OPCODE_CALL },
+};
+
+/* The CB page is regular: operation in bits 3-7, register in bits 0-2. op ends with its separator */
+#define CB_ROW(op) \
+    { op "B", 2, 8, 0, OPERAND_NONE, 0 }, \
+    { op "C", 2, 8, 0, OPERAND_NONE, 0 }, \
+    { op "D", 2, 8, 0, OPERAND_NONE, 0 }, \
+    { op "E", 2, 8, 0, OPERAND_NONE, 0 }, \
+    { op "H", 2, 8, 0, OPERAND_NONE, 0 }, \
+    { op "L", 2, 8, 0, OPERAND_NONE, 0 }, \
+    { op "(HL)", 2, 16, 0, OPERAND_NONE, 0 }, \
+    { op "A", 2, 8, 0, OPERAND_NONE, 0 }
+
+/* BIT only reads (HL) */
+#define CB_BIT_ROW(bit) \
+    { "BIT " bit ",B", 2, 8, 0, OPERAND_NONE, 0 }, \
+    { "BIT " bit ",C", 2, 8, 0, OPERAND_NONE, 0 }, \
+    { "BIT " bit ",D", 2, 8, 0, OPERAND_NONE, 0 }, \
+    { "BIT " bit ",E", 2, 8, 0, OPERAND_NONE, 0 }, \
+    { "BIT " bit ",H", 2, 8, 0, OPERAND_NONE, 0 }, \
+    { "BIT " bit ",L", 2, 8, 0, OPERAND_NONE, 0 }, \
+    { "BIT " bit ",(HL)", 2, 12, 0, OPERAND_NONE, 0 }, \
+    { "BIT " bit ",A", 2, 8, 0, OPERAND_NONE, 0 }
+
+const opcode_info_t opcode_cb_table[256] = {
+    CB_ROW("RLC "), CB_ROW("RRC "), CB_ROW("RL "), CB_ROW("RR "),
+    CB_ROW("SLA "), CB_ROW("SRA "), CB_ROW("SWAP "), CB_ROW("SRL "),
+
+    CB_BIT_ROW("0"), CB_BIT_ROW("1"), CB_BIT_ROW("2"), CB_BIT_ROW("3"),
+    CB_BIT_ROW("4"), CB_BIT_ROW("5"), CB_BIT_ROW("6"), CB_BIT_ROW("7"),
+
+    CB_ROW("RES 0,"), CB_ROW("RES 1,"), CB_ROW("RES 2,"), CB_ROW("RES 3,"),
+    CB_ROW("RES 4,"), CB_ROW("RES 5,"), CB_ROW("RES 6,"), CB_ROW("RES 7,"),
+
+    CB_ROW("SET 0,"), CB_ROW("SET 1,"), CB_ROW("SET 2,"), CB_ROW("SET 3,"),
+    CB_ROW("SET 4,"), CB_ROW("SET 5,"), CB_ROW("SET 6,"), CB_ROW("SET 7,")
+};
+
+static const char* operand_tokens[] = {
+    [OPERAND_NONE] = NULL,
+    [OPERAND_N] = "n",
+    [OPERAND_NN] = "nn",
+    [OPERAND_IO] = "FF00+n",
+    [OPERAND_REL] = "PC+dd",
+    [OPERAND_SP] = "dd"
+};
+
+/* Returns the bytes used, 0 if nothing is available. A truncated instruction keeps its unresolved mnemonic */
+int disasm_decode(const uint8_t *bytes, int available, uint16_t addr, disasm_insn_t *insn)
+{
+    if (available <= 0) {
+        return 0;
+    }
+
+    const opcode_info_t *info = &opcode_table[bytes[0]];
+
+    if ((info->flags & OPCODE_PREFIX) && available >= 2) {
+        info = &opcode_cb_table[bytes[1]];
+    }
+
+    insn->addr = addr;
+    insn->info = info;
+    insn->length = (info->length <= available) ? info->length : available;
+
+    memset(insn->bytes, 0x00, sizeof(insn->bytes));
+    memcpy(insn->bytes, bytes, insn->length);
+
+    return insn->length;
+}
+
+/* Decodes a whole region in one go, for the offline tools. Returns the number of instructions */
+int disasm_decode_block(const uint8_t *data, uint32_t size, uint16_t addr, disasm_insn_t *insns, int max)
+{
+    uint32_t offset = 0;
+    int count = 0;
+
+    while (offset < size && count < max) {
+        int length = disasm_decode(&data[offset], size - offset, (uint16_t) (addr + offset), &insns[count]);
+
+        offset += length;
+        count++;
+    }
+
+    return count;
+}
+
+/* Address a jump, call or RST goes to, or the address operand of a load */
+uint16_t disasm_target(const disasm_insn_t *insn)
+{
+    switch(insn->info->operand) {
+        case OPERAND_NN:
+            return insn->bytes[1] | (insn->bytes[2] << 8);
+        case OPERAND_IO:
+            return 0xFF00 | insn->bytes[1];
+        case OPERAND_REL:
+            return (uint16_t) (insn->addr + 2 + (int8_t) insn->bytes[1]);
+    }
+
+    if ((insn->info->flags & OPCODE_CALL) && insn->length == 1) {
+        return insn->bytes[0] & 0x38;
+    }
+
+    return 0;
+}
+
+/* Address operands are replaced by symbols where known, rom_bank is the bank mapped at 4000-7FFF */
+static void format_address(uint16_t addr, uint16_t rom_bank, char *buffer, int size)
+{
+    const char *name = symbols_find(rom_bank, addr);
+
+    if (name) {
+        snprintf(buffer, size, "%s", name);
+    } else {
+        snprintf(buffer, size, "$%04X", addr);
+    }
+}
+
+void disasm_format(const disasm_insn_t *insn, uint16_t rom_bank, char *buffer, int size)
+{
+    const opcode_info_t *info = insn->info;
+    const char *token = operand_tokens[info->operand];
+
+    if (info->flags & OPCODE_ILLEGAL) {
+        snprintf(buffer, size, "DB $%02X", insn->bytes[0]);
+        return;
+    }
+
+    if (!token || insn->length < info->length) {
+        snprintf(buffer, size, "%s", info->mnemonic);
+        return;
+    }
+
+    // Tokens are lower case, so they can't match inside the mnemonic
+    char operand[64];
+    const char *position = strstr(info->mnemonic, token);
+    int prefix = (int) (position - info->mnemonic);
+
+    switch(info->operand) {
+        case OPERAND_N:
+            snprintf(operand, sizeof(operand), "$%02X", insn->bytes[1]);
+            break;
+
+        case OPERAND_SP: {
+            int8_t offset = (int8_t) insn->bytes[1];
+
+            // SP+dd turns into SP-xx for negative offsets
+            if (offset < 0 && prefix > 0 && info->mnemonic[prefix - 1] == '+') {
+                prefix--;
+            }
+
+            snprintf(operand, sizeof(operand), "%s$%02X", (offset < 0) ? "-" : "", (offset < 0) ? -offset : offset);
+            break;
+        }
+
+        default:
+            format_address(disasm_target(insn), rom_bank, operand, sizeof(operand));
+            break;
+    }
+
+    snprintf(buffer, size, "%.*s%s%s", prefix, info->mnemonic, operand, position + strlen(token));
+}
@@ -0,0 +1,304 @@
+#include "emulator.h"
+
+bool profile_enabled = false;
+
+static profile_t profile;
+
+void profile_start()
+{
+    memset(&profile, 0x00, sizeof(profile_t));
+
+    // Node 0 is the root everything starts in
+    profile.node_count = 1;
+    profile_enabled = true;
+}
+
+static void profile_hotspot(uint16_t pc, uint8_t opcode, uint32_t cycles)
+{
+    uint32_t key = (((uint32_t) mbc_bank(pc) << 16) | pc) + 1;
+    uint32_t index = (key * 2654435761u) >> 16;
+
+    for (int probe=0; probe < PROFILE_HASH_SIZE; probe++) {
+        profile_entry_t *entry = &profile.hotspots[(index + probe) & (PROFILE_HASH_SIZE - 1)];
+
+        if (entry->key == key || entry->key == 0) {
+            entry->key = key;
+            entry->count++;
+            entry->cycles += cycles;
+            entry->opcode = opcode;
+            return;
+        }
+    }
+
+    profile.hotspot_overflow++;
+}
+
+static void profile_call(uint32_t key)
+{
+    // Past the depth limit (e.g. a game that never returns) or out of nodes, everything stays in the current function
+    if (profile.untracked || profile.depth == PROFILE_MAX_DEPTH) {
+        profile.untracked++;
+        return;
+    }
+
+    profile_node_t *parent = &profile.nodes[profile.current];
+    uint32_t index = parent->child;
+
+    while (index && profile.nodes[index].key != key) {
+        index = profile.nodes[index].sibling;
+    }
+
+    if (!index) {
+        if (profile.node_count == PROFILE_MAX_NODES) {
+            profile.untracked++;
+            return;
+        }
+
+        index = profile.node_count++;
+
+        profile_node_t *node = &profile.nodes[index];
+        node->key = key;
+        node->parent = profile.current;
+        node->sibling = parent->child;
+        parent->child = index;
+    }
+
+    profile.nodes[index].calls++;
+    profile.current = index;
+    profile.depth++;
+}
+
+static void profile_return()
+{
+    // Returns from calls that never got a node don't leave the current one
+    if (profile.untracked) {
+        profile.untracked--;
+        return;
+    }
+
+    if (profile.depth == 0) {
+        return;
+    }
+
+    profile.current = profile.nodes[profile.current].parent;
+    profile.depth--;
+}
+
+/* Called after every instruction with the PC and SP it started with */
+void profile_instruction(uint16_t pc, uint16_t sp, uint8_t opcode, uint8_t cb_opcode, uint32_t cycles)
+{
+    profile.instructions++;
+    profile.cycles += cycles;
+
+    profile.opcode_count[opcode]++;
+    profile.opcode_cycles[opcode] += cycles;
+
+    if (opcode == 0xCB) {
+        profile.cb_count[cb_opcode]++;
+        profile.cb_cycles[cb_opcode] += cycles;
+    }
+
+    profile_hotspot(pc, opcode, cycles);
+    profile.nodes[profile.current].cycles += cycles;
+
+    // Conditional calls and returns only count if they were taken
+    uint8_t flags = opcode_table[opcode].flags;
+
+    if (flags & OPCODE_CALL) {
+        if (cpu.regs.sp == (uint16_t) (sp - 2)) {
+            profile_call(((uint32_t) mbc_bank(cpu.regs.pc) << 16) | cpu.regs.pc);
+        }
+    } else if (flags & OPCODE_RET) {
+        if (cpu.regs.sp == (uint16_t) (sp + 2)) {
+            profile_return();
+        }
+    }
+}
+
+void profile_interrupt(uint16_t vector)
+{
+    profile_call(PROFILE_NODE_INTERRUPT | vector);
+}
+
+static void node_name(uint32_t index, char *buffer, int size)
+{
+    uint32_t key = profile.nodes[index].key;
+
+    if (index == 0) {
+        snprintf(buffer, size, "root");
+    } else if (key & PROFILE_NODE_INTERRUPT) {
+        snprintf(buffer, size, "int_%02X", key & 0xFF);
+    } else {
+        const char *name = symbols_find(key >> 16, key & 0xFFFF);
+
+        if (name) {
+            snprintf(buffer, size, "%s", name);
+        } else {
+            snprintf(buffer, size, "%02X:%04X", key >> 16, key & 0xFFFF);
+        }
+    }
+}
+
+static const uint64_t *sort_cycles;
+
+static int compare_cycles(const void *a, const void *b)
+{
+    uint64_t cycles_a = sort_cycles[*(const int *) a];
+    uint64_t cycles_b = sort_cycles[*(const int *) b];
+
+    return (cycles_a < cycles_b) - (cycles_a > cycles_b);
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    uint64_t cycles_a = ((const profile_entry_t *) a)->cycles;
+    uint64_t cycles_b = ((const profile_entry_t *) b)->cycles;
+
+    return (cycles_a < cycles_b) - (cycles_a > cycles_b);
+}
+
+static double percent(uint64_t cycles)
+{
+    return profile.cycles ? 100.0 * cycles / profile.cycles : 0.0;
+}
+
+static void dump_opcodes(FILE *fp, const char *title, const uint32_t *counts, const uint64_t *cycles, bool cb)
+{
+    int order[256];
+
+    for (int i=0; i < 256; i++) {
+        order[i] = i;
+    }
+
+    sort_cycles = cycles;
+    qsort(order, 256, sizeof(int), compare_cycles);
+
+    fprintf(fp, "\n%s\n%12s %14s %7s  %-5s %s\n", title, "Count", "Cycles", "%", "Op", "Instruction");
+
+    for (int i=0; i < 256 && counts[order[i]]; i++) {
+        int opcode = order[i];
+        const char *label = cb ? opcode_cb_table[opcode].mnemonic : opcode_table[opcode].mnemonic;
+
+        fprintf(fp, "%12u %14llu %6.2f%%  %s%02X  %s\n",
+                counts[opcode],
+                (unsigned long long) cycles[opcode],
+                percent(cycles[opcode]),
+                cb ? "CB" : "  ",
+                opcode,
+                label
+            );
+    }
+}
+
+static void dump_hotspots(FILE *fp)
+{
+    profile_entry_t *entries = (profile_entry_t *) malloc(sizeof(profile.hotspots));
+    uint32_t count = 0;
+
+    for (int i=0; i < PROFILE_HASH_SIZE; i++) {
+        if (profile.hotspots[i].key) {
+            entries[count++] = profile.hotspots[i];
+        }
+    }
+
+    qsort(entries, count, sizeof(profile_entry_t), compare_entries);
+
+    fprintf(fp, "\nHotspots (%u addresses, %u not tracked)\n%12s %14s %7s  %-8s %-16s %s\n", count, profile.hotspot_overflow, "Count", "Cycles", "%", "Address", "Instruction", "Symbol");
+
+    for (uint32_t i=0; i < count && i < PROFILE_HOTSPOTS; i++) {
+        uint32_t key = entries[i].key - 1;
+        uint16_t offset = 0;
+        const char *name = symbols_nearest(key >> 16, key & 0xFFFF, &offset);
+        char symbol[80] = "";
+
+        if (name && offset) {
+            snprintf(symbol, sizeof(symbol), "%s+%u", name, offset);
+        } else if (name) {
+            snprintf(symbol, sizeof(symbol), "%s", name);
+        }
+
+        fprintf(fp, "%12u %14llu %6.2f%%  %02X:%04X  %-16s %s\n",
+                entries[i].count,
+                (unsigned long long) entries[i].cycles,
+                percent(entries[i].cycles),
+                key >> 16,
+                key & 0xFFFF,
+                opcode_table[entries[i].opcode].mnemonic,
+                symbol
+            );
+    }
+
+    free(entries);
+}
+
+/* One line per call path, "root;00:0150;01:4000 cycles", as expected by flamegraph.pl */
+static void dump_folded(FILE *fp)
+{
+    uint32_t path[PROFILE_MAX_DEPTH + 1];
+    char name[32];
+
+    for (uint32_t i=0; i < profile.node_count; i++) {
+        if (!profile.nodes[i].cycles) {
+            continue;
+        }
+
+        int depth = 0;
+
+        for (uint32_t index = i; depth <= PROFILE_MAX_DEPTH; index = profile.nodes[index].parent) {
+            path[depth++] = index;
+
+            if (index == 0) {
+                break;
+            }
+        }
+
+        for (int j=depth - 1; j >= 0; j--) {
+            node_name(path[j], name, sizeof(name));
+            fprintf(fp, "%s%s", name, j ? ";" : "");
+        }
+
+        fprintf(fp, " %llu\n", (unsigned long long) profile.nodes[i].cycles);
+    }
+}
+
+/* Writes <prefix>.txt (report) and <prefix>.folded (stacks) */
+void profile_dump(const char *prefix)
+{
+    if (!profile_enabled) {
+        return;
+    }
+
+    char path[1024];
+
+    snprintf(path, sizeof(path), "%s.txt", prefix);
+    FILE *fp = fopen(path, "w");
+
+    if (!fp) {
+        printf("[profile] Unable to open %s\n", path);
+        return;
+    }
+
+    fprintf(fp, "%llu instructions | %llu cycles | %u call tree nodes\n",
+            (unsigned long long) profile.instructions,
+            (unsigned long long) profile.cycles,
+            profile.node_count
+        );
+
+    dump_opcodes(fp, "Opcodes", profile.opcode_count, profile.opcode_cycles, false);
+    dump_opcodes(fp, "CB opcodes", profile.cb_count, profile.cb_cycles, true);
+    dump_hotspots(fp);
+    fclose(fp);
+
+    snprintf(path, sizeof(path), "%s.folded", prefix);
+    fp = fopen(path, "w");
+
+    if (!fp) {
+        printf("[profile] Unable to open %s\n", path);
+        return;
+    }
+
+    dump_folded(fp);
+    fclose(fp);
+
+    printf("[profile] Wrote %s.txt and %s.folded\n", prefix, prefix);
+}
@@ -0,0 +1,912 @@
+#include "emulator.h"
+#include "inflate.h"
+
+#include <limits.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// No mmap on Windows, ROMs from archives and the cache are read into the heap there
+#ifdef _WIN32
+#include <direct.h>
+#define realpath(path, resolved) _fullpath(resolved, path, PATH_MAX)
+#define mkdir(path, mode) _mkdir(path)
+#else
+#include <sys/mman.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+rom_config_t rom_config;
+
+static const char* cartridge_type_names[0x100] = {
+    [0x00] = "ROMONLY",
+    [0x01] = "MBC1",
+    [0x02] = "MBC1+RAM",
+    [0x03] = "MBC1+RAM+BATTERY",
+    [0x05] = "MBC2",
+    [0x06] = "MBC2+BATTERY",
+    [0x08] = "ROM+RAM",
+    [0x09] = "ROM+RAM+BATTERY",
+    [0x0B] = "MMM01",
+    [0x0C] = "MMM01+RAM",
+    [0x0D] = "MMM01+RAM+BATTERY",
+    [0x0F] = "MBC3+TIMER+BATTERY",
+    [0x10] = "MBC3+TIMER+RAM+BATTERY",
+    [0x11] = "MBC3",
+    [0x12] = "MBC3+RAM",
+    [0x13] = "MBC3+RAM+BATTERY",
+    [0x19] = "MBC5",
+    [0x1A] = "MBC5+RAM",
+    [0x1B] = "MBC5+RAM+BATTERY",
+    [0x1C] = "MBC5+RUMBLE",
+    [0x1D] = "MBC5+RUMBLE+RAM",
+    [0x1E] = "MBC5+RUMBLE+RAM+BATTERY",
+    [0x20] = "MBC6",
+    [0x22] = "MBC7+SENSOR+RUMBLE+RAM+BATTERY",
+    [0xFC] = "POCKET CAMERA",
+    [0xFD] = "BANDAI TAMA5",
+    [0xFE] = "HuC3",
+    [0xFF] = "HuC1+RAM+BATTERY"
+};
+
+/* The IEEE polynomial, as listed by ROM databases */
+uint32_t rom_crc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+    static uint32_t table[256];
+
+    if (!table[1]) {
+        for (uint32_t i=0; i < 256; i++) {
+            uint32_t c = i;
+
+            for (int k=0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+
+            table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+
+    for (size_t i=0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void sha1_block(uint32_t h[5], const uint8_t *p)
+{
+    uint32_t w[80];
+
+    for (int i=0; i < 16; i++) {
+        w[i] = (uint32_t) p[i * 4] << 24 | p[i * 4 + 1] << 16 | p[i * 4 + 2] << 8 | p[i * 4 + 3];
+    }
+
+    for (int i=16; i < 80; i++) {
+        w[i] = ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+    for (int i=0; i < 80; i++) {
+        uint32_t f, k;
+
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+
+        uint32_t t = ROL(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ROL(b, 30);
+        b = a;
+        a = t;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+void rom_sha1(const uint8_t *data, size_t size, uint8_t digest[20])
+{
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    size_t i;
+
+    for (i=0; i + 64 <= size; i += 64) {
+        sha1_block(h, &data[i]);
+    }
+
+    // Padding and the length in bits, one or two more blocks
+    uint8_t tail[128] = { 0 };
+    size_t rest = size - i;
+    size_t blocks = (rest + 9 > 64) ? 2 : 1;
+    uint64_t bits = (uint64_t) size * 8;
+
+    memcpy(tail, &data[i], rest);
+    tail[rest] = 0x80;
+
+    for (int j=0; j < 8; j++) {
+        tail[blocks * 64 - 1 - j] = (uint8_t) (bits >> (j * 8));
+    }
+
+    for (size_t j=0; j < blocks; j++) {
+        sha1_block(h, &tail[j * 64]);
+    }
+
+    for (int j=0; j < 20; j++) {
+        digest[j] = (uint8_t) (h[j / 4] >> (24 - (j % 4) * 8));
+    }
+}
+
+static void sha1_hex(const uint8_t sha1[20], char hex[41])
+{
+    for (int i=0; i < 20; i++) {
+        sprintf(&hex[i * 2], "%02x", sha1[i]);
+    }
+}
+
+static bool parse_sha1(const char *hex, uint8_t sha1[20])
+{
+    for (int i=0; i < 20; i++) {
+        unsigned int byte;
+
+        if (sscanf(&hex[i * 2], "%2x", &byte) != 1) {
+            return false;
+        }
+
+        sha1[i] = (uint8_t) byte;
+    }
+
+    return true;
+}
+
+/* <$xdg or ~/fallback>/gameboy-emulator/file, the directories are created if asked to */
+static bool user_path(char *path, size_t size, const char *xdg, const char *fallback, const char *file, bool create)
+{
+    const char *base = getenv(xdg);
+
+    if (base && base[0]) {
+        snprintf(path, size, "%s/gameboy-emulator/%s", base, file);
+    } else if ((base = getenv("HOME")) && base[0]) {
+        snprintf(path, size, "%s/%s/gameboy-emulator/%s", base, fallback, file);
+    #ifdef _WIN32
+    } else if ((base = getenv("LOCALAPPDATA")) && base[0]) {
+        snprintf(path, size, "%s/gameboy-emulator/%s", base, file);
+    #endif
+    } else {
+        return false;
+    }
+
+    if (create) {
+        char *slash = strrchr(path, '/');
+
+        for (char *p = path + 1; p <= slash; p++) {
+            if (*p == '/') {
+                *p = '\0';
+                mkdir(path, 0755);
+                *p = '/';
+            }
+        }
+    }
+
+    return true;
+}
+
+/* Splits an index line, returns the path or NULL if the line isn't an entry */
+static const char* parse_entry(char *line, long long *size, long long *mtime, uint32_t *crc32, uint8_t sha1[20], uint8_t *checksums)
+{
+    unsigned int crc;
+    unsigned int flags;
+    char hex[41];
+    int offset;
+
+    if (sscanf(line, "%lld %lld %8x %40s %x %n", size, mtime, &crc, hex, &flags, &offset) != 5 || !parse_sha1(hex, sha1)) {
+        return NULL;
+    }
+
+    line[strcspn(line, "\r\n")] = '\0';
+
+    *crc32 = crc;
+    *checksums = (uint8_t) flags;
+
+    return &line[offset];
+}
+
+static bool index_lookup(const char *index_path, const char *key, const struct stat *st, rom_info_t *info)
+{
+    FILE *fp = fopen(index_path, "r");
+
+    if (!fp) {
+        return false;
+    }
+
+    char line[PATH_MAX + 128];
+    bool found = false;
+
+    while (!found && fgets(line, sizeof(line), fp)) {
+        long long size, mtime;
+        const char *path = parse_entry(line, &size, &mtime, &info->crc32, info->sha1, &info->checksums);
+
+        found = (path && strcmp(path, key) == 0 && size == (long long) st->st_size && mtime == (long long) st->st_mtime);
+    }
+
+    fclose(fp);
+
+    return found;
+}
+
+/* Rewrites the index with this ROM last, the oldest entries go once it is full */
+static void index_store(const char *index_path, const char *key, const struct stat *st, const rom_info_t *info)
+{
+    char temp_path[PATH_MAX + 32];
+    snprintf(temp_path, sizeof(temp_path), "%s.%d", index_path, (int) getpid());
+
+    FILE *out = fopen(temp_path, "w");
+
+    if (!out) {
+        return;
+    }
+
+    FILE *in = fopen(index_path, "r");
+    char line[PATH_MAX + 128];
+
+    if (in) {
+        int count = 0;
+
+        while (fgets(line, sizeof(line), in)) {
+            count++;
+        }
+
+        int skip = (count >= ROM_INDEX_MAX) ? count - ROM_INDEX_MAX + 1 : 0;
+        rewind(in);
+
+        while (fgets(line, sizeof(line), in)) {
+            char entry[sizeof(line)];
+            long long size, mtime;
+            uint32_t crc32;
+            uint8_t sha1[20];
+            uint8_t checksums;
+
+            memcpy(entry, line, sizeof(line));
+
+            const char *path = parse_entry(entry, &size, &mtime, &crc32, sha1, &checksums);
+
+            if (!path || skip-- > 0 || strcmp(path, key) == 0) {
+                continue;
+            }
+
+            fputs(line, out);
+        }
+
+        fclose(in);
+    }
+
+    char hex[41];
+    sha1_hex(info->sha1, hex);
+
+    fprintf(out, "%lld %lld %08x %s %x %s\n",
+            (long long) st->st_size,
+            (long long) st->st_mtime,
+            info->crc32,
+            hex,
+            info->checksums,
+            key
+        );
+
+    // Windows can't rename over an existing file
+    #ifdef _WIN32
+    remove(index_path);
+    #endif
+
+    // Renamed into place, emulators started in parallel never see half an index
+    if (fclose(out) != 0 || rename(temp_path, index_path) != 0) {
+        remove(temp_path);
+    }
+}
+
+/* CRC32, SHA1 and the checksums, from the index while the file is unchanged */
+static bool rom_identify(const char *path, const struct stat *st)
+{
+    rom_info_t *info = &emulator.rom_info;
+    const uint8_t *rom = emulator.rom;
+    char index_path[PATH_MAX];
+    char key[PATH_MAX];
+
+    if (!realpath(path, key)) {
+        snprintf(key, sizeof(key), "%s", path);
+    }
+
+    bool indexed = user_path(index_path, sizeof(index_path), "XDG_CACHE_HOME", ".cache", ROM_INDEX_FILE, true);
+
+    if (indexed && index_lookup(index_path, key, st, info)) {
+        return true;
+    }
+
+    info->crc32 = rom_crc32(0, rom, emulator.rom_size);
+    rom_sha1(rom, emulator.rom_size, info->sha1);
+
+    // The boot ROM locks up if the header checksum is wrong, nothing checks the global one
+    uint8_t header = 0;
+
+    for (int i=ROM_TITLE_OFFSET; i < ROM_HEADER_CHECKSUM_OFFSET; i++) {
+        header = header - rom[i] - 1;
+    }
+
+    uint16_t global = 0;
+
+    for (long i=0; i < emulator.rom_size; i++) {
+        if (i != ROM_GLOBAL_CHECKSUM_OFFSET && i != ROM_GLOBAL_CHECKSUM_OFFSET + 1) {
+            global += rom[i];
+        }
+    }
+
+    info->checksums = 0;
+
+    if (header == rom[ROM_HEADER_CHECKSUM_OFFSET]) {
+        info->checksums |= ROM_HEADER_OK;
+    }
+
+    if (global == ((rom[ROM_GLOBAL_CHECKSUM_OFFSET] << 8) | rom[ROM_GLOBAL_CHECKSUM_OFFSET + 1])) {
+        info->checksums |= ROM_GLOBAL_OK;
+    }
+
+    if (indexed) {
+        index_store(index_path, key, st, info);
+    }
+
+    return false;
+}
+
+/* Applies the first matching database entry, type and ram_banks are only changed if it overrides them */
+static void rom_lookup(int *type, int *ram_banks)
+{
+    rom_info_t *info = &emulator.rom_info;
+    char path[PATH_MAX];
+
+    if (rom_config.db_path) {
+        snprintf(path, sizeof(path), "%s", rom_config.db_path);
+    } else if (!user_path(path, sizeof(path), "XDG_DATA_HOME", ".local/share", ROM_DB_FILE, false)) {
+        return;
+    }
+
+    FILE *fp = fopen(path, "r");
+
+    // Only an explicit database has to exist
+    if (!fp) {
+        if (rom_config.db_path) {
+            printf("[emulator] Unable to open %s\n", path);
+            exit(-1);
+        }
+
+        return;
+    }
+
+    char line[1024];
+    char sha1[41];
+    sha1_hex(info->sha1, sha1);
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *token = strtok(line, " \t\r\n");
+
+        if (!token || token[0] == '#' || strtoul(token, NULL, 16) != info->crc32) {
+            continue;
+        }
+
+        if (!(token = strtok(NULL, " \t\r\n")) || (strcmp(token, "-") != 0 && strcasecmp(token, sha1) != 0)) {
+            continue;
+        }
+
+        while ((token = strtok(NULL, " \t\r\n"))) {
+            if (strncmp(token, "type=", 5) == 0) {
+                *type = (int) strtoul(token + 5, NULL, 16) & 0xFF;
+            } else if (strncmp(token, "ram=", 4) == 0) {
+                *ram_banks = atoi(token + 4);
+            } else if (strncmp(token, "ppu=", 4) == 0) {
+                snprintf(info->ppu, sizeof(info->ppu), "%s", token + 4);
+            } else if (strncmp(token, "name=", 5) == 0) {
+                // The rest of the line, strtok already cut it at the first space
+                char *rest = strtok(NULL, "\r\n");
+                snprintf(info->name, sizeof(info->name), "%s%s%s", token + 5, rest ? " " : "", rest ? rest : "");
+                break;
+            } else {
+                printf("[emulator] Unknown option in %s: %s\n", path, token);
+            }
+        }
+
+        break;
+    }
+
+    fclose(fp);
+}
+
+static uint32_t read_le(const uint8_t *p, int size)
+{
+    uint32_t value = 0;
+
+    for (int i=0; i < size; i++) {
+        value |= (uint32_t) p[i] << (i * 8);
+    }
+
+    return value;
+}
+
+/* Decompressed ROMs live in anonymous memory, like a file mapping nothing is ever written back */
+static uint8_t* rom_map(const char *path, uint32_t size)
+{
+    if (size < ROM_HEADER_SIZE || size > ROM_MAX_BANKS * 0x4000) {
+        printf("[emulator] %s doesn't contain a ROM (%u bytes)\n", path, size);
+        exit(-1);
+    }
+
+    #ifdef _WIN32
+    uint8_t *rom = (uint8_t *) malloc(size);
+
+    if (!rom) {
+    #else
+    uint8_t *rom = (uint8_t *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (rom == MAP_FAILED) {
+    #endif
+        printf("[emulator] Unable to map %u bytes for %s\n", size, path);
+        exit(-1);
+    }
+
+    return rom;
+}
+
+static void rom_inflate(const char *path, const uint8_t *in, size_t in_size, uint8_t *out, uint32_t size, uint32_t crc32)
+{
+    if (inflate_raw(in, in_size, out, size) != (long) size || rom_crc32(0, out, size) != crc32) {
+        printf("[emulator] %s is corrupt\n", path);
+        exit(-1);
+    }
+}
+
+/* A single member, the trailer has the size and CRC32 of the ROM */
+static uint8_t* extract_gzip(const char *path, const uint8_t *data, long size, long *rom_size)
+{
+    uint8_t flags = data[3];
+    long pos = 10;
+
+    if (size < 18 || data[2] != 8) {
+        printf("[emulator] %s is not a deflated gzip file\n", path);
+        exit(-1);
+    }
+
+    if (flags & 0x04) {
+        pos += 2 + read_le(&data[pos], 2);
+    }
+
+    // File name and comment
+    for (int field = 0x08; field <= 0x10; field <<= 1) {
+        if (flags & field) {
+            while (pos < size && data[pos++]);
+        }
+    }
+
+    if (flags & 0x02) {
+        pos += 2;
+    }
+
+    if (pos > size - 8) {
+        printf("[emulator] %s is corrupt\n", path);
+        exit(-1);
+    }
+
+    uint32_t length = read_le(&data[size - 4], 4);
+    uint8_t *rom = rom_map(path, length);
+
+    rom_inflate(path, &data[pos], size - 8 - pos, rom, length, read_le(&data[size - 8], 4));
+    *rom_size = length;
+
+    return rom;
+}
+
+/* The first .gb/.gbc/.sgb in the central directory, otherwise the first file */
+static uint8_t* extract_zip(const char *path, const uint8_t *data, long size, long *rom_size)
+{
+    const uint8_t *end = NULL;
+
+    // The end of central directory record is followed by a comment of up to 64 KB
+    for (long pos = size - 22; pos >= 0 && pos >= size - 22 - 0xFFFF; pos--) {
+        if (read_le(&data[pos], 4) == 0x06054B50) {
+            end = &data[pos];
+            break;
+        }
+    }
+
+    if (!end) {
+        printf("[emulator] %s is not a zip file\n", path);
+        exit(-1);
+    }
+
+    uint32_t directory_offset = read_le(&end[16], 4);
+
+    if (directory_offset > (uint32_t) (end - data)) {
+        printf("[emulator] %s is corrupt\n", path);
+        exit(-1);
+    }
+
+    const uint8_t *entry = NULL;
+    const uint8_t *p = &data[directory_offset];
+    uint32_t count = read_le(&end[10], 2);
+
+    for (uint32_t i=0; i < count && end - p >= 46 && read_le(p, 4) == 0x02014B50; i++) {
+        uint32_t name_length = read_le(&p[28], 2);
+        uint32_t entry_length = 46 + name_length + read_le(&p[30], 2) + read_le(&p[32], 2);
+
+        // The whole entry has to fit before the end record
+        if (entry_length > (uint32_t) (end - p)) {
+            break;
+        }
+
+        const char *name = (const char *) &p[46];
+        const char *extension = NULL;
+
+        for (uint32_t j=0; j < name_length; j++) {
+            if (name[j] == '.') {
+                extension = &name[j];
+            }
+        }
+
+        bool directory = (name_length && name[name_length - 1] == '/');
+        bool rom = extension && (strncasecmp(extension, ".gb", 3) == 0 || strncasecmp(extension, ".sgb", 4) == 0);
+
+        if (!directory && (!entry || rom)) {
+            entry = p;
+
+            if (rom) {
+                break;
+            }
+        }
+
+        p += entry_length;
+    }
+
+    if (!entry) {
+        printf("[emulator] %s contains no files\n", path);
+        exit(-1);
+    }
+
+    uint32_t method = read_le(&entry[10], 2);
+    uint32_t crc32 = read_le(&entry[16], 4);
+    uint32_t compressed = read_le(&entry[20], 4);
+    uint32_t length = read_le(&entry[24], 4);
+    long local = read_le(&entry[42], 4);
+
+    if ((read_le(&entry[8], 2) & 0x01) || (method != 0 && method != 8)) {
+        printf("[emulator] %s is encrypted or not stored/deflated\n", path);
+        exit(-1);
+    }
+
+    // Sizes are taken from the central directory, the local header may leave them to a data descriptor
+    if (local > size - 30 || read_le(&data[local], 4) != 0x04034B50) {
+        printf("[emulator] %s is corrupt\n", path);
+        exit(-1);
+    }
+
+    long start = local + 30 + read_le(&data[local + 26], 2) + read_le(&data[local + 28], 2);
+
+    if (start > size || compressed > (uint32_t) (size - start)) {
+        printf("[emulator] %s is corrupt\n", path);
+        exit(-1);
+    }
+
+    uint8_t *rom = rom_map(path, length);
+
+    if (method == 0) {
+        if (compressed != length || rom_crc32(0, &data[start], length) != crc32) {
+            printf("[emulator] %s is corrupt\n", path);
+            exit(-1);
+        }
+
+        memcpy(rom, &data[start], length);
+    } else {
+        rom_inflate(path, &data[start], compressed, rom, length, crc32);
+    }
+
+    *rom_size = length;
+
+    return rom;
+}
+
+/* Decompressed once, then mapped from <cache dir>/gameboy-emulator/roms/<archive SHA1>.gb */
+static uint8_t* rom_extract(const char *path, const uint8_t *data, long size, long *rom_size, bool *cached)
+{
+    uint8_t digest[20];
+    char file[64];
+    char hex[41];
+    char cache_path[PATH_MAX];
+
+    rom_sha1(data, size, digest);
+    sha1_hex(digest, hex);
+    snprintf(file, sizeof(file), "roms/%s.gb", hex);
+
+    bool cacheable = user_path(cache_path, sizeof(cache_path), "XDG_CACHE_HOME", ".cache", file, true);
+    int fd = cacheable ? open(cache_path, O_RDONLY | O_BINARY) : -1;
+    struct stat st;
+
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size >= ROM_HEADER_SIZE && st.st_size <= ROM_MAX_BANKS * 0x4000) {
+        #ifdef _WIN32
+        uint8_t *rom = (uint8_t *) malloc(st.st_size);
+
+        if (rom && read(fd, rom, (unsigned int) st.st_size) != (int) st.st_size) {
+            free(rom);
+            rom = NULL;
+        }
+
+        close(fd);
+
+        if (rom) {
+        #else
+        uint8_t *rom = (uint8_t *) mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+        close(fd);
+
+        if (rom != MAP_FAILED) {
+        #endif
+            *rom_size = (long) st.st_size;
+            *cached = true;
+            return rom;
+        }
+    } else if (fd >= 0) {
+        close(fd);
+    }
+
+    uint8_t *rom = (data[0] == 0x1F) ? extract_gzip(path, data, size, rom_size) : extract_zip(path, data, size, rom_size);
+
+    if (cacheable) {
+        char temp_path[PATH_MAX + 32];
+        snprintf(temp_path, sizeof(temp_path), "%s.%d", cache_path, (int) getpid());
+
+        FILE *fp = fopen(temp_path, "wb");
+
+        if (fp) {
+            bool written = (fwrite(rom, 1, *rom_size, fp) == (size_t) *rom_size);
+
+            if (fclose(fp) != 0 || !written || rename(temp_path, cache_path) != 0) {
+                remove(temp_path);
+            }
+        }
+    }
+
+    *cached = false;
+
+    return rom;
+}
+
+static int ram_size_banks(uint8_t code)
+{
+    switch(code) {
+        // No RAM
+        case 0x00:
+            return 0;
+
+        // 2 KB, unofficial, mirrored in a whole bank
+        case 0x01:
+        // 1 bank
+        case 0x02:
+            return 1;
+
+        // 4 banks
+        case 0x03:
+            return 4;
+
+        // 16 banks
+        case 0x04:
+            return 16;
+
+        // 8 banks
+        case 0x05:
+            return 8;
+
+        default:
+            printf("[emulator] Unknown RAM size %02X, running without RAM\n", code);
+            return 0;
+    }
+}
+
+void load_rom(const char *path)
+{
+    FILE *rom_fp = fopen(path, "rb");
+    struct stat st;
+
+    if (!rom_fp || fstat(fileno(rom_fp), &st) != 0) {
+        printf("[emulator] Unable to open %s\n", path);
+        exit(-1);
+    }
+
+    long size = (long) st.st_size;
+
+    if (!S_ISREG(st.st_mode) || size < 4 || size > ROM_MAX_BANKS * 0x4000) {
+        printf("[emulator] %s is not a ROM (%ld bytes)\n", path, size);
+        exit(-1);
+    }
+
+    uint8_t *data = (uint8_t *) malloc(size);
+
+    if (!data || fread(data, 1, size, rom_fp) != (size_t) size) {
+        printf("[emulator] Unable to read %s\n", path);
+        exit(-1);
+    }
+
+    fclose(rom_fp);
+
+    // Archives are told apart by their signature, not the extension
+    bool gzip = (data[0] == 0x1F && data[1] == 0x8B);
+    bool zip = (read_le(data, 4) == 0x04034B50);
+
+    if (gzip || zip) {
+        long archive_size = size;
+        bool unpacked;
+
+        emulator.rom = rom_extract(path, data, archive_size, &size, &unpacked);
+        free(data);
+
+        printf("[emulator] Loaded %s (%ld bytes, %s from %ld)\n", path, size, unpacked ? "cached" : "decompressed", archive_size);
+    } else {
+        if (size < ROM_HEADER_SIZE) {
+            printf("[emulator] %s is not a ROM (%ld bytes)\n", path, size);
+            exit(-1);
+        }
+
+        emulator.rom = data;
+
+        printf("[emulator] Loaded %s (%ld bytes)\n", path, size);
+    }
+
+    emulator.rom_size = size;
+    memcpy(mmu.rom, emulator.rom, (size > 0x8000) ? 0x8000 : size);
+
+    rom_info_t *info = &emulator.rom_info;
+    memset(info, 0x00, sizeof(rom_info_t));
+
+    bool cached = rom_identify(path, &st);
+
+    // Title
+    memcpy(info->title, &emulator.rom[ROM_TITLE_OFFSET], 16);
+
+    info->cgb = emulator.rom[ROM_CGB_FLAG_OFFSET] & 0x80;
+    info->sgb = emulator.rom[ROM_SGB_FLAG_OFFSET] == 0x03;
+
+    int type = emulator.rom[ROM_CARTRIDGE_TYPE_OFFSET];
+    int ram_banks = ram_size_banks(emulator.rom[ROM_RAM_SIZE_OFFSET]);
+
+    rom_lookup(&type, &ram_banks);
+
+    // Cartridge type
+    info->cartridge_type = (uint8_t) type;
+    const char *type_name = cartridge_type_names[info->cartridge_type];
+    snprintf(info->cartridge_type_name, sizeof(info->cartridge_type_name), "%s", type_name ? type_name : "UNKNOWN");
+
+    switch(info->cartridge_type) {
+        case ROM_CARTRIDGE_TYPE_ROMONLY:
+            mbc.type = MBC_TYPE_NOMBC;
+            break;
+
+        case ROM_CARTRIDGE_TYPE_MBC1:
+        case ROM_CARTRIDGE_TYPE_MBC1RAM:
+        case ROM_CARTRIDGE_TYPE_MBC1RAMBAT:
+            mbc.type = MBC_TYPE_MBC1;
+            break;
+
+        case ROM_CARTRIDGE_TYPE_MBC2:
+        case ROM_CARTRIDGE_TYPE_MBC2BAT:
+            mbc.type = MBC_TYPE_MBC2;
+            break;
+
+        case ROM_CARTRIDGE_TYPE_MBC3TIMERBAT:
+        case ROM_CARTRIDGE_TYPE_MBC3TIMERRAMBAT:
+        case ROM_CARTRIDGE_TYPE_MBC3:
+        case ROM_CARTRIDGE_TYPE_MBC3RAM:
+        case ROM_CARTRIDGE_TYPE_MBC3RAMBAT:
+            mbc.type = MBC_TYPE_MBC3;
+            break;
+
+        case ROM_CARTRIDGE_TYPE_MBC5:
+        case ROM_CARTRIDGE_TYPE_MBC5RAM:
+        case ROM_CARTRIDGE_TYPE_MBC5RAMBAT:
+        case ROM_CARTRIDGE_TYPE_MBC5RUMBLE:
+        case ROM_CARTRIDGE_TYPE_MBC5RUMBLERAM:
+        case ROM_CARTRIDGE_TYPE_MBC5RUMBLERAMBAT:
+            mbc.type = MBC_TYPE_MBC5;
+            break;
+
+        default:
+            printf("[emulator] Unsupported cartridge type %02X (%s), running it without an MBC\n", type, info->cartridge_type_name);
+            mbc.type = MBC_TYPE_NOMBC;
+            break;
+    }
+
+    switch(info->cartridge_type) {
+        case ROM_CARTRIDGE_TYPE_MBC3TIMERBAT:
+        case ROM_CARTRIDGE_TYPE_MBC3TIMERRAMBAT:
+            info->rtc = true;
+            // Fall through
+
+        case ROM_CARTRIDGE_TYPE_MBC1RAMBAT:
+        case ROM_CARTRIDGE_TYPE_MBC2BAT:
+        case ROM_CARTRIDGE_TYPE_MBC3RAMBAT:
+        case ROM_CARTRIDGE_TYPE_MBC5RAMBAT:
+        case ROM_CARTRIDGE_TYPE_MBC5RUMBLERAMBAT:
+            info->battery = true;
+            break;
+    }
+
+    // ROM banks, a header that disagrees with the file loses
+    uint32_t banks = (emulator.rom[ROM_ROM_SIZE_OFFSET] <= 0x08) ? 2u << emulator.rom[ROM_ROM_SIZE_OFFSET] : 0;
+
+    if ((long) banks * 0x4000 < size) {
+        uint32_t needed = 2;
+
+        while ((long) needed * 0x4000 < size) {
+            needed <<= 1;
+        }
+
+        printf("[emulator] Header says %u ROM banks, the file has %ld bytes, using %u\n", banks, size, needed);
+        banks = needed;
+    } else if ((long) banks * 0x4000 > size) {
+        printf("[emulator] Header says %u ROM banks, the file is only %ld bytes\n", banks, size);
+    }
+
+    info->rom_banks = (uint16_t) banks;
+    mbc.rom_banks = info->rom_banks;
+
+    // Missing banks read as open bus
+    mbc.rom = (uint8_t *) malloc(0x4000 * mbc.rom_banks);
+    memset(mbc.rom, 0xFF, 0x4000 * mbc.rom_banks);
+    memcpy(mbc.rom, emulator.rom, size);
+
+    // MBC2 has 512 half bytes built in, the header says no RAM
+    if (mbc.type == MBC_TYPE_MBC2) {
+        ram_banks = 1;
+    }
+
+    info->ram_banks = (uint8_t) ((ram_banks < 0) ? 0 : (ram_banks > 16) ? 16 : ram_banks);
+    mbc.ram_banks = info->ram_banks;
+    mbc.ram = (uint8_t *) calloc(mbc.ram_banks, 0x2000);
+
+    if (info->ppu[0] && !rom_config.ppu_selected && !lcd_select_engine(info->ppu)) {
+        printf("[emulator] Unknown PPU engine in the database: %s\n", info->ppu);
+    }
+
+    char title[17];
+    char sha1[41];
+
+    snprintf(title, sizeof(title), "%.16s", info->title);
+    sha1_hex(info->sha1, sha1);
+
+    printf("[emulator] %s | %s | %u KB ROM | %u KB RAM | CRC32 %08x | SHA1 %s%s%s%s\n",
+            info->name[0] ? info->name : title,
+            info->cartridge_type_name,
+            info->rom_banks * 16,
+            info->ram_banks * 8,
+            info->crc32,
+            sha1,
+            cached ? " | cached" : "",
+            (info->checksums & ROM_HEADER_OK) ? "" : " | BAD HEADER CHECKSUM",
+            (info->checksums & ROM_GLOBAL_OK) ? "" : " | bad global checksum"
+        );
+
+    mbc_init();
+}
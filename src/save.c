@@ -0,0 +1,203 @@
+#include "emulator.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Windows has no mmap, cartridge RAM is a copy of the file there and written pages are written back
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+save_t save;
+
+/* Only pages written since the last pass, on the save thread */
+static void save_flush()
+{
+    bool flushed = false;
+
+    for (size_t i=0; i * save.page_size < save.size; i++) {
+        if (!SDL_AtomicSet(&save.dirty[i], 0)) {
+            continue;
+        }
+
+        size_t offset = i * save.page_size;
+        size_t length = (save.size - offset < save.page_size) ? save.size - offset : save.page_size;
+
+        #ifdef _WIN32
+        if (lseek(save.fd, (long) offset, SEEK_SET) < 0 || write(save.fd, &save.data[offset], (unsigned int) length) != (int) length) {
+            printf("[save] Unable to write the save file!\n");
+        }
+        #else
+        msync(&save.data[offset], length, MS_SYNC);
+        #endif
+
+        save.pages++;
+        flushed = true;
+    }
+
+    save.flushes += flushed;
+}
+
+static int save_run(void *data)
+{
+    (void) data;
+
+    zone_thread("save");
+
+    while (SDL_AtomicGet(&save.running)) {
+        // Only woken early to stop, so flushes are at least an interval apart
+        SDL_SemWaitTimeout(save.wake, SAVE_FLUSH_INTERVAL);
+
+        ZONE("save_flush");
+        save_flush();
+    }
+
+    return 0;
+}
+
+/* Maps <rom>.sav as cartridge RAM if the cartridge has a battery, returns false if it has none or that failed */
+bool save_start(const char *rom_path)
+{
+    if (!emulator.rom_info.battery) {
+        return false;
+    }
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s", rom_path);
+
+    char *extension = strrchr(path, '.');
+
+    if (extension && !strchr(extension, '/')) {
+        *extension = '\0';
+    }
+
+    strncat(path, ".sav", sizeof(path) - strlen(path) - 1);
+
+    size_t ram_size = (size_t) mbc.ram_banks * 0x2000;
+
+    save.size = ram_size + (emulator.rom_info.rtc ? SAVE_RTC_SIZE : 0);
+    #ifdef _WIN32
+    save.page_size = 4096;
+    #else
+    save.page_size = (size_t) sysconf(_SC_PAGESIZE);
+    #endif
+
+    if (save.size == 0 || save.size > save.page_size * SAVE_MAX_PAGES) {
+        return false;
+    }
+
+    save.fd = open(path, O_RDWR | O_CREAT | O_BINARY, 0644);
+
+    if (save.fd < 0) {
+        printf("[save] Unable to open %s, the game can't be saved\n", path);
+        return false;
+    }
+
+    struct stat st;
+    bool full_size = (fstat(save.fd, &st) == 0 && (size_t) st.st_size >= save.size);
+
+    #ifdef _WIN32
+    // What a short file lacks stays zero, like ftruncate would fill it
+    save.data = (uint8_t *) calloc(1, save.size);
+
+    if (!save.data || read(save.fd, save.data, (unsigned int) save.size) < 0) {
+        printf("[save] Unable to read %s, the game can't be saved\n", path);
+        free(save.data);
+        close(save.fd);
+        return false;
+    }
+    #else
+    // Grows new or short files with zeros, longer files from other emulators are left alone
+    if (!full_size && ftruncate(save.fd, save.size) != 0) {
+        printf("[save] Unable to resize %s, the game can't be saved\n", path);
+        close(save.fd);
+        return false;
+    }
+
+    save.data = (uint8_t *) mmap(NULL, save.size, PROT_READ | PROT_WRITE, MAP_SHARED, save.fd, 0);
+
+    if (save.data == MAP_FAILED) {
+        printf("[save] Unable to map %s, the game can't be saved\n", path);
+        close(save.fd);
+        return false;
+    }
+    #endif
+
+    free(mbc.ram);
+    mbc.ram = save.data;
+
+    if (emulator.rom_info.rtc) {
+        mbc.rtc_file = &save.data[ram_size];
+
+        if (!full_size) {
+            memset(mbc.rtc_file, 0x00, SAVE_RTC_SIZE);
+        }
+    }
+
+    for (int i=0; i < SAVE_MAX_PAGES; i++) {
+        SDL_AtomicSet(&save.dirty[i], 0);
+    }
+
+    save.flushes = 0;
+    save.pages = 0;
+    save.enabled = true;
+
+    // Remaps the RAM and loads the clock
+    mbc_init();
+
+    save.wake = SDL_CreateSemaphore(0);
+    SDL_AtomicSet(&save.running, 1);
+    save.thread = SDL_CreateThread(save_run, "save", NULL);
+
+    if (!save.wake || !save.thread) {
+        printf("[save] Unable to start flush thread!\n");
+        exit(-1);
+    }
+
+    printf("[save] Mapped %s (%zu bytes)\n", path, save.size);
+
+    return true;
+}
+
+void save_stop()
+{
+    if (!save.enabled) {
+        return;
+    }
+
+    // The clock keeps running while the emulator is closed
+    if (mbc.rtc_file) {
+        mbc_rtc_store();
+    }
+
+    SDL_AtomicSet(&save.running, 0);
+    SDL_SemPost(save.wake);
+    SDL_WaitThread(save.thread, NULL);
+    SDL_DestroySemaphore(save.wake);
+
+    // Whatever was written since the thread's last pass
+    save_flush();
+
+    printf("[save] %u flushes | %u pages written\n", save.flushes, save.pages);
+
+    // Cartridge RAM stays usable, just no longer backed by the file
+    mbc.ram = (uint8_t *) malloc(save.size);
+    memcpy(mbc.ram, save.data, save.size);
+    mbc.rtc_file = NULL;
+
+    #ifdef _WIN32
+    free(save.data);
+    #else
+    munmap(save.data, save.size);
+    #endif
+
+    close(save.fd);
+
+    save.enabled = false;
+    mbc_map();
+}
@@ -0,0 +1,472 @@
+#include "emulator.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+scale_t scale;
+
+static void scale_nearest(const uint32_t *source, uint32_t *output, int pitch, int y0, int y1);
+static void scale_scale2x(const uint32_t *source, uint32_t *output, int pitch, int y0, int y1);
+static void scale_scale3x(const uint32_t *source, uint32_t *output, int pitch, int y0, int y1);
+static void scale_xbr(const uint32_t *source, uint32_t *output, int pitch, int y0, int y1);
+static void scale_crt(const uint32_t *source, uint32_t *output, int pitch, int y0, int y1);
+
+const scale_filter_t scale_filters[SCALE_FILTER_COUNT] = {
+    { "none",    1, NULL },
+    { "nearest", 4, scale_nearest },
+    { "scale2x", 2, scale_scale2x },
+    { "scale3x", 3, scale_scale3x },
+    { "xbr",     2, scale_xbr },
+    { "crt",     4, scale_crt },
+};
+
+#define ALPHA 0xFF000000
+
+static inline const uint32_t* row_at(const uint32_t *source, int y)
+{
+    if (y < 0) y = 0;
+    if (y >= LCD_HEIGHT) y = LCD_HEIGHT - 1;
+
+    return &source[y * LCD_WIDTH];
+}
+
+/* Copies a row with its edge pixels repeated, so x - 1 and x + 1 can always be read */
+static inline void pad_row(const uint32_t *row, uint32_t *padded)
+{
+    padded[0] = row[0];
+    memcpy(&padded[1], row, sizeof(uint32_t) * LCD_WIDTH);
+    padded[LCD_WIDTH + 1] = row[LCD_WIDTH - 1];
+}
+
+static inline uint32_t dim50(uint32_t color)
+{
+    return ((color >> 1) & 0x7F7F7F7F) | ALPHA;
+}
+
+static inline uint32_t dim75(uint32_t color)
+{
+    return (color - ((color >> 2) & 0x3F3F3F3F)) | ALPHA;
+}
+
+static inline uint32_t blend(uint32_t a, uint32_t b)
+{
+    return (((a >> 1) & 0x7F7F7F7F) + ((b >> 1) & 0x7F7F7F7F)) | ALPHA;
+}
+
+#ifdef __SSE2__
+static inline __m128i select_si128(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __m128i dim50_si128(__m128i color)
+{
+    return _mm_or_si128(_mm_and_si128(_mm_srli_epi32(color, 1), _mm_set1_epi32(0x7F7F7F7F)), _mm_set1_epi32(ALPHA));
+}
+
+static inline __m128i dim75_si128(__m128i color)
+{
+    __m128i quarter = _mm_and_si128(_mm_srli_epi32(color, 2), _mm_set1_epi32(0x3F3F3F3F));
+    return _mm_or_si128(_mm_sub_epi32(color, quarter), _mm_set1_epi32(ALPHA));
+}
+#endif
+
+/* Plain pixel replication */
+static void scale_nearest(const uint32_t *source, uint32_t *output, int pitch, int y0, int y1)
+{
+    for (int y=y0; y < y1; y++) {
+        const uint32_t *in = &source[y * LCD_WIDTH];
+        uint32_t *out = &output[y * 4 * pitch];
+
+        #ifdef __SSE2__
+        for (int x=0; x < LCD_WIDTH; x += 4) {
+            __m128i pixels = _mm_loadu_si128((const __m128i *) &in[x]);
+
+            _mm_storeu_si128((__m128i *) &out[x * 4], _mm_shuffle_epi32(pixels, 0x00));
+            _mm_storeu_si128((__m128i *) &out[x * 4 + 4], _mm_shuffle_epi32(pixels, 0x55));
+            _mm_storeu_si128((__m128i *) &out[x * 4 + 8], _mm_shuffle_epi32(pixels, 0xAA));
+            _mm_storeu_si128((__m128i *) &out[x * 4 + 12], _mm_shuffle_epi32(pixels, 0xFF));
+        }
+        #else
+        for (int x=0; x < LCD_WIDTH; x++) {
+            out[x * 4] = out[x * 4 + 1] = out[x * 4 + 2] = out[x * 4 + 3] = in[x];
+        }
+        #endif
+
+        for (int i=1; i < 4; i++) {
+            memcpy(&out[i * pitch], out, sizeof(uint32_t) * LCD_WIDTH * 4);
+        }
+    }
+}
+
+/*
+    Scale2x (AdvanceMAME)
+
+    A B C
+    D E F  ->  E0 E1
+    G H I      E2 E3
+*/
+static void scale_scale2x(const uint32_t *source, uint32_t *output, int pitch, int y0, int y1)
+{
+    uint32_t padded[LCD_WIDTH + 2];
+
+    for (int y=y0; y < y1; y++) {
+        const uint32_t *above = row_at(source, y - 1);
+        const uint32_t *below = row_at(source, y + 1);
+        uint32_t *out0 = &output[y * 2 * pitch];
+        uint32_t *out1 = out0 + pitch;
+
+        pad_row(&source[y * LCD_WIDTH], padded);
+
+        #ifdef __SSE2__
+        for (int x=0; x < LCD_WIDTH; x += 4) {
+            __m128i b = _mm_loadu_si128((const __m128i *) &above[x]);
+            __m128i h = _mm_loadu_si128((const __m128i *) &below[x]);
+            __m128i d = _mm_loadu_si128((const __m128i *) &padded[x]);
+            __m128i e = _mm_loadu_si128((const __m128i *) &padded[x + 1]);
+            __m128i f = _mm_loadu_si128((const __m128i *) &padded[x + 2]);
+
+            // Nothing to do where B == H or D == F
+            __m128i flat = _mm_or_si128(_mm_cmpeq_epi32(b, h), _mm_cmpeq_epi32(d, f));
+
+            __m128i e0 = select_si128(_mm_andnot_si128(flat, _mm_cmpeq_epi32(d, b)), d, e);
+            __m128i e1 = select_si128(_mm_andnot_si128(flat, _mm_cmpeq_epi32(b, f)), f, e);
+            __m128i e2 = select_si128(_mm_andnot_si128(flat, _mm_cmpeq_epi32(d, h)), d, e);
+            __m128i e3 = select_si128(_mm_andnot_si128(flat, _mm_cmpeq_epi32(h, f)), f, e);
+
+            _mm_storeu_si128((__m128i *) &out0[x * 2], _mm_unpacklo_epi32(e0, e1));
+            _mm_storeu_si128((__m128i *) &out0[x * 2 + 4], _mm_unpackhi_epi32(e0, e1));
+            _mm_storeu_si128((__m128i *) &out1[x * 2], _mm_unpacklo_epi32(e2, e3));
+            _mm_storeu_si128((__m128i *) &out1[x * 2 + 4], _mm_unpackhi_epi32(e2, e3));
+        }
+        #else
+        for (int x=0; x < LCD_WIDTH; x++) {
+            uint32_t b = above[x], h = below[x];
+            uint32_t d = padded[x], e = padded[x + 1], f = padded[x + 2];
+
+            if (b != h && d != f) {
+                out0[x * 2] = (d == b) ? d : e;
+                out0[x * 2 + 1] = (b == f) ? f : e;
+                out1[x * 2] = (d == h) ? d : e;
+                out1[x * 2 + 1] = (h == f) ? f : e;
+            } else {
+                out0[x * 2] = out0[x * 2 + 1] = out1[x * 2] = out1[x * 2 + 1] = e;
+            }
+        }
+        #endif
+    }
+}
+
+/* Scale3x (AdvanceMAME), the 3 wide output doesn't interleave well in SSE2 so it stays scalar */
+static void scale_scale3x(const uint32_t *source, uint32_t *output, int pitch, int y0, int y1)
+{
+    uint32_t above[LCD_WIDTH + 2];
+    uint32_t center[LCD_WIDTH + 2];
+    uint32_t below[LCD_WIDTH + 2];
+
+    for (int y=y0; y < y1; y++) {
+        uint32_t *out0 = &output[y * 3 * pitch];
+        uint32_t *out1 = out0 + pitch;
+        uint32_t *out2 = out1 + pitch;
+
+        pad_row(row_at(source, y - 1), above);
+        pad_row(&source[y * LCD_WIDTH], center);
+        pad_row(row_at(source, y + 1), below);
+
+        for (int x=0; x < LCD_WIDTH; x++) {
+            uint32_t a = above[x], b = above[x + 1], c = above[x + 2];
+            uint32_t d = center[x], e = center[x + 1], f = center[x + 2];
+            uint32_t g = below[x], h = below[x + 1], i = below[x + 2];
+
+            if (b != h && d != f) {
+                out0[x * 3] = (d == b) ? d : e;
+                out0[x * 3 + 1] = ((d == b && e != c) || (b == f && e != a)) ? b : e;
+                out0[x * 3 + 2] = (b == f) ? f : e;
+                out1[x * 3] = ((d == b && e != g) || (d == h && e != a)) ? d : e;
+                out1[x * 3 + 1] = e;
+                out1[x * 3 + 2] = ((b == f && e != i) || (h == f && e != c)) ? f : e;
+                out2[x * 3] = (d == h) ? d : e;
+                out2[x * 3 + 1] = ((d == h && e != i) || (h == f && e != g)) ? h : e;
+                out2[x * 3 + 2] = (h == f) ? f : e;
+            } else {
+                out0[x * 3] = out0[x * 3 + 1] = out0[x * 3 + 2] = e;
+                out1[x * 3] = out1[x * 3 + 1] = out1[x * 3 + 2] = e;
+                out2[x * 3] = out2[x * 3 + 1] = out2[x * 3 + 2] = e;
+            }
+        }
+    }
+}
+
+static inline uint32_t distance(uint32_t a, uint32_t b)
+{
+    int r = abs((int) ((a >> 16) & 0xFF) - (int) ((b >> 16) & 0xFF));
+    int g = abs((int) ((a >> 8) & 0xFF) - (int) ((b >> 8) & 0xFF));
+    int bl = abs((int) (a & 0xFF) - (int) (b & 0xFF));
+
+    return 2 * r + 4 * g + bl;
+}
+
+/*
+    2x xBR with only the 3x3 neighbourhood (the full filter looks at 5x5).
+    A corner gets blended towards its neighbours if the edge running across
+    it is "stronger" than the one running through the center pixel.
+*/
+static void scale_xbr(const uint32_t *source, uint32_t *output, int pitch, int y0, int y1)
+{
+    uint32_t above[LCD_WIDTH + 2];
+    uint32_t center[LCD_WIDTH + 2];
+    uint32_t below[LCD_WIDTH + 2];
+
+    for (int y=y0; y < y1; y++) {
+        uint32_t *out0 = &output[y * 2 * pitch];
+        uint32_t *out1 = out0 + pitch;
+
+        pad_row(row_at(source, y - 1), above);
+        pad_row(&source[y * LCD_WIDTH], center);
+        pad_row(row_at(source, y + 1), below);
+
+        for (int x=0; x < LCD_WIDTH; x++) {
+            uint32_t a = above[x], b = above[x + 1], c = above[x + 2];
+            uint32_t d = center[x], e = center[x + 1], f = center[x + 2];
+            uint32_t g = below[x], h = below[x + 1], i = below[x + 2];
+
+            out0[x * 2] = out0[x * 2 + 1] = out1[x * 2] = out1[x * 2 + 1] = e;
+
+            if (b == h && d == f) {
+                continue;
+            }
+
+            uint32_t bd = distance(b, d), bf = distance(b, f), dh = distance(d, h), fh = distance(f, h);
+            uint32_t ea = distance(e, a), ec = distance(e, c), eg = distance(e, g), ei = distance(e, i);
+
+            if (ec + eg + 4 * bd < bf + dh + 4 * ea) {
+                out0[x * 2] = blend(e, (distance(e, b) <= distance(e, d)) ? b : d);
+            }
+
+            if (ea + ei + 4 * bf < bd + fh + 4 * ec) {
+                out0[x * 2 + 1] = blend(e, (distance(e, b) <= distance(e, f)) ? b : f);
+            }
+
+            if (ea + ei + 4 * dh < bd + fh + 4 * eg) {
+                out1[x * 2] = blend(e, (distance(e, d) <= distance(e, h)) ? d : h);
+            }
+
+            if (ec + eg + 4 * fh < bf + dh + 4 * ei) {
+                out1[x * 2 + 1] = blend(e, (distance(e, f) <= distance(e, h)) ? f : h);
+            }
+        }
+    }
+}
+
+/*
+    4x with a scanline gap (rows 3 and 4 of each pixel dimmed)
+    and a slot mask (last column of each pixel dimmed)
+*/
+static void scale_crt(const uint32_t *source, uint32_t *output, int pitch, int y0, int y1)
+{
+    for (int y=y0; y < y1; y++) {
+        const uint32_t *in = &source[y * LCD_WIDTH];
+        uint32_t *out = &output[y * 4 * pitch];
+
+        #ifdef __SSE2__
+        __m128i slot = _mm_set_epi32(-1, 0, 0, 0);
+
+        for (int x=0; x < LCD_WIDTH; x += 4) {
+            __m128i pixels = _mm_loadu_si128((const __m128i *) &in[x]);
+            __m128i columns[4] = {
+                _mm_shuffle_epi32(pixels, 0x00),
+                _mm_shuffle_epi32(pixels, 0x55),
+                _mm_shuffle_epi32(pixels, 0xAA),
+                _mm_shuffle_epi32(pixels, 0xFF)
+            };
+
+            for (int i=0; i < 4; i++) {
+                __m128i masked = select_si128(slot, dim75_si128(columns[i]), columns[i]);
+
+                _mm_storeu_si128((__m128i *) &out[x * 4 + i * 4], masked);
+                _mm_storeu_si128((__m128i *) &out[pitch + x * 4 + i * 4], masked);
+                _mm_storeu_si128((__m128i *) &out[2 * pitch + x * 4 + i * 4], dim75_si128(masked));
+                _mm_storeu_si128((__m128i *) &out[3 * pitch + x * 4 + i * 4], dim50_si128(masked));
+            }
+        }
+        #else
+        for (int x=0; x < LCD_WIDTH; x++) {
+            for (int i=0; i < 4; i++) {
+                uint32_t masked = (i == 3) ? dim75(in[x]) : in[x];
+
+                out[x * 4 + i] = masked;
+                out[pitch + x * 4 + i] = masked;
+                out[2 * pitch + x * 4 + i] = dim75(masked);
+                out[3 * pitch + x * 4 + i] = dim50(masked);
+            }
+        }
+        #endif
+    }
+}
+
+static int scale_worker(void *data)
+{
+    scale_worker_t *worker = (scale_worker_t *) data;
+
+    zone_thread("scale");
+
+    while (true) {
+        SDL_SemWait(worker->start);
+
+        if (scale.quit) {
+            return 0;
+        }
+
+        {
+            ZONE("scale_band");
+            scale.filter->func(scale.source, scale.output, scale.pitch, worker->y0, worker->y1);
+        }
+
+        SDL_SemPost(scale.done);
+    }
+}
+
+void scale_init()
+{
+    if (!scale.filter) {
+        scale.filter = &scale_filters[0];
+    }
+
+    // One core is taken by the emulator thread and this one scales a band too
+    int workers = SDL_GetCPUCount() - 2;
+
+    if (workers < 0) workers = 0;
+    if (workers > SCALE_MAX_WORKERS) workers = SCALE_MAX_WORKERS;
+
+    scale.done = SDL_CreateSemaphore(0);
+
+    for (int i=0; i < workers; i++) {
+        scale.workers[i].start = SDL_CreateSemaphore(0);
+        scale.workers[i].thread = SDL_CreateThread(scale_worker, "scale", &scale.workers[i]);
+
+        if (!scale.workers[i].thread) {
+            printf("Unable to create scale thread!\n");
+            exit(-1);
+        }
+    }
+
+    scale.worker_count = workers;
+}
+
+void scale_quit()
+{
+    scale.quit = true;
+
+    for (int i=0; i < scale.worker_count; i++) {
+        SDL_SemPost(scale.workers[i].start);
+        SDL_WaitThread(scale.workers[i].thread, NULL);
+        SDL_DestroySemaphore(scale.workers[i].start);
+    }
+
+    SDL_DestroySemaphore(scale.done);
+    scale.worker_count = 0;
+}
+
+bool scale_select(const char *name)
+{
+    for (int i=0; i < SCALE_FILTER_COUNT; i++) {
+        if (strcmp(scale_filters[i].name, name) == 0) {
+            scale.filter = &scale_filters[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void scale_next()
+{
+    int index = (int) (scale.filter - scale_filters);
+    scale_stats_t *stats = &scale.stats[index];
+
+    if (stats->frames) {
+        printf("[scale] %s: %.3f ms/frame\n", scale.filter->name, (double) stats->ticks * 1000 / SDL_GetPerformanceFrequency() / stats->frames);
+    }
+
+    scale.filter = &scale_filters[(index + 1) % SCALE_FILTER_COUNT];
+    printf("[scale] Filter: %s\n", scale.filter->name);
+}
+
+/* Converts and scales a frame into output, which must hold factor * LCD_WIDTH by factor * LCD_HEIGHT pixels */
+void scale_frame(const uint16_t *pixels, uint32_t *output, int pitch)
+{
+    ZONE("scale_frame");
+
+    uint64_t start = SDL_GetPerformanceCounter();
+
+    for (int i=0; i < LCD_WIDTH * LCD_HEIGHT; i++) {
+        scale.source[i] = video_colors[pixels[i] & (VIDEO_COLOR_COUNT - 1)];
+    }
+
+    scale.output = output;
+    scale.pitch = pitch;
+
+    int bands = scale.worker_count + 1;
+
+    for (int i=0; i < scale.worker_count; i++) {
+        scale.workers[i].y0 = LCD_HEIGHT * i / bands;
+        scale.workers[i].y1 = LCD_HEIGHT * (i + 1) / bands;
+        SDL_SemPost(scale.workers[i].start);
+    }
+
+    scale.filter->func(scale.source, output, pitch, LCD_HEIGHT * scale.worker_count / bands, LCD_HEIGHT);
+
+    for (int i=0; i < scale.worker_count; i++) {
+        SDL_SemWait(scale.done);
+    }
+
+    scale_stats_t *stats = &scale.stats[scale.filter - scale_filters];
+    stats->frames++;
+    stats->ticks += SDL_GetPerformanceCounter() - start;
+}
+
+void scale_report()
+{
+    for (int i=0; i < SCALE_FILTER_COUNT; i++) {
+        if (!scale.stats[i].frames) {
+            continue;
+        }
+
+        printf("[scale] %-8s %.3f ms/frame over %u frames\n",
+                scale_filters[i].name,
+                (double) scale.stats[i].ticks * 1000 / SDL_GetPerformanceFrequency() / scale.stats[i].frames,
+                scale.stats[i].frames
+            );
+    }
+}
+
+/* Times every filter on the given frame */
+void scale_bench(const uint16_t *pixels, uint32_t iterations)
+{
+    const scale_filter_t *selected = scale.filter;
+    uint32_t *output = (uint32_t *) malloc(sizeof(uint32_t) * LCD_WIDTH * LCD_HEIGHT * SCALE_MAX_FACTOR * SCALE_MAX_FACTOR);
+
+    for (int i=0; i < SCALE_FILTER_COUNT; i++) {
+        if (!scale_filters[i].func) {
+            continue;
+        }
+
+        scale.filter = &scale_filters[i];
+        memset(&scale.stats[i], 0x00, sizeof(scale_stats_t));
+
+        for (uint32_t j=0; j < iterations; j++) {
+            scale_frame(pixels, output, LCD_WIDTH * scale_filters[i].factor);
+        }
+
+        printf("[bench] %-8s %.3f ms/frame (%dx, %d threads)\n",
+                scale_filters[i].name,
+                (double) scale.stats[i].ticks * 1000 / SDL_GetPerformanceFrequency() / iterations,
+                scale_filters[i].factor,
+                scale.worker_count + 1
+            );
+    }
+
+    free(output);
+    scale.filter = selected;
+}
@@ -0,0 +1,86 @@
+#include "emulator.h"
+
+serial_t serial;
+
+#ifdef SERIAL_DEBUG
+#define DEBUG_SERIAL(...) LOG(LOG_SERIAL, LOG_LEVEL_DEBUG, __VA_ARGS__)
+#endif
+
+void serial_init()
+{
+    memset(&serial, 0x00, sizeof(serial_t));
+}
+
+/* Keeps the newest bytes if a ROM prints more than fits */
+static void serial_output(uint8_t data)
+{
+    if (serial.output_length == SERIAL_OUTPUT_SIZE - 1) {
+        memmove(serial.output, &serial.output[SERIAL_OUTPUT_SIZE / 2], SERIAL_OUTPUT_SIZE / 2);
+        serial.output_length -= SERIAL_OUTPUT_SIZE / 2;
+    }
+
+    serial.output[serial.output_length++] = (char) data;
+    serial.output[serial.output_length] = '\0';
+}
+
+void serial_wb(uint8_t addr, uint8_t data)
+{
+    switch(addr) {
+        case 0x01:
+            serial.data = data;
+            break;
+
+        case 0x02:
+            serial.control = data;
+
+            // Nothing is connected, with an external clock the transfer never finishes
+            if ((data & SERIAL_CONTROL_START) && (data & SERIAL_CONTROL_INTERNAL_CLOCK)) {
+                serial.bits = 8;
+                serial.cycles = SERIAL_CYCLES_PER_BIT;
+                serial_output(serial.data);
+
+                #ifdef SERIAL_DEBUG
+                DEBUG_SERIAL("Transfer -> %02X '%c'\n", serial.data, (serial.data >= 0x20 && serial.data < 0x7F) ? serial.data : '.');
+                #endif
+            }
+            break;
+    }
+}
+
+uint8_t serial_rb(uint8_t addr)
+{
+    uint8_t result = 0xFF;
+
+    switch(addr) {
+        case 0x01:
+            result = serial.data;
+            break;
+
+        case 0x02:
+            result = serial.control | 0x7E;
+            break;
+    }
+
+    return result;
+}
+
+void serial_step(uint32_t cycles)
+{
+    while (serial.bits && cycles) {
+        if (cycles < serial.cycles) {
+            serial.cycles -= cycles;
+            return;
+        }
+
+        cycles -= serial.cycles;
+        serial.cycles = SERIAL_CYCLES_PER_BIT;
+
+        // No partner, the line reads high
+        serial.data = (serial.data << 1) | 1;
+
+        if (--serial.bits == 0) {
+            serial.control &= ~SERIAL_CONTROL_START;
+            cpu_request_interrupt(CPU_IF_SERIAL);
+        }
+    }
+}
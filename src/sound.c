@@ -3,7 +3,7 @@
 sound_controller_t sound_controller;
 
 #ifdef SOUND_DEBUG
-#define DEBUG_SOUND(...) printf("[sound] "); printf(__VA_ARGS__)
+#define DEBUG_SOUND(...) LOG(LOG_SOUND, LOG_LEVEL_DEBUG, __VA_ARGS__)
 #endif
 
 void sound_power_on();
@@ -19,6 +19,7 @@ const uint8_t wave_patterns[4][8] = {
 
 void sound_init()
 {
+    memset(&sound_controller, 0x00, sizeof(sound_controller_t));
     sound_controller.buffer_position = 0;
 }
 
@@ -559,10 +560,21 @@ void sound_step(uint32_t cycles)
             if (sound_controller.buffer_position >= SOUND_BUFFER_SIZE) {
                 sound_controller.buffer_position = 0;
 
-                SDL_QueueAudio(emulator.audiodev_id, sound_controller.buffer, sizeof(float) * SOUND_BUFFER_SIZE);
-                memset(sound_controller.buffer, 0x00, sizeof(float) * SOUND_BUFFER_SIZE);
+                // No device when running headless
+                if (emulator.audiodev_id > 0) {
+                    ZONE("sound_queue");
+
+                    // emulator_run paces to real time, a buffer is only dropped if the device clock drifted far behind
+                    if (SDL_GetQueuedAudioSize(emulator.audiodev_id) < sizeof(float) * SOUND_BUFFER_SIZE * SOUND_MAX_QUEUED) {
+                        SDL_QueueAudio(emulator.audiodev_id, sound_controller.buffer, sizeof(float) * SOUND_BUFFER_SIZE);
+                    }
+                }
 
-                while (SDL_GetQueuedAudioSize(emulator.audiodev_id) > sizeof(float) * SOUND_BUFFER_SIZE) { }
+                if (capture.enabled) {
+                    capture_audio(sound_controller.buffer, SOUND_BUFFER_SIZE);
+                }
+
+                memset(sound_controller.buffer, 0x00, sizeof(float) * SOUND_BUFFER_SIZE);
             }
         }
     }
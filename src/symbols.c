@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "symbols.h"
+
+/* Sorted by address, then bank, then file order */
+static symbol_t *symbols = NULL;
+static uint32_t symbol_count = 0;
+static uint32_t symbol_capacity = 0;
+
+static char *names = NULL;
+static uint32_t names_size = 0;
+static uint32_t names_capacity = 0;
+
+static int compare_symbols(const void *a, const void *b)
+{
+    const symbol_t *symbol_a = (const symbol_t *) a;
+    const symbol_t *symbol_b = (const symbol_t *) b;
+
+    if (symbol_a->addr != symbol_b->addr) {
+        return symbol_a->addr - symbol_b->addr;
+    }
+
+    if (symbol_a->bank != symbol_b->bank) {
+        return symbol_a->bank - symbol_b->bank;
+    }
+
+    return (symbol_a->name > symbol_b->name) - (symbol_a->name < symbol_b->name);
+}
+
+static void add_symbol(uint16_t bank, uint16_t addr, const char *name, int length)
+{
+    if (symbol_count == symbol_capacity) {
+        symbol_capacity = symbol_capacity ? symbol_capacity * 2 : 1024;
+        symbols = (symbol_t *) realloc(symbols, symbol_capacity * sizeof(symbol_t));
+    }
+
+    while (names_size + length + 1 > names_capacity) {
+        names_capacity = names_capacity ? names_capacity * 2 : 16384;
+        names = (char *) realloc(names, names_capacity);
+    }
+
+    if (!symbols || !names) {
+        printf("[symbols] Out of memory\n");
+        exit(-1);
+    }
+
+    symbol_t *symbol = &symbols[symbol_count++];
+    symbol->bank = bank;
+    symbol->addr = addr;
+    symbol->name = names_size;
+
+    memcpy(&names[names_size], name, length);
+    names[names_size + length] = '\0';
+    names_size += length + 1;
+}
+
+/* "BB:AAAA Name" per line, ';' starts a comment */
+bool symbols_load(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+
+    if (!fp) {
+        return false;
+    }
+
+    char line[512];
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *p = line;
+        char *end;
+
+        while (isspace((unsigned char) *p)) {
+            p++;
+        }
+
+        if (*p == ';' || *p == '\0') {
+            continue;
+        }
+
+        unsigned long bank = strtoul(p, &end, 16);
+
+        if (end == p || *end != ':') {
+            continue;
+        }
+
+        p = end + 1;
+        unsigned long addr = strtoul(p, &end, 16);
+
+        if (end == p || addr > 0xFFFF || !isspace((unsigned char) *end)) {
+            continue;
+        }
+
+        p = end;
+
+        while (isspace((unsigned char) *p)) {
+            p++;
+        }
+
+        int length = 0;
+
+        while (p[length] && !isspace((unsigned char) p[length]) && p[length] != ';') {
+            length++;
+        }
+
+        if (length) {
+            add_symbol((uint16_t) bank, (uint16_t) addr, p, length);
+        }
+    }
+
+    fclose(fp);
+
+    qsort(symbols, symbol_count, sizeof(symbol_t), compare_symbols);
+
+    return true;
+}
+
+/* Only ROM at 4000-7FFF is banked here, elsewhere any bank matches */
+static bool bank_matches(const symbol_t *symbol, uint16_t rom_bank)
+{
+    return symbol->addr < 0x4000 || symbol->addr >= 0x8000 || symbol->bank == rom_bank;
+}
+
+/* Symbols never span areas, e.g. a ROM label doesn't cover VRAM */
+static int area(uint16_t addr)
+{
+    return (addr < 0x8000) ? addr >> 14 : addr >> 13;
+}
+
+/* First symbol at addr or above */
+static uint32_t lower_bound(uint16_t addr)
+{
+    uint32_t low = 0;
+    uint32_t high = symbol_count;
+
+    while (low < high) {
+        uint32_t middle = (low + high) / 2;
+
+        if (symbols[middle].addr < addr) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+const char* symbols_find(uint16_t rom_bank, uint16_t addr)
+{
+    for (uint32_t i = lower_bound(addr); i < symbol_count && symbols[i].addr == addr; i++) {
+        if (bank_matches(&symbols[i], rom_bank)) {
+            return &names[symbols[i].name];
+        }
+    }
+
+    return NULL;
+}
+
+/* Closest symbol at or below addr in the same area, for "Name+offset" */
+const char* symbols_nearest(uint16_t rom_bank, uint16_t addr, uint16_t *offset)
+{
+    uint32_t i = lower_bound(addr);
+
+    // Prefer an exact match, it's the first one at addr
+    if (i < symbol_count && symbols[i].addr == addr) {
+        const char *name = symbols_find(rom_bank, addr);
+
+        if (name) {
+            *offset = 0;
+            return name;
+        }
+    }
+
+    while (i-- > 0 && area(symbols[i].addr) == area(addr)) {
+        if (bank_matches(&symbols[i], rom_bank)) {
+            *offset = addr - symbols[i].addr;
+            return &names[symbols[i].name];
+        }
+    }
+
+    return NULL;
+}
+
+bool symbols_lookup(const char *name, uint16_t *bank, uint16_t *addr)
+{
+    for (uint32_t i=0; i < symbol_count; i++) {
+        if (strcmp(&names[symbols[i].name], name) == 0) {
+            *bank = symbols[i].bank;
+            *addr = symbols[i].addr;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -3,14 +3,52 @@
 timer_regs_t timer;
 
 #ifdef TIMER_DEBUG
-#define DEBUG_TIMER(...) printf("[timer] "); printf(__VA_ARGS__)
+#define DEBUG_TIMER(...) LOG(LOG_TIMER, LOG_LEVEL_DEBUG, __VA_ARGS__)
 #endif
 
+/* Divider bit whose falling edge increments TIMA, by TAC */
+static const uint8_t timer_bits[4] = { 9, 3, 5, 7 };
+
+static uint32_t timer_period()
+{
+    return 1u << (timer_bits[timer.tac & 3] + 1);
+}
+
+/* The input of the TIMA edge detector */
+static bool timer_signal(uint16_t counter, uint8_t tac)
+{
+    return (tac & TIMER_TAC_ENABLE) && (counter & (1u << timer_bits[tac & 3]));
+}
+
+/* Any number of increments at once, wrapping through TMA as often as needed */
+static void timer_increment(uint32_t increments)
+{
+    if (increments < 0x100u - timer.tima) {
+        timer.tima += increments;
+        return;
+    }
+
+    increments -= 0x100u - timer.tima;
+    timer.tima = timer.tma + increments % (0x100u - timer.tma);
+
+    // IF only holds one request, more overflows can't be told apart
+    cpu_request_interrupt(CPU_IF_TIMER);
+
+    #ifdef TIMER_DEBUG
+    LOG(LOG_TIMER, LOG_LEVEL_TRACE, "TIMA overflow\n");
+    #endif
+}
+
 void timer_wb(uint8_t addr, uint8_t data)
 {
     switch(addr) {
         case 0x04:
-            timer.div = 0;
+            // A set bit drops to 0, that is a falling edge
+            if (timer_signal(timer.counter, timer.tac)) {
+                timer_increment(1);
+            }
+
+            timer.counter = 0;
 
             #ifdef TIMER_DEBUG
             DEBUG_TIMER("-> DIV: Reset\n");
@@ -34,34 +72,18 @@ void timer_wb(uint8_t addr, uint8_t data)
             break;
 
         case 0x07:
+            // Disabling or selecting a cleared bit while the old one is set increments too
+            if (timer_signal(timer.counter, timer.tac) && !timer_signal(timer.counter, data)) {
+                timer_increment(1);
+            }
+
             timer.tac = data;
 
             #ifdef TIMER_DEBUG
-
-            uint16_t divider = 0;
-
-            switch(timer.tac & 3) {
-                case 0:
-                    timer.freq = 4096;
-                    break;
-            
-                case 1:
-                    timer.freq = 262144;
-                    break;
-
-                case 2:
-                    timer.freq = 65536;
-                    break;
-
-                case 3:
-                    timer.freq = 16384;
-                    break;
-            }
-
-            DEBUG_TIMER("-> TMA: %02X | Frequency: %d Timer enable: %s\n",
+            DEBUG_TIMER("-> TAC: %02X | Frequency: %u Timer enable: %s\n",
                         data,
-                        timer.freq,
-                        ((timer.tac & (1 << 2))) ? "Enabled" : "Disabled"
+                        CYCLES_PER_SECOND / timer_period(),
+                        (timer.tac & TIMER_TAC_ENABLE) ? "Enabled" : "Disabled"
                         );
             #endif
             break;
@@ -74,7 +96,7 @@ uint8_t timer_rb(uint8_t addr)
 
     switch (addr) {
         case 0x04:
-            result = timer.div;
+            result = timer.counter >> 8;
             break;
 
         case 0x05:
@@ -86,43 +108,38 @@ uint8_t timer_rb(uint8_t addr)
             break;
 
         case 0x07:
-            result = timer.tac;
+            result = timer.tac | 0xF8;
             break;
     }
 
     return result;
 }
 
+/* Catches up in one go, however many cycles passed */
 void timer_tick(uint32_t cycles)
 {
-    // DIV
-    timer.div_counter += cycles;
-    
-    if (timer.div_counter >= 256) {
-        timer.div_counter -= 256;
-        timer.div++;
-
-        #ifdef TIMER_DEBUG
-        DEBUG_TIMER("DIV increment\n");
-        #endif
-    }
+    uint32_t counter = timer.counter;
 
-    // TIMA
-    if (timer.tac & TIMER_TAC_ENABLE) {
-        timer.tima_counter += cycles;
+    timer.counter = (uint16_t) (counter + cycles);
 
-        if ((timer.tima_counter % (4194304 / timer.freq)) == 0) {
-            if (timer.tima == 0xFF) {
-                timer.tima = timer.tma;
+    if (timer.tac & TIMER_TAC_ENABLE) {
+        // Falling edges of the selected bit are the multiples of its period that were passed
+        int shift = timer_bits[timer.tac & 3] + 1;
+        uint64_t end = (uint64_t) counter + cycles;
 
-                cpu_request_interrupt(CPU_IF_TIMER);
+        timer_increment((uint32_t) ((end >> shift) - (counter >> shift)));
+    }
+}
 
-                #ifdef TIMER_DEBUG
-                DEBUG_TIMER("TIMA overflow\n");
-                #endif
-            } else {
-                timer.tima += 1;
-            }
-        }
+/* Until TIMA overflows and requests an interrupt, UINT32_MAX while the timer is stopped */
+uint32_t timer_cycles_to_overflow()
+{
+    if (!(timer.tac & TIMER_TAC_ENABLE)) {
+        return UINT32_MAX;
     }
-}
\ No newline at end of file
+
+    uint32_t period = timer_period();
+    uint32_t first = period - (timer.counter & (period - 1));
+
+    return first + (0xFFu - timer.tima) * period;
+}
@@ -0,0 +1,238 @@
+#include "emulator.h"
+
+bool trace_enabled = false;
+
+typedef struct trace_block_t {
+    uint32_t size;
+    uint32_t records;
+    uint8_t data[TRACE_BLOCK_SIZE];
+} trace_block_t;
+
+/* Blocks are filled by the emulator thread and written out by the trace thread */
+typedef struct trace_t {
+    FILE *fp;
+
+    trace_block_t blocks[TRACE_BLOCK_COUNT];
+    SDL_sem *free_blocks;
+    SDL_sem *used_blocks;
+    int head;
+    int tail;
+
+    trace_block_t *current;
+    trace_state_t previous;
+
+    SDL_Thread *thread;
+
+    /* Stats */
+    uint64_t records;
+    uint64_t bytes;
+    uint32_t stalls;
+} trace_t;
+
+static trace_t trace;
+
+#define TRACE_STOP 0xFFFFFFFF
+
+static void put_u32(uint8_t *p, uint32_t value)
+{
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    p[2] = (value >> 16) & 0xFF;
+    p[3] = value >> 24;
+}
+
+static int trace_run(void *data)
+{
+    (void) data;
+
+    zone_thread("trace");
+
+    while (true) {
+        SDL_SemWait(trace.used_blocks);
+
+        trace_block_t *block = &trace.blocks[trace.tail];
+        trace.tail = (trace.tail + 1) % TRACE_BLOCK_COUNT;
+
+        if (block->size == TRACE_STOP) {
+            SDL_SemPost(trace.free_blocks);
+            return 0;
+        }
+
+        uint8_t header[8];
+        put_u32(header, block->size);
+        put_u32(&header[4], block->records);
+
+        ZONE("trace_write");
+
+        fwrite(header, 1, sizeof(header), trace.fp);
+        fwrite(block->data, 1, block->size, trace.fp);
+
+        SDL_SemPost(trace.free_blocks);
+    }
+}
+
+/* Takes the next free block, only waits if the writer is a whole pool behind */
+static void trace_next_block()
+{
+    if (SDL_SemTryWait(trace.free_blocks) != 0) {
+        trace.stalls++;
+        SDL_SemWait(trace.free_blocks);
+    }
+
+    trace.current = &trace.blocks[trace.head];
+    trace.head = (trace.head + 1) % TRACE_BLOCK_COUNT;
+
+    trace.current->size = 0;
+    trace.current->records = 0;
+
+    // Each block is encoded against a zeroed state
+    memset(&trace.previous, 0x00, sizeof(trace_state_t));
+}
+
+static void trace_submit_block()
+{
+    trace.bytes += trace.current->size;
+    SDL_SemPost(trace.used_blocks);
+}
+
+bool trace_start(const char *path)
+{
+    memset(&trace, 0x00, sizeof(trace_t));
+
+    trace.fp = fopen(path, "wb");
+
+    if (!trace.fp) {
+        printf("[trace] Unable to open %s\n", path);
+        exit(-1);
+    }
+
+    uint8_t header[12];
+    memcpy(header, TRACE_MAGIC, 8);
+    put_u32(&header[8], TRACE_VERSION);
+    fwrite(header, 1, sizeof(header), trace.fp);
+
+    trace.free_blocks = SDL_CreateSemaphore(TRACE_BLOCK_COUNT);
+    trace.used_blocks = SDL_CreateSemaphore(0);
+    trace.thread = SDL_CreateThread(trace_run, "trace", NULL);
+
+    if (!trace.free_blocks || !trace.used_blocks || !trace.thread) {
+        printf("[trace] Unable to start writer thread!\n");
+        exit(-1);
+    }
+
+    trace_next_block();
+    trace_enabled = true;
+
+    return true;
+}
+
+void trace_stop()
+{
+    if (!trace_enabled) {
+        return;
+    }
+
+    trace_enabled = false;
+
+    if (trace.current->records) {
+        trace_submit_block();
+        trace_next_block();
+    }
+
+    trace.current->size = TRACE_STOP;
+    SDL_SemPost(trace.used_blocks);
+    SDL_WaitThread(trace.thread, NULL);
+
+    fclose(trace.fp);
+
+    SDL_DestroySemaphore(trace.free_blocks);
+    SDL_DestroySemaphore(trace.used_blocks);
+
+    printf("[trace] %llu instructions | %llu bytes (%.2f per instruction) | %u stalls\n",
+            (unsigned long long) trace.records,
+            (unsigned long long) trace.bytes,
+            trace.records ? (double) trace.bytes / trace.records : 0.0,
+            trace.stalls
+        );
+}
+
+/* Called before the instruction executes, pc already points past the opcode */
+void trace_instruction(uint8_t opcode)
+{
+    trace_block_t *block = trace.current;
+
+    if (TRACE_BLOCK_SIZE - block->size < TRACE_MAX_RECORD) {
+        trace_submit_block();
+        trace_next_block();
+        block = trace.current;
+    }
+
+    trace_state_t *previous = &trace.previous;
+    uint8_t regs[8] = { cpu.regs.a, cpu.regs.b, cpu.regs.c, cpu.regs.d, cpu.regs.e, cpu.regs.h, cpu.regs.l, cpu.regs.f };
+    uint16_t pc = cpu.regs.pc - 1;
+
+    uint8_t *header = &block->data[block->size];
+    uint8_t *p = header + 2;
+    uint8_t mask = 0;
+    uint8_t flags = 0;
+
+    for (int i=0; i < 8; i++) {
+        if (regs[i] != previous->regs[i]) {
+            mask |= 1 << i;
+            *p++ = regs[i];
+            previous->regs[i] = regs[i];
+        }
+    }
+
+    p = trace_put_varint(p, trace_zigzag((int16_t) (pc - previous->pc)));
+    previous->pc = pc;
+
+    if (cpu.regs.sp != previous->sp) {
+        flags |= TRACE_SP;
+        p = trace_put_varint(p, trace_zigzag((int16_t) (cpu.regs.sp - previous->sp)));
+        previous->sp = cpu.regs.sp;
+    }
+
+    if (cpu.ime != previous->ime) {
+        flags |= TRACE_IME;
+        previous->ime = cpu.ime;
+    }
+
+    if (mmu.boot_rom_mapped != previous->boot) {
+        flags |= TRACE_BOOT;
+        previous->boot = mmu.boot_rom_mapped;
+    }
+
+    if (cpu.ie != previous->ie) {
+        flags |= TRACE_IE;
+        *p++ = cpu.ie;
+        previous->ie = cpu.ie;
+    }
+
+    if (cpu.ifr != previous->ifr) {
+        flags |= TRACE_IF;
+        *p++ = cpu.ifr;
+        previous->ifr = cpu.ifr;
+    }
+
+    // Lets the operands be resolved from the ROM offline
+    uint16_t bank = mbc_bank(0x4000);
+
+    if (bank != previous->bank) {
+        flags |= TRACE_BANK;
+        p = trace_put_varint(p, bank);
+        previous->bank = bank;
+    }
+
+    p = trace_put_varint(p, cpu.cycles - previous->cycles);
+    previous->cycles = cpu.cycles;
+
+    *p++ = opcode;
+
+    header[0] = mask;
+    header[1] = flags;
+
+    block->size = (uint32_t) (p - block->data);
+    block->records++;
+    trace.records++;
+}
@@ -0,0 +1,92 @@
+#include "emulator.h"
+
+video_t video;
+
+/* ARGB8888 of each 15 bit color, the 5 bit channels are widened by repeating their top bits */
+uint32_t video_colors[VIDEO_COLOR_COUNT];
+
+static void build_colors()
+{
+    for (int color=0; color < VIDEO_COLOR_COUNT; color++) {
+        uint32_t r = color & 0x1F;
+        uint32_t g = (color >> 5) & 0x1F;
+        uint32_t b = (color >> 10) & 0x1F;
+
+        r = (r << 3) | (r >> 2);
+        g = (g << 3) | (g >> 2);
+        b = (b << 3) | (b >> 2);
+
+        video_colors[color] = 0xFF000000 | (r << 16) | (g << 8) | b;
+    }
+}
+
+void video_init()
+{
+    build_colors();
+
+    memset(video.frames, 0x00, sizeof(video.frames));
+
+    video.back = 0;
+    video.front = 1;
+    video.presented = 0;
+    SDL_AtomicSet(&video.ready, 2);
+    SDL_AtomicSet(&video.published, 0);
+}
+
+/* Called by the PPU once a frame is complete, never blocks */
+void video_publish(const uint16_t *color_buffer, const uint32_t *dirty_lines)
+{
+    ZONE("video_publish");
+
+    uint32_t sequence = (uint32_t) SDL_AtomicGet(&video.published) + 1;
+    video_frame_t *frame = &video.frames[video.back];
+
+    memcpy(frame->pixels, color_buffer, sizeof(frame->pixels));
+    memcpy(video.dirty_history[sequence % VIDEO_DIRTY_HISTORY], dirty_lines, sizeof(uint32_t) * LCD_DIRTY_WORDS);
+    frame->sequence = sequence;
+
+    // Make the pixels visible before handing the slot over
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&video.published, (int) sequence);
+    video.back = SDL_AtomicSet(&video.ready, video.back | VIDEO_FRAME_FRESH) & VIDEO_FRAME_INDEX;
+
+    if (capture.enabled) {
+        capture_frame(color_buffer);
+    }
+}
+
+/*
+    Returns the newest frame or NULL if nothing was published since the last call.
+    dirty_lines receives the rows that differ from the previously returned frame.
+*/
+video_frame_t* video_acquire(uint32_t *dirty_lines)
+{
+    if (!(SDL_AtomicGet(&video.ready) & VIDEO_FRAME_FRESH)) {
+        return NULL;
+    }
+
+    video.front = SDL_AtomicSet(&video.ready, video.front) & VIDEO_FRAME_INDEX;
+    SDL_MemoryBarrierAcquire();
+
+    video_frame_t *frame = &video.frames[video.front];
+    uint32_t skipped = frame->sequence - video.presented;
+
+    memset(dirty_lines, 0x00, sizeof(uint32_t) * LCD_DIRTY_WORDS);
+
+    if (video.presented != 0 && skipped < VIDEO_DIRTY_HISTORY) {
+        for (uint32_t sequence = video.presented + 1; sequence != frame->sequence + 1; sequence++) {
+            for (int i=0; i < LCD_DIRTY_WORDS; i++) {
+                dirty_lines[i] |= video.dirty_history[sequence % VIDEO_DIRTY_HISTORY][i];
+            }
+        }
+    }
+
+    // Full upload on the first frame or if the history was overwritten meanwhile
+    if (video.presented == 0 || (uint32_t) SDL_AtomicGet(&video.published) - video.presented >= VIDEO_DIRTY_HISTORY) {
+        memset(dirty_lines, 0xFF, sizeof(uint32_t) * LCD_DIRTY_WORDS);
+    }
+
+    video.presented = frame->sequence;
+
+    return frame;
+}
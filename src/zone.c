@@ -0,0 +1,130 @@
+#include "emulator.h"
+
+bool zones_enabled = false;
+
+static _Thread_local zone_buffer_t *zone_buffer = NULL;
+static _Thread_local const char *zone_thread_name = NULL;
+
+static zone_buffer_t *buffers[ZONE_MAX_THREADS];
+static SDL_atomic_t buffer_count;
+
+/* Clock calibration */
+static uint64_t start_clock;
+static uint64_t start_counter;
+
+void zones_start()
+{
+    start_clock = zone_clock();
+    start_counter = SDL_GetPerformanceCounter();
+    zones_enabled = true;
+}
+
+/* Names the calling thread in the exported trace */
+void zone_thread(const char *name)
+{
+    zone_thread_name = name;
+
+    if (zone_buffer) {
+        zone_buffer->thread_name = name;
+    }
+}
+
+/* Each thread gets its own buffer the first time it records, so recording never locks */
+static zone_buffer_t* zone_register()
+{
+    int index = SDL_AtomicAdd(&buffer_count, 1);
+
+    if (index >= ZONE_MAX_THREADS) {
+        return NULL;
+    }
+
+    zone_buffer_t *buffer = (zone_buffer_t *) calloc(1, sizeof(zone_buffer_t));
+    buffer->tid = index + 1;
+    buffer->thread_name = zone_thread_name;
+
+    SDL_MemoryBarrierRelease();
+    buffers[index] = buffer;
+
+    return buffer;
+}
+
+void zone_record(const char *name, uint64_t start, uint64_t end)
+{
+    if (!zone_buffer) {
+        zone_buffer = zone_register();
+
+        if (!zone_buffer) {
+            return;
+        }
+    }
+
+    zone_event_t *event = &zone_buffer->events[zone_buffer->count & (ZONE_RING_SIZE - 1)];
+    event->name = name;
+    event->start = start;
+    event->end = end;
+
+    zone_buffer->count++;
+}
+
+/* Chrome trace event format, opens in about:tracing and Perfetto. Other threads must be stopped */
+void zones_dump(const char *path)
+{
+    if (!zones_enabled) {
+        return;
+    }
+
+    zones_enabled = false;
+
+    double seconds = (double) (SDL_GetPerformanceCounter() - start_counter) / SDL_GetPerformanceFrequency();
+    double ticks_per_us = (seconds > 0) ? (zone_clock() - start_clock) / (seconds * 1000000.0) : 1.0;
+
+    FILE *fp = fopen(path, "w");
+
+    if (!fp) {
+        printf("[zone] Unable to open %s\n", path);
+        return;
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    int threads = SDL_AtomicGet(&buffer_count);
+    bool first = true;
+    uint64_t total = 0;
+
+    SDL_MemoryBarrierAcquire();
+
+    for (int i=0; i < threads && i < ZONE_MAX_THREADS; i++) {
+        zone_buffer_t *buffer = buffers[i];
+
+        if (!buffer) {
+            continue;
+        }
+
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n",
+                buffer->tid,
+                buffer->thread_name ? buffer->thread_name : "thread"
+            );
+        first = false;
+
+        uint64_t count = (buffer->count < ZONE_RING_SIZE) ? buffer->count : ZONE_RING_SIZE;
+
+        for (uint64_t j = buffer->count - count; j < buffer->count; j++) {
+            zone_event_t *event = &buffer->events[j & (ZONE_RING_SIZE - 1)];
+
+            fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    event->name,
+                    buffer->tid,
+                    (double) (event->start - start_clock) / ticks_per_us,
+                    (double) (event->end - event->start) / ticks_per_us
+                );
+        }
+
+        total += count;
+    }
+
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+
+    printf("[zone] Wrote %llu events from %d threads to %s\n", (unsigned long long) total, (threads < ZONE_MAX_THREADS) ? threads : ZONE_MAX_THREADS, path);
+}
@@ -0,0 +1,140 @@
+/*
+    Offline ROM disassembler
+
+    gbdis [--sym <file>] <rom> [bank[:start[-end]]]
+
+    Disassembles every bank, or a single bank (hex) and optionally an address
+    range inside it. Data is decoded as code too, there is no flow analysis.
+    Symbols are printed as labels and replace the operands they match.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opcodes.h"
+#include "symbols.h"
+
+#define BANK_SIZE 0x4000
+
+static uint8_t *rom = NULL;
+static long rom_size = 0;
+
+/* A whole bank is decoded at once, then printed */
+static disasm_insn_t insns[BANK_SIZE];
+
+static void load_rom(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp) {
+        printf("Unable to open %s\n", path);
+        exit(2);
+    }
+
+    fseek(fp, 0, SEEK_END);
+    rom_size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    rom = (uint8_t *) malloc(rom_size);
+
+    if (fread(rom, 1, rom_size, fp) != (size_t) rom_size) {
+        printf("Unable to read %s\n", path);
+        exit(2);
+    }
+
+    fclose(fp);
+}
+
+static void disassemble_bank(uint16_t bank, uint16_t start, uint16_t end)
+{
+    uint16_t base = bank ? 0x4000 : 0x0000;
+    long offset = (long) bank * BANK_SIZE + (start - base);
+
+    if (offset >= rom_size) {
+        return;
+    }
+
+    uint32_t size = end - start + 1;
+
+    if (offset + size > rom_size) {
+        size = rom_size - offset;
+    }
+
+    int count = disasm_decode_block(&rom[offset], size, start, insns, BANK_SIZE);
+
+    printf("\n; Bank %02X\n", bank);
+
+    for (int i=0; i < count; i++) {
+        disasm_insn_t *insn = &insns[i];
+        const char *label = symbols_find(bank, insn->addr);
+        char bytes[12] = "";
+        char text[64];
+
+        if (label) {
+            printf("%s:\n", label);
+        }
+
+        for (int j=0; j < insn->length; j++) {
+            snprintf(&bytes[j * 3], sizeof(bytes) - j * 3, "%02X ", insn->bytes[j]);
+        }
+
+        disasm_format(insn, bank, text, sizeof(text));
+        printf("    %02X:%04X  %-9s %s\n", bank, insn->addr, bytes, text);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int arg = 1;
+
+    if (arg + 1 < argc && strcmp(argv[arg], "--sym") == 0) {
+        if (!symbols_load(argv[arg + 1])) {
+            printf("Unable to open %s\n", argv[arg + 1]);
+            return 2;
+        }
+
+        arg += 2;
+    }
+
+    if (arg >= argc) {
+        printf("Usage: %s [--sym <file>] <rom> [bank[:start[-end]]]\n", argv[0]);
+        return 2;
+    }
+
+    load_rom(argv[arg++]);
+
+    uint16_t banks = (uint16_t) ((rom_size + BANK_SIZE - 1) / BANK_SIZE);
+
+    if (arg < argc) {
+        char *p;
+        uint16_t bank = (uint16_t) strtoul(argv[arg], &p, 16);
+        uint16_t base = bank ? 0x4000 : 0x0000;
+        uint16_t start = base;
+        uint16_t end = base + BANK_SIZE - 1;
+
+        if (*p == ':') {
+            start = (uint16_t) strtoul(p + 1, &p, 16);
+            end = start;
+
+            if (*p == '-') {
+                end = (uint16_t) strtoul(p + 1, &p, 16);
+            }
+        }
+
+        if (bank >= banks || start < base || end < start || end >= base + BANK_SIZE) {
+            printf("Invalid range: %s\n", argv[arg]);
+            return 2;
+        }
+
+        disassemble_bank(bank, start, end);
+        return 0;
+    }
+
+    for (uint16_t bank=0; bank < banks; bank++) {
+        uint16_t base = bank ? 0x4000 : 0x0000;
+        disassemble_bank(bank, base, base + BANK_SIZE - 1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,444 @@
+/*
+    Regression and speed harness
+
+    regress [options] <tests> <golden>
+
+    -j <jobs>           Emulators running in parallel (default: one per core)
+    --emulator <path>   Emulator binary (default: ./emulator)
+    --update            Rewrites the golden file with the current hashes
+
+    Each line of the tests file is "<rom> <frame>[,<frame>...] [movie=<file>] [ppu=<engine>]",
+    '#' starts a comment. Every ROM runs headless in its own emulator process
+    (--hash), the screen and state hashes at each frame are compared against
+    the golden file and the emulation time is reported per ROM.
+
+    "<rom> test[=<frames>]" runs a blargg or mooneye test ROM instead (--test),
+    it passes if the ROM reports so within the frames (default 3600).
+
+    Golden lines are "<name> <frame> <screen hash> <state hash>", the name is
+    the ROM path plus "@<engine>" and "+<movie>" if given.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#define REGRESS_MAX_TESTS 1024
+#define REGRESS_MAX_CHECKPOINTS 64
+#define REGRESS_MAX_GOLDEN (REGRESS_MAX_TESTS * REGRESS_MAX_CHECKPOINTS)
+
+#define REGRESS_TEST_FRAMES "3600"
+
+#define REGRESS_PENDING 0
+#define REGRESS_PASS    1
+#define REGRESS_NEW     2
+#define REGRESS_FAIL    3
+
+typedef struct checkpoint_t {
+    uint32_t frame;
+    uint64_t screen;
+    uint64_t state;
+} checkpoint_t;
+
+typedef struct test_t {
+    char name[768];
+    char rom[256];
+    char frames[256];
+    char movie[256];
+    char ppu[32];
+    bool test;
+
+    pid_t pid;
+    FILE *output;
+
+    int result;
+    char reason[128];
+    uint32_t count;
+    checkpoint_t checkpoints[REGRESS_MAX_CHECKPOINTS];
+    double seconds;     // Emulation only, as measured by the emulator
+    uint32_t frames_run;
+} test_t;
+
+typedef struct golden_t {
+    char name[768];
+    checkpoint_t checkpoint;
+} golden_t;
+
+static test_t tests[REGRESS_MAX_TESTS];
+static int test_count = 0;
+
+static golden_t golden[REGRESS_MAX_GOLDEN];
+static int golden_count = 0;
+
+static const char *emulator_path = "./emulator";
+
+static const char *result_names[] = { "?", "PASS", "NEW", "FAIL" };
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void load_tests(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+
+    if (!fp) {
+        printf("Unable to open %s\n", path);
+        exit(2);
+    }
+
+    char line[1024];
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *comment = strchr(line, '#');
+
+        if (comment) {
+            *comment = '\0';
+        }
+
+        char *token = strtok(line, " \t\r\n");
+
+        if (!token) {
+            continue;
+        }
+
+        if (test_count == REGRESS_MAX_TESTS) {
+            printf("Too many tests in %s\n", path);
+            exit(2);
+        }
+
+        test_t *test = &tests[test_count++];
+        const char *rom = token;
+        const char *movie = "";
+        const char *ppu = "";
+
+        if (!(token = strtok(NULL, " \t\r\n"))) {
+            printf("Missing frames for %s\n", rom);
+            exit(2);
+        }
+
+        if (strncmp(token, "test", 4) == 0) {
+            test->test = true;
+            token = (token[4] == '=') ? token + 5 : REGRESS_TEST_FRAMES;
+        }
+
+        snprintf(test->frames, sizeof(test->frames), "%s", token);
+
+        while ((token = strtok(NULL, " \t\r\n"))) {
+            if (strncmp(token, "movie=", 6) == 0) {
+                movie = token + 6;
+            } else if (strncmp(token, "ppu=", 4) == 0) {
+                ppu = token + 4;
+            } else {
+                printf("Unknown option for %s: %s\n", rom, token);
+                exit(2);
+            }
+        }
+
+        snprintf(test->rom, sizeof(test->rom), "%s", rom);
+        snprintf(test->movie, sizeof(test->movie), "%s", movie);
+        snprintf(test->ppu, sizeof(test->ppu), "%s", ppu);
+        snprintf(test->name, sizeof(test->name), "%s%s%s%s%s",
+                rom,
+                ppu[0] ? "@" : "", ppu,
+                movie[0] ? "+" : "", movie
+            );
+    }
+
+    fclose(fp);
+}
+
+/* A missing golden file is fine, every test is new then */
+static void load_golden(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+
+    if (!fp) {
+        return;
+    }
+
+    char line[1024];
+
+    while (fgets(line, sizeof(line), fp) && golden_count < REGRESS_MAX_GOLDEN) {
+        golden_t *entry = &golden[golden_count];
+        unsigned long long screen;
+        unsigned long long state;
+
+        if (line[0] == '#' || sscanf(line, "%767s %u %llx %llx", entry->name, &entry->checkpoint.frame, &screen, &state) != 4) {
+            continue;
+        }
+
+        entry->checkpoint.screen = screen;
+        entry->checkpoint.state = state;
+        golden_count++;
+    }
+
+    fclose(fp);
+}
+
+static const checkpoint_t* find_golden(const char *name, uint32_t frame)
+{
+    for (int i=0; i < golden_count; i++) {
+        if (golden[i].checkpoint.frame == frame && strcmp(golden[i].name, name) == 0) {
+            return &golden[i].checkpoint;
+        }
+    }
+
+    return NULL;
+}
+
+static void start_test(test_t *test)
+{
+    const char *args[16];
+    int count = 0;
+
+    args[count++] = emulator_path;
+    args[count++] = test->test ? "--test" : "--hash";
+    args[count++] = test->frames;
+
+    if (test->ppu[0]) {
+        args[count++] = "--ppu";
+        args[count++] = test->ppu;
+    }
+
+    if (test->movie[0]) {
+        args[count++] = "--replay";
+        args[count++] = test->movie;
+    }
+
+    args[count++] = test->rom;
+    args[count] = NULL;
+
+    // A file instead of a pipe, the parent only reads it once the emulator exited
+    test->output = tmpfile();
+
+    if (!test->output) {
+        printf("Unable to create a temporary file\n");
+        exit(2);
+    }
+
+    fflush(stdout);
+    test->pid = fork();
+
+    if (test->pid < 0) {
+        printf("Unable to start %s\n", emulator_path);
+        exit(2);
+    }
+
+    if (test->pid == 0) {
+        dup2(fileno(test->output), STDOUT_FILENO);
+        dup2(fileno(test->output), STDERR_FILENO);
+        execv(emulator_path, (char * const *) args);
+        _exit(127);
+    }
+}
+
+static void finish_test(test_t *test, int status)
+{
+    char line[1024];
+    rewind(test->output);
+
+    while (fgets(line, sizeof(line), test->output)) {
+        checkpoint_t *checkpoint = &test->checkpoints[test->count];
+        unsigned long long screen;
+        unsigned long long state;
+
+        if (sscanf(line, "[hash] time %lf", &test->seconds) == 1) {
+            continue;
+        }
+
+        if (sscanf(line, "[test] %*s after %u frames in %lfs", &test->frames_run, &test->seconds) == 2) {
+            continue;
+        }
+
+        if (test->count < REGRESS_MAX_CHECKPOINTS && sscanf(line, "[hash] %u %llx %llx", &checkpoint->frame, &screen, &state) == 3) {
+            checkpoint->screen = screen;
+            checkpoint->state = state;
+            test->frames_run = checkpoint->frame;
+            test->count++;
+        }
+    }
+
+    fclose(test->output);
+
+    if (test->test && WIFEXITED(status) && (WEXITSTATUS(status) == 1 || WEXITSTATUS(status) == 2)) {
+        test->result = REGRESS_FAIL;
+        snprintf(test->reason, sizeof(test->reason), (WEXITSTATUS(status) == 1) ? "failed" : "timeout");
+        return;
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        test->result = REGRESS_FAIL;
+
+        if (WIFSIGNALED(status)) {
+            snprintf(test->reason, sizeof(test->reason), "killed by signal %d", WTERMSIG(status));
+        } else {
+            snprintf(test->reason, sizeof(test->reason), "exit status %d", WEXITSTATUS(status));
+        }
+
+        return;
+    }
+
+    test->result = REGRESS_PASS;
+
+    for (uint32_t i=0; i < test->count; i++) {
+        const checkpoint_t *checkpoint = &test->checkpoints[i];
+        const checkpoint_t *expected = find_golden(test->name, checkpoint->frame);
+
+        if (!expected) {
+            test->result = REGRESS_NEW;
+            continue;
+        }
+
+        if (checkpoint->screen != expected->screen || checkpoint->state != expected->state) {
+            test->result = REGRESS_FAIL;
+            snprintf(test->reason, sizeof(test->reason), "%s differs at frame %u",
+                    (checkpoint->screen != expected->screen) ? "screen" : "state",
+                    checkpoint->frame
+                );
+
+            return;
+        }
+    }
+}
+
+/* Keeps up to jobs emulators running, reports each ROM as it finishes */
+static void run_tests(int jobs)
+{
+    int next = 0;
+    int running = 0;
+
+    while (next < test_count || running > 0) {
+        while (running < jobs && next < test_count) {
+            start_test(&tests[next++]);
+            running++;
+        }
+
+        int status;
+        pid_t pid = wait(&status);
+
+        if (pid < 0) {
+            break;
+        }
+
+        for (int i=0; i < test_count; i++) {
+            test_t *test = &tests[i];
+
+            if (test->pid != pid || test->result != REGRESS_PENDING) {
+                continue;
+            }
+
+            finish_test(test, status);
+            running--;
+
+            printf("%-4s  %8.3fs  %9.1f fps  %s%s%s\n",
+                    result_names[test->result],
+                    test->seconds,
+                    test->seconds > 0 ? test->frames_run / test->seconds : 0.0,
+                    test->name,
+                    test->reason[0] ? ": " : "",
+                    test->reason
+                );
+
+            break;
+        }
+    }
+}
+
+static void write_golden(const char *path)
+{
+    FILE *fp = fopen(path, "w");
+
+    if (!fp) {
+        printf("Unable to open %s\n", path);
+        exit(2);
+    }
+
+    fprintf(fp, "# name frame screen state\n");
+
+    for (int i=0; i < test_count; i++) {
+        for (uint32_t j=0; j < tests[i].count; j++) {
+            const checkpoint_t *checkpoint = &tests[i].checkpoints[j];
+
+            fprintf(fp, "%s %u %016llx %016llx\n",
+                    tests[i].name,
+                    checkpoint->frame,
+                    (unsigned long long) checkpoint->screen,
+                    (unsigned long long) checkpoint->state
+                );
+        }
+    }
+
+    fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+    int jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    bool update = false;
+    int arg = 1;
+
+    while (arg < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-j") == 0 && arg + 1 < argc) {
+            jobs = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "--emulator") == 0 && arg + 1 < argc) {
+            emulator_path = argv[++arg];
+        } else if (strcmp(argv[arg], "--update") == 0) {
+            update = true;
+        } else {
+            break;
+        }
+
+        arg++;
+    }
+
+    if (argc - arg != 2) {
+        printf("Usage: %s [-j <jobs>] [--emulator <path>] [--update] <tests> <golden>\n", argv[0]);
+        return 2;
+    }
+
+    if (jobs < 1) {
+        jobs = 1;
+    }
+
+    load_tests(argv[arg]);
+    load_golden(argv[arg + 1]);
+
+    double start = now();
+    run_tests(jobs);
+    double wall = now() - start;
+
+    int counts[4] = { 0 };
+    double seconds = 0;
+
+    for (int i=0; i < test_count; i++) {
+        counts[tests[i].result]++;
+        seconds += tests[i].seconds;
+    }
+
+    printf("%d passed, %d failed, %d new | %.3fs emulated in %.3fs with %d jobs\n",
+            counts[REGRESS_PASS],
+            counts[REGRESS_FAIL],
+            counts[REGRESS_NEW],
+            seconds,
+            wall,
+            jobs
+        );
+
+    if (update) {
+        write_golden(argv[arg + 1]);
+        printf("Updated %s\n", argv[arg + 1]);
+        return 0;
+    }
+
+    return counts[REGRESS_FAIL] ? 1 : 0;
+}
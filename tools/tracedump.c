@@ -0,0 +1,283 @@
+/*
+    Offline tool for the binary traces written with --trace
+
+    tracedump [options] <trace>             Prints the trace in the CPU_DEBUG_INSTRUCTIONS text format
+    tracedump [options] --diff <a> <b>      Finds the first instruction where both traces differ
+
+    --rom <file>    Resolves the operands of instructions in ROM
+    --sym <file>    RGBDS symbols for the operands
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "opcodes.h"
+#include "symbols.h"
+#include "boot.h"
+
+#define DIFF_CONTEXT 8
+
+static uint8_t *rom = NULL;
+static long rom_size = 0;
+
+typedef struct trace_reader_t {
+    const char *path;
+    FILE *fp;
+    uint8_t *block;
+    const uint8_t *p;
+    const uint8_t *end;
+    uint32_t remaining;
+    trace_state_t state;
+    uint64_t index;
+} trace_reader_t;
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void reader_open(trace_reader_t *reader, const char *path)
+{
+    uint8_t header[12];
+
+    memset(reader, 0x00, sizeof(trace_reader_t));
+    reader->path = path;
+    reader->fp = fopen(path, "rb");
+
+    if (!reader->fp) {
+        printf("Unable to open %s\n", path);
+        exit(2);
+    }
+
+    if (fread(header, 1, sizeof(header), reader->fp) != sizeof(header) || memcmp(header, TRACE_MAGIC, 8) != 0) {
+        printf("%s is not a trace\n", path);
+        exit(2);
+    }
+
+    // Version 1 only lacks the bank
+    if (get_u32(&header[8]) < 1 || get_u32(&header[8]) > TRACE_VERSION) {
+        printf("%s: unsupported trace version %u\n", path, get_u32(&header[8]));
+        exit(2);
+    }
+
+    reader->block = (uint8_t *) malloc(TRACE_BLOCK_SIZE);
+}
+
+/* Returns false at the end of the trace */
+static bool reader_next(trace_reader_t *reader)
+{
+    while (reader->remaining == 0) {
+        uint8_t header[8];
+
+        if (fread(header, 1, sizeof(header), reader->fp) != sizeof(header)) {
+            return false;
+        }
+
+        uint32_t size = get_u32(header);
+
+        if (size > TRACE_BLOCK_SIZE || fread(reader->block, 1, size, reader->fp) != size) {
+            printf("%s: truncated block after instruction %llu\n", reader->path, (unsigned long long) reader->index);
+            exit(2);
+        }
+
+        reader->p = reader->block;
+        reader->end = reader->block + size;
+        reader->remaining = get_u32(&header[4]);
+        memset(&reader->state, 0x00, sizeof(trace_state_t));
+    }
+
+    reader->p = trace_decode(reader->p, reader->end, &reader->state);
+
+    if (!reader->p) {
+        printf("%s: corrupt record at instruction %llu\n", reader->path, (unsigned long long) reader->index);
+        exit(2);
+    }
+
+    reader->remaining--;
+    reader->index++;
+
+    return true;
+}
+
+static void load_rom(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp) {
+        printf("Unable to open %s\n", path);
+        exit(2);
+    }
+
+    fseek(fp, 0, SEEK_END);
+    rom_size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    rom = (uint8_t *) malloc(rom_size);
+
+    if (fread(rom, 1, rom_size, fp) != (size_t) rom_size) {
+        printf("Unable to read %s\n", path);
+        exit(2);
+    }
+
+    fclose(fp);
+}
+
+/* Only ROM and the boot ROM can be read back, elsewhere just the opcode is known */
+static void disassemble(const trace_state_t *state, char *buffer, int size)
+{
+    uint8_t bytes[3] = { state->opcode, 0, 0 };
+    int available = 1;
+    long offset = -1;
+
+    if (state->pc < 0x0100 && state->boot) {
+        available = (state->pc < 0xFE) ? 3 : 0x100 - state->pc;
+        memcpy(bytes, &boot_rom[state->pc], available);
+    } else if (state->pc < 0x4000) {
+        offset = state->pc;
+    } else if (state->pc < 0x8000) {
+        offset = (long) state->bank * 0x4000 + (state->pc - 0x4000);
+    }
+
+    if (rom && offset >= 0 && offset + 3 <= rom_size) {
+        memcpy(bytes, &rom[offset], 3);
+        available = 3;
+    }
+
+    disasm_insn_t insn;
+    disasm_decode(bytes, available, state->pc, &insn);
+    disasm_format(&insn, state->bank, buffer, size);
+}
+
+static void print_state(const char *prefix, const trace_state_t *state)
+{
+    char text[64];
+    disassemble(state, text, sizeof(text));
+
+    // Same output as the text trace
+    printf("%s[cpu] A: %02X B: %02X C: %02X D: %02X E: %02X H: %02X L: %02X | F: %02X PC: %04X SP: %04X IME: %d IE: %02X IF: %02X Cycles: %d | %02X | %s\n",
+            prefix,
+            state->regs[0],
+            state->regs[1],
+            state->regs[2],
+            state->regs[3],
+            state->regs[4],
+            state->regs[5],
+            state->regs[6],
+            state->regs[7],
+            state->pc,
+            state->sp,
+            state->ime,
+            state->ie,
+            state->ifr,
+            (int) state->cycles,
+            state->opcode,
+            text
+        );
+}
+
+static bool state_equal(const trace_state_t *a, const trace_state_t *b)
+{
+    return memcmp(a->regs, b->regs, sizeof(a->regs)) == 0 &&
+            a->pc == b->pc &&
+            a->sp == b->sp &&
+            a->ime == b->ime &&
+            a->ie == b->ie &&
+            a->ifr == b->ifr &&
+            a->cycles == b->cycles &&
+            a->opcode == b->opcode &&
+            a->boot == b->boot &&
+            a->bank == b->bank;
+}
+
+static int dump(const char *path)
+{
+    trace_reader_t reader;
+    reader_open(&reader, path);
+
+    while (reader_next(&reader)) {
+        print_state("", &reader.state);
+    }
+
+    return 0;
+}
+
+static int diff(const char *path_a, const char *path_b)
+{
+    trace_reader_t a;
+    trace_reader_t b;
+    trace_state_t history[DIFF_CONTEXT];
+
+    reader_open(&a, path_a);
+    reader_open(&b, path_b);
+
+    while (true) {
+        bool more_a = reader_next(&a);
+        bool more_b = reader_next(&b);
+
+        if (!more_a && !more_b) {
+            printf("Traces are identical (%llu instructions)\n", (unsigned long long) a.index);
+            return 0;
+        }
+
+        if (more_a && more_b && state_equal(&a.state, &b.state)) {
+            history[a.index % DIFF_CONTEXT] = a.state;
+            continue;
+        }
+
+        uint64_t index = more_a ? a.index : b.index;
+        printf("Traces diverge at instruction %llu\n", (unsigned long long) index);
+
+        for (uint64_t i = (index > DIFF_CONTEXT) ? index - DIFF_CONTEXT + 1 : 1; i < index; i++) {
+            print_state("  ", &history[i % DIFF_CONTEXT]);
+        }
+
+        if (more_a) {
+            print_state("- ", &a.state);
+        } else {
+            printf("- (end of %s)\n", path_a);
+        }
+
+        if (more_b) {
+            print_state("+ ", &b.state);
+        } else {
+            printf("+ (end of %s)\n", path_b);
+        }
+
+        return 1;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int arg = 1;
+
+    while (arg + 1 < argc && argv[arg][0] == '-' && argv[arg][1] == '-' && strcmp(argv[arg], "--diff") != 0) {
+        if (strcmp(argv[arg], "--rom") == 0) {
+            load_rom(argv[arg + 1]);
+        } else if (strcmp(argv[arg], "--sym") == 0) {
+            if (!symbols_load(argv[arg + 1])) {
+                printf("Unable to open %s\n", argv[arg + 1]);
+                return 2;
+            }
+        } else {
+            break;
+        }
+
+        arg += 2;
+    }
+
+    if (argc - arg == 1) {
+        return dump(argv[arg]);
+    }
+
+    if (argc - arg == 3 && strcmp(argv[arg], "--diff") == 0) {
+        return diff(argv[arg + 1], argv[arg + 2]);
+    }
+
+    printf("Usage: %s [--rom <file>] [--sym <file>] <trace>\n", argv[0]);
+    printf("       %s [--rom <file>] [--sym <file>] --diff <a> <b>\n", argv[0]);
+
+    return 2;
+}